@@ -0,0 +1,38 @@
+
+#ifndef TIMELAPSEDOTMAP_ALIGNED_H
+#define TIMELAPSEDOTMAP_ALIGNED_H
+
+#include <cstdlib>
+#include <new>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+// frames are aligned to a cache line so SIMD kernels can use aligned loads
+static const size_t FRAME_ALIGNMENT = 64;
+
+inline void* AlignedAlloc(size_t size, size_t alignment = FRAME_ALIGNMENT) {
+#ifdef _WIN32
+    void* ptr = _aligned_malloc(size, alignment);
+#else
+    void* ptr = NULL;
+    if (posix_memalign(&ptr, alignment, size) != 0) {
+        ptr = NULL;
+    }
+#endif
+    if (ptr == NULL) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+inline void AlignedFree(void* ptr) {
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+#endif //TIMELAPSEDOTMAP_ALIGNED_H
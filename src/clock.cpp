@@ -0,0 +1,125 @@
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <thread>
+
+#include "clock.h"
+
+// the view was tuned at this frame rate, speed is in deltas per frame of it
+static const double SPEED_FPS = 60.0;
+
+// how much of a wait is spent yielding instead of sleeping
+static const double SPIN_SECONDS = 0.0005;
+
+SteadyClock::SteadyClock() :
+        m_Start(0.0)
+{
+    m_Start = Now();
+}
+
+double SteadyClock::Now() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count() - m_Start;
+}
+
+void SteadyClock::SleepUntil(double time) {
+    double remaining = time - Now();
+    if (remaining > SPIN_SECONDS) {
+        std::this_thread::sleep_for(std::chrono::duration<double>(remaining - SPIN_SECONDS));
+    }
+    while (Now() < time) {
+        std::this_thread::yield();
+    }
+}
+
+ManualClock::ManualClock(double time) :
+        m_Time(time)
+{
+}
+
+double ManualClock::Now() {
+    return m_Time;
+}
+
+void ManualClock::SleepUntil(double time) {
+    m_Time = std::max(m_Time, time);
+}
+
+void ManualClock::Advance(double seconds) {
+    m_Time += seconds;
+}
+
+FrameScheduler::FrameScheduler(Clock& clock, double fps) :
+        m_Clock(clock),
+        m_Period(0.0),
+        m_LateFrames(0)
+{
+    SetRate(fps);
+    m_Last = m_Next = m_Clock.Now();
+}
+
+double FrameScheduler::Wait() {
+    double now = m_Clock.Now();
+    if (m_Period > 0.0) {
+        if (now < m_Next) {
+            m_Clock.SleepUntil(m_Next);
+            now = m_Clock.Now();
+        } else if (now > m_Next + m_Period) {
+            m_LateFrames++;
+            m_Next = now;
+        }
+        m_Next += m_Period;
+    }
+    double elapsed = now - m_Last;
+    m_Last = now;
+    return elapsed;
+}
+
+void FrameScheduler::SetRate(double fps) {
+    m_Period = fps > 0.0 ? 1.0 / fps : 0.0;
+}
+
+uint64_t FrameScheduler::GetLateFrames() {
+    return m_LateFrames;
+}
+
+PlaybackClock::PlaybackClock(Clock& clock, size_t maxBacklog) :
+        m_Clock(clock),
+        m_MaxBacklog(std::max(maxBacklog, size_t(1))),
+        m_Last(clock.Now()),
+        m_Phase(0.0),
+        m_Dropped(0)
+{
+}
+
+size_t PlaybackClock::Advance(float speed) {
+    double now = m_Clock.Now();
+    m_Phase += (now - m_Last) * speed * SPEED_FPS;
+    m_Last = now;
+    // a stalled window (dragged, minimised) must not owe minutes of deltas
+    Limit();
+    size_t due = size_t(std::floor(m_Phase));
+    m_Phase -= due;
+    return due;
+}
+
+void PlaybackClock::Defer(size_t numDeltas) {
+    m_Phase += numDeltas;
+    Limit();
+}
+
+void PlaybackClock::Limit() {
+    if (m_Phase > m_MaxBacklog) {
+        m_Dropped += uint64_t(m_Phase - m_MaxBacklog);
+        m_Phase = m_MaxBacklog;
+    }
+}
+
+void PlaybackClock::Reset() {
+    m_Last = m_Clock.Now();
+    m_Phase = 0.0;
+}
+
+uint64_t PlaybackClock::GetDropped() {
+    return m_Dropped;
+}
@@ -0,0 +1,102 @@
+
+#ifndef TIMELAPSEDOTMAP_CLOCK_H
+#define TIMELAPSEDOTMAP_CLOCK_H
+
+#include <cstdint>
+#include <cstdlib>
+
+// Time source for frame pacing and playback. The window uses SteadyClock;
+// ManualClock only moves when told to, for rendering offline at a fixed
+// frame rate and for checking pacing without waiting for real time.
+class Clock {
+
+public:
+    virtual ~Clock() {}
+
+    // seconds since an arbitrary start, never goes back
+    virtual double Now() = 0;
+    // block until Now() >= time
+    virtual void SleepUntil(double time) = 0;
+};
+
+class SteadyClock : public Clock {
+
+public:
+    SteadyClock();
+
+    double Now();
+    // sleeps to just before the deadline and yields the rest, since a plain
+    // sleep can wake up a scheduler tick late
+    void SleepUntil(double time);
+
+private:
+    double m_Start;
+};
+
+class ManualClock : public Clock {
+
+public:
+    explicit ManualClock(double time = 0.0);
+
+    double Now();
+    // returns at once, jumping to the deadline
+    void SleepUntil(double time);
+    void Advance(double seconds);
+
+private:
+    double m_Time;
+};
+
+// Paces the render loop at a fixed rate by sleeping until each frame is due.
+// Deadlines follow a fixed cadence, so an early or late frame does not shift
+// the ones after it; after falling more than a frame behind the cadence
+// restarts from now instead of rendering a burst of frames to catch up.
+class FrameScheduler {
+
+public:
+    FrameScheduler(Clock& clock, double fps); // fps 0: no limit, e.g. vsync paces
+
+    // wait for the next frame, returns the seconds since the previous one
+    double Wait();
+    void SetRate(double fps);
+    uint64_t GetLateFrames();
+
+private:
+    Clock& m_Clock;
+    double m_Period;
+    double m_Next;
+    double m_Last;
+    uint64_t m_LateFrames;
+};
+
+// Playback position in deltas, driven by elapsed time rather than by frames
+// drawn, so a slow frame makes the next one apply more deltas instead of
+// slowing the time-lapse down. Speed keeps its config meaning: deltas per
+// frame at 60 Hz.
+class PlaybackClock {
+
+public:
+    // maxBacklog: deltas owed at most, e.g. what the prefetcher holds
+    PlaybackClock(Clock& clock, size_t maxBacklog);
+
+    // whole deltas due since the last call; apply them all in this frame
+    size_t Advance(float speed);
+    // hand back deltas that were due but not available yet. Whatever is
+    // owed beyond the backlog limit is dropped: playback falls behind real
+    // time instead of racing ahead once decode catches up.
+    void Defer(size_t numDeltas);
+    // start over from now with nothing owed, e.g. after a seek
+    void Reset();
+    uint64_t GetDropped();
+
+private:
+    void Limit();
+
+    Clock& m_Clock;
+    size_t m_MaxBacklog;
+    double m_Last;
+    double m_Phase;
+    uint64_t m_Dropped;
+};
+
+#endif //TIMELAPSEDOTMAP_CLOCK_H
@@ -0,0 +1,227 @@
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <spdlog/spdlog.h>
+
+#include "container.h"
+
+ContainerSource::ContainerSource(const char* filename) :
+        m_Data(NULL),
+        m_Size(0),
+        m_Reverses(NULL)
+{
+#ifdef _WIN32
+    m_File = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                         FILE_ATTRIBUTE_NORMAL, NULL);
+    if (m_File == INVALID_HANDLE_VALUE) {
+        throw std::runtime_error(std::string("cannot open ") + filename);
+    }
+    LARGE_INTEGER size;
+    GetFileSizeEx(m_File, &size);
+    m_Size = size.QuadPart;
+    m_Mapping = CreateFileMappingA(m_File, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (m_Mapping != NULL) {
+        m_Data = (const char*)MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0);
+    }
+    if (m_Data == NULL) {
+        throw std::runtime_error(std::string("cannot map ") + filename);
+    }
+#else
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error(std::string("cannot open ") + filename);
+    }
+    struct stat st;
+    fstat(fd, &st);
+    m_Size = st.st_size;
+    void* data = mmap(NULL, m_Size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        throw std::runtime_error(std::string("cannot map ") + filename);
+    }
+    m_Data = (const char*)data;
+#endif
+
+    m_Header = At<ContainerHeader>(0, 1);
+    if (memcmp(m_Header->magic, CONTAINER_MAGIC, sizeof(CONTAINER_MAGIC)) != 0 ||
+        m_Header->version < 1 || m_Header->version > CONTAINER_VERSION) {
+        throw std::runtime_error(std::string(filename) + " is not a version 1 or 2 .tldm container");
+    }
+    m_Timestamps = At<uint32_t>(m_Header->timestampsOffset, m_Header->numTimestamps);
+    m_Deltas = At<ContainerDelta>(m_Header->deltasOffset, m_Header->numTimestamps);
+    m_Snapshots = At<ContainerSnapshot>(m_Header->snapshotsOffset, m_Header->numSnapshots);
+    if (m_Header->version >= 2 && m_Header->reversesOffset) {
+        m_Reverses = At<ContainerDelta>(m_Header->reversesOffset, m_Header->numTimestamps);
+    }
+}
+
+ContainerSource::~ContainerSource() {
+#ifdef _WIN32
+    UnmapViewOfFile(m_Data);
+    CloseHandle(m_Mapping);
+    CloseHandle(m_File);
+#else
+    munmap((void*)m_Data, m_Size);
+#endif
+}
+
+template <typename T>
+const T* ContainerSource::At(uint64_t offset, uint64_t count) {
+    if (offset > m_Size || count > (m_Size - offset) / sizeof(T)) {
+        throw std::runtime_error("truncated .tldm container");
+    }
+    return (const T*)(m_Data + offset);
+}
+
+size_t ContainerSource::GetFrameSize() {
+    return m_Header->frameSize;
+}
+
+std::vector<uint32_t> ContainerSource::GetTimestamps() {
+    return std::vector<uint32_t>(m_Timestamps, m_Timestamps + m_Header->numTimestamps);
+}
+
+std::vector<uint32_t> ContainerSource::GetSnapshotTimestamps() {
+    std::vector<uint32_t> timestamps;
+    for (size_t i = 0; i < m_Header->numSnapshots; i++) {
+        timestamps.push_back(m_Snapshots[i].timestamp);
+    }
+    return timestamps;
+}
+
+size_t ContainerSource::GetSnapshot(uint32_t timestamp, glm::vec2* frame, size_t numLocations) {
+    const ContainerSnapshot* end = m_Snapshots + m_Header->numSnapshots;
+    const ContainerSnapshot* snapshot = std::lower_bound(m_Snapshots, end, timestamp,
+            [](const ContainerSnapshot& s, uint32_t t) { return s.timestamp < t; });
+    if (snapshot == end || snapshot->timestamp != timestamp) {
+        return 0;
+    }
+    numLocations = std::min<size_t>(numLocations, snapshot->numLocations);
+    // already laid out as a frame, no conversion needed
+    memcpy(frame, At<glm::vec2>(snapshot->offset, numLocations), numLocations * sizeof(glm::vec2));
+    return numLocations;
+}
+
+const ContainerDelta* ContainerSource::FindDelta(const ContainerDelta* deltas, uint32_t timestamp) {
+    const uint32_t* end = m_Timestamps + m_Header->numTimestamps;
+    const uint32_t* found = std::lower_bound(m_Timestamps, end, timestamp);
+    if (deltas == NULL || found == end || *found != timestamp) {
+        return NULL;
+    }
+    return deltas + (found - m_Timestamps);
+}
+
+const update_t* ContainerSource::GetDelta(uint32_t timestamp, size_t& numUpdates) {
+    const ContainerDelta* delta = FindDelta(m_Deltas, timestamp);
+    if (delta == NULL) {
+        numUpdates = 0;
+        return NULL;
+    }
+    numUpdates = delta->numUpdates;
+    return At<update_t>(delta->offset, numUpdates);
+}
+
+const update_t* ContainerSource::GetReverseDelta(uint32_t timestamp, size_t& numUpdates) {
+    const ContainerDelta* reverse = FindDelta(m_Reverses, timestamp);
+    if (reverse == NULL) {
+        numUpdates = 0;
+        return NULL;
+    }
+    numUpdates = reverse->numUpdates;
+    return At<update_t>(reverse->offset, numUpdates);
+}
+
+bool ContainerSource::IsReversible() {
+    return m_Reverses != NULL;
+}
+
+ContainerWriter::ContainerWriter(const char* filename, uint32_t frameSize, bool reversible) :
+        m_Filename(filename),
+        m_File(fopen(filename, "wb")),
+        m_Offset(0),
+        m_Reversible(reversible)
+{
+    if (m_File == NULL) {
+        throw std::runtime_error(std::string("cannot create ") + filename);
+    }
+    memset(&m_Header, 0, sizeof(m_Header));
+    memcpy(m_Header.magic, CONTAINER_MAGIC, sizeof(CONTAINER_MAGIC));
+    m_Header.version = reversible ? CONTAINER_VERSION : 1;
+    m_Header.frameSize = frameSize;
+    // placeholder, rewritten by Finish()
+    Write(&m_Header, sizeof(m_Header));
+}
+
+ContainerWriter::~ContainerWriter() {
+    if (m_File) {
+        fclose(m_File);
+    }
+}
+
+uint64_t ContainerWriter::Write(const void* data, size_t size) {
+    static const char padding[CONTAINER_ALIGNMENT] = {0};
+    size_t pad = (CONTAINER_ALIGNMENT - m_Offset % CONTAINER_ALIGNMENT) % CONTAINER_ALIGNMENT;
+    uint64_t offset = m_Offset + pad;
+    if (fwrite(padding, 1, pad, m_File) != pad || fwrite(data, 1, size, m_File) != size) {
+        throw std::runtime_error("cannot write " + m_Filename);
+    }
+    m_Offset = offset + size;
+    return offset;
+}
+
+void ContainerWriter::AddSnapshot(uint32_t timestamp, const glm::vec2* frame, size_t numLocations) {
+    ContainerSnapshot snapshot;
+    snapshot.offset = Write(frame, numLocations * sizeof(glm::vec2));
+    snapshot.timestamp = timestamp;
+    snapshot.numLocations = numLocations;
+    m_Snapshots.push_back(snapshot);
+    if (m_Reversible) {
+        m_Reverse.Reset(frame, numLocations);
+    }
+}
+
+void ContainerWriter::AddDelta(uint32_t timestamp, const update_t* updates, size_t numUpdates) {
+    ContainerDelta delta;
+    delta.offset = Write(updates, numUpdates * sizeof(update_t));
+    delta.numUpdates = numUpdates;
+    delta.reserved = 0;
+    m_Timestamps.push_back(timestamp);
+    m_Deltas.push_back(delta);
+    if (m_Reversible) {
+        const std::vector<update_t>& reverse = m_Reverse.Build(updates, numUpdates);
+        delta.offset = Write(reverse.data(), reverse.size() * sizeof(update_t));
+        delta.numUpdates = reverse.size();
+        m_Reverses.push_back(delta);
+    }
+}
+
+void ContainerWriter::Finish() {
+    m_Header.numTimestamps = m_Timestamps.size();
+    m_Header.numSnapshots = m_Snapshots.size();
+    m_Header.timestampsOffset = Write(m_Timestamps.data(), m_Timestamps.size() * sizeof(uint32_t));
+    m_Header.deltasOffset = Write(m_Deltas.data(), m_Deltas.size() * sizeof(ContainerDelta));
+    m_Header.snapshotsOffset = Write(m_Snapshots.data(), m_Snapshots.size() * sizeof(ContainerSnapshot));
+    if (m_Reversible) {
+        m_Header.reversesOffset = Write(m_Reverses.data(), m_Reverses.size() * sizeof(ContainerDelta));
+    }
+    fseek(m_File, 0, SEEK_SET);
+    if (fwrite(&m_Header, sizeof(m_Header), 1, m_File) != 1) {
+        throw std::runtime_error("cannot write " + m_Filename);
+    }
+    fclose(m_File);
+    m_File = NULL;
+    spdlog::info("Wrote {}: {} frames, {} snapshots, {} bytes{}", m_Filename,
+                 m_Header.numTimestamps, m_Header.numSnapshots, m_Offset,
+                 m_Reversible ? " with reverse deltas" : "");
+}
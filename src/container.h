@@ -0,0 +1,114 @@
+
+#ifndef TIMELAPSEDOTMAP_CONTAINER_H
+#define TIMELAPSEDOTMAP_CONTAINER_H
+
+#include <cstdio>
+#include <string>
+
+#include "source.h"
+#include "writer.h"
+
+// .tldm container: one read-only file that is memory mapped and used in
+// place. All offsets are from the start of the file, payloads are aligned
+// to CONTAINER_ALIGNMENT.
+//
+//   ContainerHeader
+//   payloads: snapshots as glm::vec2 (lon, lat), deltas as update_t
+//   uint32_t timestamps[numTimestamps]       sorted
+//   ContainerDelta deltas[numTimestamps]     same order as timestamps
+//   ContainerSnapshot snapshots[numSnapshots] sorted by timestamp
+//   ContainerDelta reverses[numTimestamps]   version 2 with reverse deltas only
+//
+// Version 2 adds reverseOffset to the header, 0 without reverse deltas.
+// Version 1 files have zero padding there, so they read the same way.
+
+static const char CONTAINER_MAGIC[4] = {'T', 'L', 'D', 'M'};
+static const uint32_t CONTAINER_VERSION = 2;
+static const size_t CONTAINER_ALIGNMENT = 64;
+
+struct ContainerHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t frameSize;
+    uint32_t numTimestamps;
+    uint32_t numSnapshots;
+    uint32_t reserved;
+    uint64_t timestampsOffset;
+    uint64_t deltasOffset;
+    uint64_t snapshotsOffset;
+    uint64_t reversesOffset;
+};
+
+struct ContainerDelta {
+    uint64_t offset;
+    uint32_t numUpdates;
+    uint32_t reserved;
+};
+
+struct ContainerSnapshot {
+    uint64_t offset;
+    uint32_t timestamp;
+    uint32_t numLocations;
+};
+
+class ContainerSource : public FrameSource {
+
+public:
+    explicit ContainerSource(const char* filename);
+    ~ContainerSource();
+
+    size_t GetFrameSize();
+    std::vector<uint32_t> GetTimestamps();
+    std::vector<uint32_t> GetSnapshotTimestamps();
+    size_t GetSnapshot(uint32_t timestamp, glm::vec2* frame, size_t numLocations);
+    const update_t* GetDelta(uint32_t timestamp, size_t& numUpdates);
+    const update_t* GetReverseDelta(uint32_t timestamp, size_t& numUpdates);
+    bool IsReversible();
+
+private:
+    const ContainerDelta* FindDelta(const ContainerDelta* deltas, uint32_t timestamp);
+    template <typename T>
+    const T* At(uint64_t offset, uint64_t count);
+
+    const char* m_Data;
+    size_t m_Size;
+#ifdef _WIN32
+    void* m_File;
+    void* m_Mapping;
+#endif
+    const ContainerHeader* m_Header;
+    const uint32_t* m_Timestamps;
+    const ContainerDelta* m_Deltas;
+    const ContainerSnapshot* m_Snapshots;
+    const ContainerDelta* m_Reverses; // NULL without reverse deltas
+};
+
+// Streams frames into a new container, indices are written by Finish().
+// Containers without reverse deltas are written as version 1.
+class ContainerWriter : public FrameWriter {
+
+public:
+    ContainerWriter(const char* filename, uint32_t frameSize, bool reversible = false);
+    ~ContainerWriter();
+
+    // timestamps must be added in increasing order
+    void AddSnapshot(uint32_t timestamp, const glm::vec2* frame, size_t numLocations);
+    void AddDelta(uint32_t timestamp, const update_t* updates, size_t numUpdates);
+    void Finish();
+
+private:
+    uint64_t Write(const void* data, size_t size);
+
+    std::string m_Filename;
+    FILE* m_File;
+    uint64_t m_Offset;
+    ContainerHeader m_Header;
+    std::vector<uint32_t> m_Timestamps;
+    std::vector<ContainerDelta> m_Deltas;
+    std::vector<ContainerSnapshot> m_Snapshots;
+    bool m_Reversible;
+    ReverseDelta m_Reverse;
+    std::vector<ContainerDelta> m_Reverses;
+};
+
+#endif //TIMELAPSEDOTMAP_CONTAINER_H
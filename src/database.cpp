@@ -0,0 +1,484 @@
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#include <spdlog/spdlog.h>
+
+#include "database.h"
+
+// reversible databases have the reverse of every delta next to it
+static bool HasReverseDeltas(SQLite::Database& db) {
+    SQLite::Statement columnsQuery(db, "PRAGMA table_info(delta)");
+    while (columnsQuery.executeStep()) {
+        if (std::string(columnsQuery.getColumn(1).getText()) == "previous") {
+            return true;
+        }
+    }
+    return false;
+}
+
+// whether the timestamp of table is its rowid, i.e. its only primary key
+// and declared INTEGER
+static bool IsRowid(SQLite::Database& db, const char* table) {
+    SQLite::Statement columnsQuery(db, std::string("PRAGMA table_info(") + table + ")");
+    int keys = 0;
+    bool timestamp = false;
+    while (columnsQuery.executeStep()) {
+        if (columnsQuery.getColumn(5).getInt() > 0) {
+            keys++;
+            timestamp = std::string(columnsQuery.getColumn(1).getText()) == "timestamp" &&
+                        sqlite3_stricmp(columnsQuery.getColumn(2).getText(), "integer") == 0;
+        }
+    }
+    return keys == 1 && timestamp;
+}
+
+BlobReader::BlobReader(SQLite::Database& db, const char* table, const char* column) :
+        m_Db(db),
+        m_Table(table),
+        m_Column(column),
+        m_Blob(NULL)
+{
+}
+
+BlobReader::~BlobReader() {
+    sqlite3_blob_close(m_Blob);
+}
+
+bool BlobReader::Open(int64_t rowid) {
+    if (m_Blob != NULL) {
+        if (sqlite3_blob_reopen(m_Blob, rowid) == SQLITE_OK) {
+            return true;
+        }
+        // the handle is unusable after a failed reopen, e.g. no such row
+        sqlite3_blob_close(m_Blob);
+        m_Blob = NULL;
+    }
+    if (sqlite3_blob_open(m_Db.getHandle(), "main", m_Table, m_Column, rowid, 0, &m_Blob) != SQLITE_OK) {
+        sqlite3_blob_close(m_Blob);
+        m_Blob = NULL;
+        return false;
+    }
+    return true;
+}
+
+size_t BlobReader::GetBytes() {
+    return m_Blob ? sqlite3_blob_bytes(m_Blob) : 0;
+}
+
+void BlobReader::Read(void* data, size_t size, size_t offset) {
+    if (size == 0) {
+        return;
+    }
+    if (m_Blob == NULL || sqlite3_blob_read(m_Blob, data, int(size), int(offset)) != SQLITE_OK) {
+        throw std::runtime_error(std::string("cannot read ") + m_Table + "." + m_Column + ": " +
+                                 sqlite3_errmsg(m_Db.getHandle()));
+    }
+}
+
+DatabaseSource::DatabaseSource(const char* filename, bool incremental)
+    : m_Db(filename),
+      m_TimestampsQuery(m_Db, "SELECT timestamp FROM timestamps WHERE timestamp > 0"),
+      m_SnapshotTimestampsQuery(m_Db, "SELECT timestamp FROM snapshot ORDER BY timestamp"),
+      m_SnapshotQuery(m_Db, "SELECT frame FROM snapshot WHERE timestamp = :timestamp"),
+      m_DeltaQuery(m_Db, "SELECT frame FROM delta WHERE timestamp = :timestamp"),
+      m_Swizzle(SelectSwizzleKernels("auto"))
+{
+    if (HasReverseDeltas(m_Db)) {
+        m_ReverseQuery.reset(new SQLite::Statement(m_Db, "SELECT previous FROM delta WHERE timestamp = :timestamp"));
+        spdlog::info("{} has reverse deltas", filename);
+    }
+    if (m_Db.tableExists("attr_snapshot") && m_Db.tableExists("attr_delta")) {
+        m_AttributeSnapshotQuery.reset(new SQLite::Statement(m_Db,
+                "SELECT frame FROM attr_snapshot WHERE name = :name AND timestamp = :timestamp"));
+        m_AttributeDeltaQuery.reset(new SQLite::Statement(m_Db,
+                "SELECT frame, previous FROM attr_delta WHERE name = :name AND timestamp = :timestamp"));
+    }
+    if (incremental && IsRowid(m_Db, "snapshot") && IsRowid(m_Db, "delta")) {
+        m_SnapshotBlob.reset(new BlobReader(m_Db, "snapshot", "frame"));
+        m_DeltaBlob.reset(new BlobReader(m_Db, "delta", "frame"));
+        if (m_ReverseQuery) {
+            m_ReverseBlob.reset(new BlobReader(m_Db, "delta", "previous"));
+        }
+    } else if (incremental) {
+        spdlog::info("{}: timestamps are not rowids, reading blobs with queries", filename);
+    }
+}
+
+size_t DatabaseSource::GetFrameSize() {
+    size_t frameSize = 0;
+    if (m_Db.tableExists("slots")) {
+        SQLite::Statement slotsQuery(m_Db, "SELECT MAX(slot) + 1 FROM slots");
+        if (slotsQuery.executeStep() && !slotsQuery.getColumn(0).isNull()) {
+            frameSize = slotsQuery.getColumn(0).getInt();
+        }
+    }
+    // older databases without slots: the largest snapshot covers every dot
+    SQLite::Statement snapshotQuery(m_Db, "SELECT MAX(LENGTH(frame)) FROM snapshot");
+    if (snapshotQuery.executeStep() && !snapshotQuery.getColumn(0).isNull()) {
+        frameSize = std::max<size_t>(frameSize, snapshotQuery.getColumn(0).getInt() / (2 * sizeof(float)));
+    }
+    return frameSize;
+}
+
+std::vector<uint32_t> DatabaseSource::GetTimestamps() {
+    std::vector<uint32_t> timestamps;
+
+    // Loop to execute the query step by step, to get one a row of results at a time
+    while (m_TimestampsQuery.executeStep()) {
+        timestamps.push_back(m_TimestampsQuery.getColumn(0));
+    }
+    m_TimestampsQuery.reset();
+    return timestamps;
+}
+
+std::vector<uint32_t> DatabaseSource::GetSnapshotTimestamps() {
+    std::vector<uint32_t> timestamps;
+
+    while (m_SnapshotTimestampsQuery.executeStep()) {
+        timestamps.push_back(m_SnapshotTimestampsQuery.getColumn(0));
+    }
+    m_SnapshotTimestampsQuery.reset();
+    return timestamps;
+}
+
+size_t DatabaseSource::GetSnapshot(uint32_t timestamp, glm::vec2* buffer, size_t numLocations) {
+    const void* blobData = NULL;
+    size_t blobSize;
+    size_t locationSize = sizeof(float) * 2;
+
+    if (m_SnapshotBlob) {
+        if (!m_SnapshotBlob->Open(timestamp)) {
+            return 0;
+        }
+        // lat, lon pairs straight into the frame, then swapped in place
+        numLocations = std::min(numLocations, m_SnapshotBlob->GetBytes() / locationSize);
+        m_SnapshotBlob->Read(buffer, numLocations * locationSize);
+        m_Swizzle.swizzle((const float*)buffer, numLocations, buffer);
+        return numLocations;
+    }
+
+    m_SnapshotQuery.bind(":timestamp", timestamp);
+    if (m_SnapshotQuery.executeStep()) {
+        SQLite::Column colBlob = m_SnapshotQuery.getColumn(0);
+        blobData = colBlob.getBlob();
+        blobSize = colBlob.getBytes();
+        if (blobSize / locationSize < numLocations) {
+            numLocations = blobSize / locationSize;
+        }
+
+        spdlog::debug("converting {} floats ({} locations)", 2 * numLocations, numLocations);
+        m_Swizzle.swizzle((const float*)blobData, numLocations, buffer);
+    } else {
+        numLocations = 0;
+    }
+    m_SnapshotQuery.clearBindings();
+    m_SnapshotQuery.reset();
+
+    return numLocations;
+}
+
+const update_t* DatabaseSource::GetDelta(uint32_t timestamp, size_t& numUpdates) {
+    if (m_DeltaBlob) {
+        return ReadUpdates(*m_DeltaBlob, timestamp, m_Updates, numUpdates);
+    }
+
+    // the blob belongs to the statement, keep it stepped until the next call
+    m_DeltaQuery.reset();
+    m_DeltaQuery.clearBindings();
+
+    m_DeltaQuery.bind(":timestamp", timestamp);
+    if (m_DeltaQuery.executeStep()) {
+        SQLite::Column colBlob = m_DeltaQuery.getColumn(0);
+        numUpdates = colBlob.getBytes() / sizeof(update_t);
+        return (const update_t*)colBlob.getBlob();
+    }
+    numUpdates = 0;
+    return NULL;
+}
+
+const update_t* DatabaseSource::GetReverseDelta(uint32_t timestamp, size_t& numUpdates) {
+    numUpdates = 0;
+    if (!m_ReverseQuery) {
+        return NULL;
+    }
+    if (m_ReverseBlob) {
+        return ReadUpdates(*m_ReverseBlob, timestamp, m_Reverse, numUpdates);
+    }
+    // its own statement, so the delta's blob stays valid
+    m_ReverseQuery->reset();
+    m_ReverseQuery->clearBindings();
+
+    m_ReverseQuery->bind(":timestamp", timestamp);
+    if (m_ReverseQuery->executeStep()) {
+        SQLite::Column colBlob = m_ReverseQuery->getColumn(0);
+        numUpdates = colBlob.getBytes() / sizeof(update_t);
+        return (const update_t*)colBlob.getBlob();
+    }
+    return NULL;
+}
+
+bool DatabaseSource::IsReversible() {
+    return m_ReverseQuery != NULL;
+}
+
+std::vector<std::string> DatabaseSource::GetAttributes() {
+    std::vector<std::string> names;
+    if (m_AttributeSnapshotQuery) {
+        SQLite::Statement namesQuery(m_Db, "SELECT name FROM attr_snapshot UNION SELECT name FROM attr_delta");
+        while (namesQuery.executeStep()) {
+            names.push_back(namesQuery.getColumn(0).getText());
+        }
+    }
+    return names;
+}
+
+size_t DatabaseSource::GetAttributeSnapshot(const std::string& name, uint32_t timestamp, float* column,
+                                            size_t numValues) {
+    if (!m_AttributeSnapshotQuery) {
+        return 0;
+    }
+    m_AttributeSnapshotQuery->bind(":name", name);
+    m_AttributeSnapshotQuery->bind(":timestamp", timestamp);
+    if (m_AttributeSnapshotQuery->executeStep()) {
+        SQLite::Column colBlob = m_AttributeSnapshotQuery->getColumn(0);
+        numValues = std::min<size_t>(numValues, colBlob.getBytes() / sizeof(float));
+        memcpy(column, colBlob.getBlob(), numValues * sizeof(float));
+    } else {
+        numValues = 0;
+    }
+    m_AttributeSnapshotQuery->clearBindings();
+    m_AttributeSnapshotQuery->reset();
+    return numValues;
+}
+
+const attribute_t* DatabaseSource::GetAttributeDelta(const std::string& name, uint32_t timestamp,
+                                                     size_t& numUpdates) {
+    return QueryAttributeDelta(name, timestamp, 0, numUpdates);
+}
+
+const attribute_t* DatabaseSource::GetReverseAttributeDelta(const std::string& name, uint32_t timestamp,
+                                                            size_t& numUpdates) {
+    return QueryAttributeDelta(name, timestamp, 1, numUpdates);
+}
+
+const attribute_t* DatabaseSource::QueryAttributeDelta(const std::string& name, uint32_t timestamp, int column,
+                                                       size_t& numUpdates) {
+    numUpdates = 0;
+    if (!m_AttributeDeltaQuery) {
+        return NULL;
+    }
+    // like GetDelta(), the blob is valid while the statement stays stepped
+    m_AttributeDeltaQuery->reset();
+    m_AttributeDeltaQuery->clearBindings();
+
+    m_AttributeDeltaQuery->bind(":name", name);
+    m_AttributeDeltaQuery->bind(":timestamp", timestamp);
+    if (m_AttributeDeltaQuery->executeStep()) {
+        SQLite::Column colBlob = m_AttributeDeltaQuery->getColumn(column);
+        numUpdates = colBlob.getBytes() / sizeof(attribute_t);
+        return (const attribute_t*)colBlob.getBlob();
+    }
+    return NULL;
+}
+
+const update_t* DatabaseSource::ReadUpdates(BlobReader& reader, uint32_t timestamp,
+                                            std::vector<update_t>& updates, size_t& numUpdates) {
+    numUpdates = 0;
+    if (!reader.Open(timestamp)) {
+        return NULL;
+    }
+    numUpdates = reader.GetBytes() / sizeof(update_t);
+    updates.resize(numUpdates);
+    reader.Read(updates.data(), numUpdates * sizeof(update_t));
+    return updates.data();
+}
+
+static SQLite::Database& OpenSchema(SQLite::Database& db, bool append, bool reversible) {
+    if (!append) {
+        db.exec("CREATE TABLE slots (name text primary key, slot integer)");
+        db.exec("CREATE TABLE timestamps (timestamp integer primary key)");
+        db.exec("CREATE TABLE snapshot (timestamp integer primary key, frame blob not null)");
+        if (reversible) {
+            db.exec("CREATE TABLE delta (timestamp integer primary key, frame blob not null, previous blob)");
+        } else {
+            db.exec("CREATE TABLE delta (timestamp integer primary key, frame blob not null)");
+        }
+    }
+    db.exec("BEGIN");
+    return db;
+}
+
+DatabaseWriter::DatabaseWriter(const char* filename, bool append, bool reversible)
+    : m_Filename(filename),
+      m_Db(filename, append ? SQLite::OPEN_READWRITE : SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE),
+      m_InTransaction(true),
+      m_Reversible(append ? HasReverseDeltas(m_Db) : reversible),
+      m_SlotInsert(OpenSchema(m_Db, append, m_Reversible), "REPLACE INTO slots (name, slot) VALUES (:name, :slot)"),
+      m_TimestampInsert(m_Db, "REPLACE INTO timestamps (timestamp) VALUES (:timestamp)"),
+      m_SnapshotInsert(m_Db, "REPLACE INTO snapshot (timestamp, frame) VALUES (:timestamp, :frame)"),
+      m_DeltaInsert(m_Db, m_Reversible ?
+                    "REPLACE INTO delta (timestamp, frame, previous) VALUES (:timestamp, :frame, :previous)" :
+                    "REPLACE INTO delta (timestamp, frame) VALUES (:timestamp, :frame)"),
+      m_NumUpdates(0),
+      m_DeltaBytes(0),
+      m_ReverseBytes(0),
+      m_AttributeBytes(0)
+{
+    if (append && reversible && !m_Reversible) {
+        spdlog::warn("{} has no reverse deltas, appending without them", filename);
+    }
+}
+
+DatabaseWriter::~DatabaseWriter() {
+    if (m_InTransaction) {
+        try {
+            m_Db.exec("ROLLBACK");
+        } catch (SQLite::Exception& e) {
+            spdlog::error("Rolling back {}: {}", m_Filename, e.what());
+        }
+    }
+}
+
+void DatabaseWriter::CopySlots(const char* filename, const std::vector<uint32_t>* newSlots) {
+    SQLite::Database source(filename);
+    if (!source.tableExists("slots")) {
+        return;
+    }
+    SQLite::Statement slotsQuery(source, "SELECT name, slot FROM slots");
+    while (slotsQuery.executeStep()) {
+        uint32_t slot = slotsQuery.getColumn(1).getInt();
+        if (newSlots && slot < newSlots->size()) {
+            slot = (*newSlots)[slot];
+        }
+        AddSlot(slotsQuery.getColumn(0).getText(), slot);
+    }
+}
+
+void DatabaseWriter::Resume(const glm::vec2* frame, size_t numLocations) {
+    if (m_Reversible) {
+        m_Reverse.Reset(frame, numLocations);
+    }
+}
+
+void DatabaseWriter::AddSlot(const std::string& name, uint32_t slot) {
+    m_SlotInsert.bind(":name", name);
+    m_SlotInsert.bind(":slot", (int)slot);
+    m_SlotInsert.exec();
+    m_SlotInsert.reset();
+}
+
+void DatabaseWriter::AddSnapshot(uint32_t timestamp, const glm::vec2* frame, size_t numLocations) {
+    // one batch per snapshot interval keeps the journal small
+    m_Db.exec("COMMIT");
+    m_Db.exec("BEGIN");
+
+    m_Snapshot.resize(2 * numLocations);
+    for (size_t i = 0; i < numLocations; i++) {
+        m_Snapshot[2 * i] = frame[i].y;
+        m_Snapshot[2 * i + 1] = frame[i].x;
+    }
+    m_SnapshotInsert.bind(":timestamp", timestamp);
+    m_SnapshotInsert.bind(":frame", m_Snapshot.data(), m_Snapshot.size() * sizeof(float));
+    m_SnapshotInsert.exec();
+    m_SnapshotInsert.reset();
+    if (m_Reversible) {
+        m_Reverse.Reset(frame, numLocations);
+    }
+}
+
+void DatabaseWriter::AddDelta(uint32_t timestamp, const update_t* updates, size_t numUpdates) {
+    m_TimestampInsert.bind(":timestamp", timestamp);
+    m_TimestampInsert.exec();
+    m_TimestampInsert.reset();
+
+    size_t size = numUpdates * sizeof(update_t);
+    m_DeltaInsert.bind(":timestamp", timestamp);
+    m_DeltaInsert.bind(":frame", updates, size);
+    if (m_Reversible) {
+        const std::vector<update_t>& reverse = m_Reverse.Build(updates, numUpdates);
+        m_DeltaInsert.bind(":previous", reverse.data(), reverse.size() * sizeof(update_t));
+        m_ReverseBytes += reverse.size() * sizeof(update_t);
+    }
+    m_DeltaInsert.exec();
+    m_DeltaInsert.reset();
+
+    m_NumUpdates += numUpdates;
+    m_DeltaBytes += size;
+}
+
+bool DatabaseWriter::HasAttributes() {
+    return true;
+}
+
+void DatabaseWriter::CreateAttributeTables() {
+    m_Db.exec("CREATE TABLE IF NOT EXISTS attr_snapshot "
+              "(name text, timestamp integer, frame blob not null, primary key (name, timestamp))");
+    m_Db.exec("CREATE TABLE IF NOT EXISTS attr_delta "
+              "(name text, timestamp integer, frame blob not null, previous blob not null, "
+              "primary key (name, timestamp))");
+    m_AttributeSnapshotInsert.reset(new SQLite::Statement(m_Db,
+            "REPLACE INTO attr_snapshot (name, timestamp, frame) VALUES (:name, :timestamp, :frame)"));
+    m_AttributeDeltaInsert.reset(new SQLite::Statement(m_Db,
+            "REPLACE INTO attr_delta (name, timestamp, frame, previous) VALUES (:name, :timestamp, :frame, :previous)"));
+}
+
+void DatabaseWriter::AddAttributeSnapshot(const std::string& name, uint32_t timestamp, const float* column,
+                                          size_t numValues) {
+    if (!m_AttributeSnapshotInsert) {
+        CreateAttributeTables();
+    }
+    m_AttributeSnapshotInsert->bind(":name", name);
+    m_AttributeSnapshotInsert->bind(":timestamp", timestamp);
+    m_AttributeSnapshotInsert->bind(":frame", column, numValues * sizeof(float));
+    m_AttributeSnapshotInsert->exec();
+    m_AttributeSnapshotInsert->reset();
+    m_AttributeColumns[name].assign(column, column + numValues);
+}
+
+void DatabaseWriter::AddAttributeDelta(const std::string& name, uint32_t timestamp, const attribute_t* updates,
+                                       size_t numUpdates) {
+    if (numUpdates == 0) {
+        return;
+    }
+    if (!m_AttributeDeltaInsert) {
+        CreateAttributeTables();
+    }
+    // all from the column before the delta, like ReverseDelta
+    std::vector<float>& column = m_AttributeColumns[name];
+    m_AttributePrevious.resize(numUpdates);
+    for (size_t i = 0; i < numUpdates; i++) {
+        uint32_t slot = updates[i].index;
+        m_AttributePrevious[i].index = slot;
+        m_AttributePrevious[i].value = slot < column.size() ? column[slot] : 0.0f;
+    }
+    for (size_t i = 0; i < numUpdates; i++) {
+        uint32_t slot = updates[i].index;
+        if (slot >= column.size()) {
+            column.resize(slot + 1, 0.0f);
+        }
+        column[slot] = updates[i].value;
+    }
+    m_AttributeDeltaInsert->bind(":name", name);
+    m_AttributeDeltaInsert->bind(":timestamp", timestamp);
+    m_AttributeDeltaInsert->bind(":frame", updates, numUpdates * sizeof(attribute_t));
+    m_AttributeDeltaInsert->bind(":previous", m_AttributePrevious.data(), numUpdates * sizeof(attribute_t));
+    m_AttributeDeltaInsert->exec();
+    m_AttributeDeltaInsert->reset();
+    m_AttributeBytes += 2 * numUpdates * sizeof(attribute_t);
+}
+
+void DatabaseWriter::Finish() {
+    m_Db.exec("COMMIT");
+    m_InTransaction = false;
+    spdlog::info("Wrote {}: {} updates in {} delta bytes, {:.2f} bytes per update", m_Filename,
+                 m_NumUpdates, m_DeltaBytes, m_NumUpdates ? (double)m_DeltaBytes / m_NumUpdates : 0.0);
+    if (m_Reversible) {
+        spdlog::info("Reverse deltas: {} bytes", m_ReverseBytes);
+    }
+    if (!m_AttributeColumns.empty()) {
+        spdlog::info("{} attribute columns: {} delta bytes", m_AttributeColumns.size(), m_AttributeBytes);
+    }
+}
@@ -0,0 +1,141 @@
+
+#ifndef TIMELAPSEDOTMAP_DATABASE_H
+#define TIMELAPSEDOTMAP_DATABASE_H
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <SQLiteCpp/SQLiteCpp.h>
+#include <sqlite3.h>
+
+#include "kernels.h"
+#include "source.h"
+#include "writer.h"
+
+// One blob column of a table read by rowid with SQLite's incremental blob
+// API, straight into the caller's memory rather than through a statement
+// that first materializes the row. The handle stays open and is moved to
+// the next row with sqlite3_blob_reopen().
+class BlobReader {
+
+public:
+    BlobReader(SQLite::Database& db, const char* table, const char* column);
+    ~BlobReader();
+
+    // move to the row, false if there is none
+    bool Open(int64_t rowid);
+    size_t GetBytes();
+    // copy size bytes from offset of the row's blob to data
+    void Read(void* data, size_t size, size_t offset = 0);
+
+private:
+    SQLite::Database& m_Db;
+    const char* m_Table;
+    const char* m_Column;
+    sqlite3_blob* m_Blob;
+};
+
+// Frames stored in the SQLite schema written by tools/create-db.py. With
+// incremental reads (the default), snapshots and deltas are read by
+// timestamp as rowid with a BlobReader: a snapshot straight into the
+// caller's frame and swizzled there, a delta into a buffer of the source.
+// Databases whose timestamps are not the rowid are read with statements.
+class DatabaseSource : public FrameSource {
+
+public:
+    explicit DatabaseSource(const char* filename, bool incremental = true);
+
+    size_t GetFrameSize();
+    std::vector<uint32_t> GetTimestamps();
+    std::vector<uint32_t> GetSnapshotTimestamps();
+    size_t GetSnapshot(uint32_t timestamp, glm::vec2* frame, size_t numLocations);
+    const update_t* GetDelta(uint32_t timestamp, size_t& numUpdates);
+    const update_t* GetReverseDelta(uint32_t timestamp, size_t& numUpdates);
+    bool IsReversible();
+    std::vector<std::string> GetAttributes();
+    size_t GetAttributeSnapshot(const std::string& name, uint32_t timestamp, float* column, size_t numValues);
+    const attribute_t* GetAttributeDelta(const std::string& name, uint32_t timestamp, size_t& numUpdates);
+    const attribute_t* GetReverseAttributeDelta(const std::string& name, uint32_t timestamp, size_t& numUpdates);
+
+private:
+    // column 0: the changes, 1: the values they replace
+    const attribute_t* QueryAttributeDelta(const std::string& name, uint32_t timestamp, int column,
+                                           size_t& numUpdates);
+    // numUpdates raw updates of the blob at timestamp into updates
+    const update_t* ReadUpdates(BlobReader& reader, uint32_t timestamp, std::vector<update_t>& updates,
+                                size_t& numUpdates);
+
+    SQLite::Database m_Db;
+    SQLite::Statement m_TimestampsQuery;
+    SQLite::Statement m_SnapshotTimestampsQuery;
+    SQLite::Statement m_SnapshotQuery;
+    SQLite::Statement m_DeltaQuery;
+    std::unique_ptr<SQLite::Statement> m_ReverseQuery; // reversible databases only
+    // databases with attribute columns only
+    std::unique_ptr<SQLite::Statement> m_AttributeSnapshotQuery;
+    std::unique_ptr<SQLite::Statement> m_AttributeDeltaQuery;
+    // incremental reads only, the reverse one of reversible databases only
+    std::unique_ptr<BlobReader> m_SnapshotBlob;
+    std::unique_ptr<BlobReader> m_DeltaBlob;
+    std::unique_ptr<BlobReader> m_ReverseBlob;
+    std::vector<update_t> m_Updates;   // delta as read
+    std::vector<update_t> m_Reverse;   // reverse delta as read
+    const SwizzleKernels& m_Swizzle;
+};
+
+// Writes a database in the create-db.py schema. Rows are committed in batches, one per snapshot interval. A reversible
+// database has a 'previous' column in the delta table with the reverse of
+// each delta, always as raw update_t since it is read in any order.
+// Attribute columns go to the attr_snapshot and attr_delta tables, keyed
+// by name and timestamp: snapshots as one float per slot, deltas as raw
+// attribute_t with the values they replace in 'previous'. Timestamps
+// where a column does not change have no row.
+class DatabaseWriter : public FrameWriter {
+
+public:
+    // append: extend an existing database, keeping its reversibility
+    DatabaseWriter(const char* filename, bool append = false, bool reversible = false);
+    ~DatabaseWriter();
+
+    // copy the name to slot table of another database, renumbered to
+    // newSlots[slot] if given
+    void CopySlots(const char* filename, const std::vector<uint32_t>* newSlots = NULL);
+    // continue the reverse deltas from the last frame of an appended database
+    void Resume(const glm::vec2* frame, size_t numLocations);
+
+    void AddSlot(const std::string& name, uint32_t slot);
+    void AddSnapshot(uint32_t timestamp, const glm::vec2* frame, size_t numLocations);
+    void AddDelta(uint32_t timestamp, const update_t* updates, size_t numUpdates);
+    bool HasAttributes();
+    void AddAttributeSnapshot(const std::string& name, uint32_t timestamp, const float* column, size_t numValues);
+    void AddAttributeDelta(const std::string& name, uint32_t timestamp, const attribute_t* updates,
+                           size_t numUpdates);
+    void Finish();
+
+private:
+    void CreateAttributeTables();
+
+    std::string m_Filename;
+    SQLite::Database m_Db;
+    bool m_InTransaction;
+    bool m_Reversible;
+    SQLite::Statement m_SlotInsert;
+    SQLite::Statement m_TimestampInsert;
+    SQLite::Statement m_SnapshotInsert;
+    SQLite::Statement m_DeltaInsert;
+    std::vector<float> m_Snapshot;
+    ReverseDelta m_Reverse;
+    size_t m_NumUpdates;
+    size_t m_DeltaBytes;
+    size_t m_ReverseBytes;
+    // created with the first attribute written
+    std::unique_ptr<SQLite::Statement> m_AttributeSnapshotInsert;
+    std::unique_ptr<SQLite::Statement> m_AttributeDeltaInsert;
+    std::map<std::string, std::vector<float> > m_AttributeColumns; // as of the last delta, for 'previous'
+    std::vector<attribute_t> m_AttributePrevious;
+    size_t m_AttributeBytes;
+};
+
+#endif //TIMELAPSEDOTMAP_DATABASE_H
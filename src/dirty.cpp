@@ -0,0 +1,134 @@
+
+#include <algorithm>
+#include <cassert>
+
+#include "dirty.h"
+
+DirtyRanges::DirtyRanges(size_t size) :
+        m_Size(0),
+        m_All(false)
+{
+    Resize(size);
+}
+
+size_t DirtyRanges::GetSize() {
+    return m_Size;
+}
+
+void DirtyRanges::Resize(size_t size) {
+    m_Size = size;
+    m_Words.assign((size + 63) / 64, 0);
+    m_All = false;
+}
+
+void DirtyRanges::MarkRange(size_t begin, size_t end) {
+    end = std::min(end, m_Size);
+    for (; begin < end && (begin & 63); begin++) {
+        Mark(begin);
+    }
+    for (; begin + 64 <= end; begin += 64) {
+        m_Words[begin >> 6] = ~uint64_t(0);
+    }
+    for (; begin < end; begin++) {
+        Mark(begin);
+    }
+}
+
+void DirtyRanges::MarkAll() {
+    m_All = true;
+}
+
+void DirtyRanges::Merge(const DirtyRanges& other) {
+    assert(other.m_Size == m_Size);
+    if (other.m_All) {
+        m_All = true;
+    }
+    if (m_All) {
+        return;
+    }
+    for (size_t i = 0; i < m_Words.size(); i++) {
+        m_Words[i] |= other.m_Words[i];
+    }
+}
+
+void DirtyRanges::Clear() {
+    std::fill(m_Words.begin(), m_Words.end(), 0);
+    m_All = false;
+}
+
+void DirtyRanges::Swap(DirtyRanges& other) {
+    m_Words.swap(other.m_Words);
+    std::swap(m_Size, other.m_Size);
+    std::swap(m_All, other.m_All);
+}
+
+bool DirtyRanges::IsAll() {
+    return m_All;
+}
+
+size_t DirtyRanges::Count(size_t limit) {
+    limit = std::min(limit, m_Size);
+    if (m_All) {
+        return limit;
+    }
+    size_t count = 0;
+    for (size_t i = 0; i < limit / 64; i++) {
+        count += __builtin_popcountll(m_Words[i]);
+    }
+    if (limit & 63) {
+        count += __builtin_popcountll(m_Words[limit / 64] & ((uint64_t(1) << (limit & 63)) - 1));
+    }
+    return count;
+}
+
+const std::vector<DirtyRanges::Range>& DirtyRanges::Coalesce(size_t limit, size_t maxGap) {
+    limit = std::min(limit, m_Size);
+    m_Ranges.clear();
+    if (m_All) {
+        if (limit > 0) {
+            Range range = {0, limit};
+            m_Ranges.push_back(range);
+        }
+        return m_Ranges;
+    }
+
+    // alternately look for the next set bit and the next clear one, words
+    // without either are skipped whole
+    bool open = false;
+    size_t begin = 0;
+    size_t numWords = (limit + 63) / 64;
+    for (size_t i = 0; i < numWords; i++) {
+        uint64_t word = m_Words[i];
+        if (i == limit / 64) {
+            word &= (uint64_t(1) << (limit & 63)) - 1; // the bits from limit on end a range
+        }
+        size_t bit = 0;
+        while (bit < 64) {
+            uint64_t rest = (open ? ~word : word) >> bit;
+            if (rest == 0) {
+                break;
+            }
+            bit += __builtin_ctzll(rest);
+            size_t index = i * 64 + bit;
+            if (!open) {
+                begin = index;
+            } else {
+                Append(begin, index, maxGap);
+            }
+            open = !open;
+        }
+    }
+    if (open) {
+        Append(begin, limit, maxGap);
+    }
+    return m_Ranges;
+}
+
+void DirtyRanges::Append(size_t begin, size_t end, size_t maxGap) {
+    if (!m_Ranges.empty() && begin - m_Ranges.back().end <= maxGap) {
+        m_Ranges.back().end = end;
+    } else {
+        Range range = {begin, end};
+        m_Ranges.push_back(range);
+    }
+}
@@ -0,0 +1,54 @@
+
+#ifndef TIMELAPSEDOTMAP_DIRTY_H
+#define TIMELAPSEDOTMAP_DIRTY_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+// Set of changed indices, e.g. the dots that moved since the previous
+// frame, as one bit per index. Coalesce() turns the set into sorted
+// [begin, end) ranges for uploading just those parts of a buffer; ranges
+// closer than a gap are merged, since one longer copy is cheaper than
+// several short ones.
+class DirtyRanges {
+
+public:
+    struct Range {
+        size_t begin;
+        size_t end;
+    };
+
+    explicit DirtyRanges(size_t size = 0);
+
+    size_t GetSize();
+    // clears the set
+    void Resize(size_t size);
+
+    void Mark(size_t index) {
+        m_Words[index >> 6] |= uint64_t(1) << (index & 63);
+    }
+    void MarkRange(size_t begin, size_t end);
+    void MarkAll();
+    // add every index marked in other, which has the same size
+    void Merge(const DirtyRanges& other);
+    void Clear();
+    void Swap(DirtyRanges& other);
+
+    bool IsAll();
+    // marked indices below limit
+    size_t Count(size_t limit = SIZE_MAX);
+    // ranges of marked indices below limit, gaps of up to maxGap unmarked
+    // indices are included in the ranges; valid until the next call
+    const std::vector<Range>& Coalesce(size_t limit, size_t maxGap);
+
+private:
+    void Append(size_t begin, size_t end, size_t maxGap);
+
+    std::vector<uint64_t> m_Words;
+    std::vector<Range> m_Ranges;
+    size_t m_Size;
+    bool m_All; // every index, without filling the words
+};
+
+#endif //TIMELAPSEDOTMAP_DIRTY_H
@@ -2,10 +2,18 @@
 out vec4 FragColor;
 
 in vec2 TexCoords;
+in float Weight;
+in float Tint;
 
 uniform sampler2D texture1;
 
 void main()
 {
-    FragColor = texture(texture1, TexCoords);
+    // as bright as Weight dots on top of each other with additive blending
+    vec4 color = texture(texture1, TexCoords);
+    if (Tint >= 0.0) {
+        // from blue at the low end of the range to red at the high end
+        color.rgb *= mix(vec3(0.2, 0.5, 1.0), vec3(1.0, 0.3, 0.1), Tint);
+    }
+    FragColor = vec4(color.rgb, min(color.a * Weight, 1.0));
 }
\ No newline at end of file
@@ -1,18 +1,45 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
 layout (location = 2) in vec2 aTexCoords;
-layout (location = 3) in vec2 aOffset;
+layout (location = 3) in vec2 aOffset; // lon, lat, or packed steps
+layout (location = 4) in float aWeight; // dots drawn by this instance
+layout (location = 5) in float aColorValue; // the [attributes] columns
+layout (location = 6) in float aFilterValue;
 
 out vec2 TexCoords;
+out float Weight;
+out float Tint; // 0..1 along color_range, -1 for the texture's own colour
 
 uniform mat4 projection;
 uniform mat4 view;
 uniform float dot_scale;
 uniform float x_scale;
+// degrees = packed_origin + aOffset * packed_step when packed, and then
+// packed_outside marks dots outside the packed region
+uniform bool packed;
+uniform vec2 packed_origin;
+uniform vec2 packed_step;
+uniform float packed_outside;
+// dots are tinted by aColorValue, and hidden unless aFilterValue is in filter_range
+uniform bool color_attribute;
+uniform vec2 color_range;
+uniform bool filter_attribute;
+uniform vec2 filter_range;
 
 void main()
 {
     TexCoords = aTexCoords;
-    gl_Position = projection * view * vec4(aPos.x * dot_scale + aOffset.x * x_scale, 
-                                           aPos.y * dot_scale + aOffset.y, 0.0f, 1.0f); 
+    Weight = aWeight;
+    Tint = -1.0f;
+    if ((packed && aOffset.x == packed_outside) ||
+        (filter_attribute && (aFilterValue < filter_range.x || aFilterValue > filter_range.y))) {
+        gl_Position = vec4(2.0f, 2.0f, 2.0f, 1.0f); // clipped
+        return;
+    }
+    if (color_attribute) {
+        Tint = clamp((aColorValue - color_range.x) / max(color_range.y - color_range.x, 1e-6f), 0.0f, 1.0f);
+    }
+    vec2 offset = packed_origin + aOffset * packed_step;
+    gl_Position = projection * view * vec4(aPos.x * dot_scale + offset.x * x_scale, 
+                                           aPos.y * dot_scale + offset.y, 0.0f, 1.0f); 
 }
\ No newline at end of file
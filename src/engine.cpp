@@ -0,0 +1,358 @@
+
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+
+#include <spdlog/spdlog.h>
+#include <INIReader.h>
+
+#include "engine.h"
+#include "profile.h"
+
+ReplaySettings::ReplaySettings() :
+        filename("frames.fb"),
+        engine("segment"),
+        window(120),
+        simd("auto"),
+        idleSeconds(3600),
+        prefetchDepth(256),
+        loop(false)
+{
+}
+
+// the columns named by the [attributes] section, each once
+static std::vector<std::string> ReadAttributes(const INIReader& reader) {
+    std::vector<std::string> attributes;
+    const char* keys[] = {"color", "filter"};
+    for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+        std::string name = reader.Get("attributes", keys[i], "");
+        if (!name.empty() && std::find(attributes.begin(), attributes.end(), name) == attributes.end()) {
+            attributes.push_back(name);
+        }
+    }
+    return attributes;
+}
+
+ReplaySettings::ReplaySettings(const INIReader& reader) :
+        filename(reader.Get("database", "filename", "frames.fb")),
+        engine(reader.Get("interpolation", "engine", "segment")),
+        trajectories(reader.Get("interpolation", "trajectories", "")),
+        window(reader.GetInteger("interpolation", "window", 120)),
+        simd(reader.Get("interpolation", "simd", "auto")),
+        idleSeconds(reader.GetInteger("liveset", "idle", 3600)),
+        prefetchDepth(reader.GetInteger("prefetch", "depth", 256)),
+        loop(false),
+        attributes(ReadAttributes(reader))
+{
+}
+
+ReplayEngine::ReplayEngine(const ReplaySettings& settings, WorkerPool& pool) :
+        m_FrameProvider(settings.filename.c_str()),
+        m_InstanceStore(NULL),
+        m_LiveSet(m_FrameProvider.GetFrameSize(), settings.idleSeconds),
+        m_SeekFrame(m_FrameProvider.GetFrameSize()),
+        m_InstanceFrame(m_FrameProvider.GetFrameSize()),
+        m_Prefetcher(m_FrameProvider, settings.prefetchDepth),
+        m_Position(0),
+        m_Reverse(false),
+        m_Loop(settings.loop),
+        m_AtEnd(false)
+{
+    if (settings.engine == "trajectory") {
+        // nothing to decode, the timeline is all that is needed from the frames
+        std::string filename = settings.trajectories;
+        if (filename.empty()) {
+            filename = settings.filename.substr(0, settings.filename.find_last_of('.')) + ".tldt";
+        }
+        spdlog::info("Loading trajectories...");
+        m_Trajectories.reset(new TrajectoryTracker(filename, m_FrameProvider.GetFrameSize(),
+                                                   settings.idleSeconds));
+        m_Timestamps = m_FrameProvider.GetTimestamps();
+        if (!settings.attributes.empty()) {
+            spdlog::warn("Trajectories have no attribute columns, drawing without them");
+        }
+        Reset(FirstTimestamp());
+        return;
+    }
+    // either a window of frames interpolated in place, or one segment per dot
+    if (settings.engine == "window") {
+        spdlog::info("Creating frame queue...");
+        m_FrameQueue.reset(new FrameQueue(m_FrameProvider, settings.window));
+        m_Interpolator.reset(new Interpolator(*m_FrameQueue, SelectKernels(settings.simd), &pool));
+        m_InstanceStore = m_FrameQueue.get();
+    } else {
+        spdlog::info("Creating segment tracker...");
+        m_Tracker.reset(new SegmentTracker(m_FrameProvider, settings.window));
+        m_InstanceStore = m_Tracker.get();
+    }
+    // engines work on live dots only, numbered by instance
+    m_FrameProvider.GetSnapshot(FirstTimestamp(), m_SeekFrame.data(), m_SeekFrame.size());
+    if (!settings.attributes.empty()) {
+        m_FrameProvider.SelectAttributes(settings.attributes);
+        m_FrameProvider.GetAttributeSnapshot(FirstTimestamp(), m_Attributes);
+        m_InstanceAttributes.resize(m_Attributes.size());
+        spdlog::info("Reading {} attribute columns", m_Attributes.size());
+    }
+    Reset(FirstTimestamp());
+    m_Prefetcher.Start();
+}
+
+ReplayEngine::~ReplayEngine() {
+    m_Prefetcher.Stop();
+}
+
+void ReplayEngine::Reset(uint32_t timestamp) {
+    if (m_Trajectories) {
+        m_Trajectories->Seek(timestamp);
+        return;
+    }
+    m_LiveSet.Reset(timestamp, m_SeekFrame.data(), m_InstanceFrame.data());
+    if (m_Tracker) {
+        m_Tracker->Reset(m_InstanceFrame.data());
+    } else {
+        m_FrameQueue->Fill(m_InstanceFrame.data());
+    }
+}
+
+size_t ReplayEngine::Advance(size_t numDeltas, bool wait) {
+    if (m_Trajectories) {
+        return AdvanceTrajectories(numDeltas);
+    }
+    TLDM_PROFILE_SCOPE("apply deltas");
+    size_t applied = 0;
+    for (; applied < numDeltas && !m_AtEnd; applied++) {
+        const DeltaFrame* delta;
+        while ((delta = m_Prefetcher.Front()) == NULL) {
+            if (!wait) {
+                return applied; // decode is behind, the caller catches up later
+            }
+            std::this_thread::yield();
+        }
+        const update_t* updates = m_LiveSet.Remap(delta->timestamp, delta->updates.data(),
+                                                  delta->updates.size(), *m_InstanceStore);
+        if (m_Tracker) {
+            m_Tracker->Apply(updates, delta->updates.size());
+        } else {
+            m_FrameQueue->Apply(updates, delta->updates.size());
+        }
+        m_LiveSet.Expire(delta->timestamp, *m_InstanceStore);
+        // by slot, so they follow the dots through remapping on their own
+        FrameProvider::ApplyAttributes(delta->attributes, m_Attributes);
+        m_Prefetcher.Pop();
+        UpdateAtEnd();
+    }
+    return applied;
+}
+
+size_t ReplayEngine::AdvanceTrajectories(size_t numDeltas) {
+    // only the position moves, any timestamp can be evaluated
+    size_t applied = 0;
+    for (; applied < numDeltas && !m_AtEnd; applied++) {
+        if (m_Reverse) {
+            m_Position--;
+        } else {
+            if (m_Position == m_Timestamps.size()) {
+                m_Position = 0; // looping, like FrameProvider::NextDelta()
+                m_Trajectories->Seek(FirstTimestamp());
+            }
+            m_Position++;
+        }
+        UpdateAtEnd();
+    }
+    return applied;
+}
+
+size_t ReplayEngine::Render(FrameSink& sink) {
+    size_t numDots = m_Trajectories ? m_Trajectories->Evaluate(CurrentTimestamp()) : m_LiveSet.GetActive();
+    glm::vec2* frame = sink.Acquire(numDots);
+    {
+        TLDM_PROFILE_SCOPE("interpolate");
+        if (m_Trajectories) {
+            m_Trajectories->Pop(frame, numDots);
+            sink.Changed(m_Trajectories->GetChanged());
+        } else if (m_Tracker) {
+            m_Tracker->Pop(frame, numDots);
+            sink.Changed(m_Tracker->GetChanged());
+        } else {
+            m_Interpolator->Interpolate(numDots);
+            m_FrameQueue->Pop(frame, numDots);
+            sink.Changed(m_FrameQueue->GetChanged());
+        }
+    }
+    if (!m_Attributes.empty()) {
+        TLDM_PROFILE_SCOPE("attributes");
+        for (size_t c = 0; c < m_Attributes.size(); c++) {
+            m_InstanceAttributes[c].resize(numDots);
+            for (size_t i = 0; i < numDots; i++) {
+                m_InstanceAttributes[c][i] = m_Attributes[c][m_LiveSet.GetSlot(i)];
+            }
+        }
+        sink.Attributes(m_InstanceAttributes);
+    }
+    sink.Submit(CurrentTimestamp(), numDots);
+    return numDots;
+}
+
+uint32_t ReplayEngine::Seek(uint32_t timestamp) {
+    TLDM_PROFILE_SCOPE("seek");
+    if (m_Trajectories) {
+        // the state at timestamp includes its delta
+        m_Position = std::upper_bound(m_Timestamps.begin(), m_Timestamps.end(), timestamp) - m_Timestamps.begin();
+        uint32_t landed = CurrentTimestamp();
+        Reset(landed);
+        UpdateAtEnd();
+        return landed;
+    }
+    uint32_t landed = m_Prefetcher.Seek(timestamp, m_SeekFrame.data(),
+                                        m_Attributes.empty() ? NULL : &m_Attributes);
+    Reset(landed);
+    UpdateAtEnd();
+    return landed;
+}
+
+bool ReplayEngine::SetReverse(bool reverse) {
+    if (m_Trajectories) {
+        m_Reverse = reverse;
+        UpdateAtEnd();
+        return true;
+    }
+    if (reverse && !m_FrameProvider.IsReversible()) {
+        spdlog::warn("No reverse deltas to rewind with, convert with --reversible");
+        return false;
+    }
+    if (reverse != m_Prefetcher.IsReverse()) {
+        // the live dots and engines carry on, they only see other deltas
+        m_Prefetcher.SetReverse(reverse);
+        UpdateAtEnd();
+    }
+    return true;
+}
+
+bool ReplayEngine::IsReverse() {
+    return m_Trajectories ? m_Reverse : m_Prefetcher.IsReverse();
+}
+
+size_t ReplayEngine::GetPosition() {
+    return m_Trajectories ? m_Position : m_Prefetcher.GetPosition();
+}
+
+void ReplayEngine::UpdateAtEnd() {
+    if (IsReverse()) {
+        m_AtEnd = GetPosition() == 0;
+    } else {
+        m_AtEnd = !m_Loop && GetPosition() > 0 && CurrentTimestamp() == LastTimestamp();
+    }
+}
+
+bool ReplayEngine::AtEnd() {
+    return m_AtEnd;
+}
+
+uint32_t ReplayEngine::FirstTimestamp() {
+    return m_FrameProvider.FirstTimestamp();
+}
+
+uint32_t ReplayEngine::LastTimestamp() {
+    return m_FrameProvider.LastTimestamp();
+}
+
+uint32_t ReplayEngine::CurrentTimestamp() {
+    if (m_Trajectories) {
+        return m_Timestamps[m_Position > 0 ? m_Position - 1 : 0];
+    }
+    return m_Prefetcher.CurrentTimestamp();
+}
+
+size_t ReplayEngine::GetFrameSize() {
+    return m_SeekFrame.size();
+}
+
+size_t ReplayEngine::GetActiveDots() {
+    return m_Trajectories ? m_Trajectories->GetVisible() : m_LiveSet.GetActive();
+}
+
+Prefetcher& ReplayEngine::GetPrefetcher() {
+    return m_Prefetcher;
+}
+
+LiveSet& ReplayEngine::GetLiveSet() {
+    return m_LiveSet;
+}
+
+NullSink::NullSink(size_t frameSize) :
+        m_Frame(frameSize),
+        m_Frames(0),
+        m_Dots(0)
+{
+}
+
+glm::vec2* NullSink::Acquire(size_t numDots) {
+    return m_Frame.data();
+}
+
+void NullSink::Submit(uint32_t timestamp, size_t numDots) {
+    m_Frames++;
+    m_Dots += numDots;
+}
+
+uint64_t NullSink::GetFrames() {
+    return m_Frames;
+}
+
+uint64_t NullSink::GetDots() {
+    return m_Dots;
+}
+
+FileSink::FileSink(const std::string& filename, size_t frameSize) :
+        m_Filename(filename),
+        m_File(NULL),
+        m_Frame(frameSize),
+        m_Frames(0),
+        m_Bytes(0),
+        m_Failed(false)
+{
+    m_File = filename == "-" ? stdout : fopen(filename.c_str(), "wb");
+    if (m_File == NULL) {
+        throw std::runtime_error("Cannot create " + filename);
+    }
+}
+
+FileSink::~FileSink() {
+    if (m_File != NULL && m_File != stdout) {
+        fclose(m_File);
+    }
+}
+
+glm::vec2* FileSink::Acquire(size_t numDots) {
+    return m_Frame.data();
+}
+
+void FileSink::Submit(uint32_t timestamp, size_t numDots) {
+    uint32_t header[2] = {timestamp, uint32_t(numDots)};
+    bool ok = fwrite(header, sizeof(header), 1, m_File) == 1;
+    if (numDots) {
+        ok = ok && fwrite(m_Frame.data(), sizeof(glm::vec2), numDots, m_File) == numDots;
+    }
+    m_Failed = m_Failed || !ok;
+    m_Frames++;
+    m_Bytes += sizeof(header) + numDots * sizeof(glm::vec2);
+}
+
+void FileSink::Finish() {
+    bool ok = fflush(m_File) == 0;
+    if (m_File != stdout) {
+        ok = fclose(m_File) == 0 && ok;
+    }
+    m_File = NULL;
+    if (m_Failed || !ok) {
+        throw std::runtime_error("Cannot write " + m_Filename);
+    }
+}
+
+uint64_t FileSink::GetFrames() {
+    return m_Frames;
+}
+
+uint64_t FileSink::GetBytes() {
+    return m_Bytes;
+}
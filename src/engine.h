@@ -0,0 +1,167 @@
+
+#ifndef TIMELAPSEDOTMAP_ENGINE_H
+#define TIMELAPSEDOTMAP_ENGINE_H
+
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "dirty.h"
+#include "frame.h"
+#include "interpolator.h"
+#include "liveset.h"
+#include "pool.h"
+#include "prefetch.h"
+#include "queue.h"
+#include "tracker.h"
+#include "trajectory.h"
+
+class INIReader;
+
+// Receives the frames of a ReplayEngine. The engine writes the positions
+// straight into the sink's buffer, so e.g. a mapped GL buffer needs no copy.
+class FrameSink {
+
+public:
+    virtual ~FrameSink() {}
+
+    // room for numDots positions, written by the engine before Submit()
+    virtual glm::vec2* Acquire(size_t numDots) = 0;
+    // the frame in the buffer from Acquire() is complete
+    virtual void Submit(uint32_t timestamp, size_t numDots) = 0;
+    // called before Submit() with the dots that may differ from the previous
+    // frame, for sinks that only pass on changes
+    virtual void Changed(DirtyRanges& changed) {}
+    // called before Submit() with the selected attribute columns of the
+    // frame's dots, in the order of the positions
+    virtual void Attributes(const AttributeColumns& columns) {}
+};
+
+struct ReplaySettings {
+    ReplaySettings();
+    // the [database], [interpolation], [liveset], [prefetch] and [attributes] sections
+    explicit ReplaySettings(const INIReader& reader);
+
+    std::string filename;
+    std::string engine; // "segment", "window" or "trajectory"
+    std::string trajectories; // .tldt for the trajectory engine, default filename with that extension
+    size_t window;
+    std::string simd;
+    uint32_t idleSeconds;
+    size_t prefetchDepth;
+    bool loop; // start over after the last timestamp
+    std::vector<std::string> attributes; // columns read along with the positions
+};
+
+// The replay pipeline without any display: decodes deltas ahead on the
+// prefetch thread, keeps the live dots, interpolates them with the
+// configured engine and hands every frame to a FrameSink. The trajectory
+// engine instead evaluates precomputed trajectories at the current
+// timestamp; the deltas only provide the timeline and are not decoded.
+// Selected attribute columns are decoded with the deltas, and each dot
+// keeps its latest value until the next change.
+class ReplayEngine {
+
+public:
+    ReplayEngine(const ReplaySettings& settings, WorkerPool& pool);
+    ~ReplayEngine();
+
+    // apply up to numDeltas decoded deltas, returns how many were. Without
+    // wait it stops when decode is behind; with wait it blocks for decode
+    // instead. Either way it stops after the last timestamp unless looping,
+    // and when rewinding at the first.
+    size_t Advance(size_t numDeltas, bool wait);
+    // interpolate the live dots into the sink, returns their number
+    size_t Render(FrameSink& sink);
+    // jump to the state at timestamp, returns the timestamp reached
+    uint32_t Seek(uint32_t timestamp);
+    // play backwards from the current timestamp with the reverse deltas, or
+    // forwards again. Returns false if the source has no reverse deltas.
+    bool SetReverse(bool reverse);
+    bool IsReverse();
+
+    // the last timestamp has been applied and the engine does not loop, or
+    // rewinding has reached the first
+    bool AtEnd();
+    uint32_t FirstTimestamp();
+    uint32_t LastTimestamp();
+    uint32_t CurrentTimestamp();
+    size_t GetFrameSize();
+    // dots in the last rendered frame
+    size_t GetActiveDots();
+
+    Prefetcher& GetPrefetcher();
+    LiveSet& GetLiveSet();
+
+private:
+    void Reset(uint32_t timestamp);
+    void UpdateAtEnd();
+    size_t GetPosition();
+    size_t AdvanceTrajectories(size_t numDeltas);
+
+    FrameProvider m_FrameProvider;
+    std::unique_ptr<FrameQueue> m_FrameQueue;
+    std::unique_ptr<Interpolator> m_Interpolator;
+    std::unique_ptr<SegmentTracker> m_Tracker;
+    std::unique_ptr<TrajectoryTracker> m_Trajectories;
+    InstanceStore* m_InstanceStore;
+    LiveSet m_LiveSet;
+    std::vector<glm::vec2> m_SeekFrame;
+    std::vector<glm::vec2> m_InstanceFrame;
+    AttributeColumns m_Attributes;         // by slot
+    AttributeColumns m_InstanceAttributes; // by instance, of the last rendered frame
+    Prefetcher m_Prefetcher;
+    std::vector<uint32_t> m_Timestamps; // trajectory engine only, it keeps its own position
+    size_t m_Position;
+    bool m_Reverse;
+    bool m_Loop;
+    bool m_AtEnd;
+};
+
+// Counts frames and drops them, to measure the pipeline on its own
+class NullSink : public FrameSink {
+
+public:
+    explicit NullSink(size_t frameSize);
+
+    glm::vec2* Acquire(size_t numDots);
+    void Submit(uint32_t timestamp, size_t numDots);
+
+    uint64_t GetFrames();
+    uint64_t GetDots();
+
+private:
+    std::vector<glm::vec2> m_Frame;
+    uint64_t m_Frames;
+    uint64_t m_Dots;
+};
+
+// Appends every frame to a file: timestamp and number of dots as uint32,
+// then the dots as float lon, lat pairs, all little endian
+class FileSink : public FrameSink {
+
+public:
+    FileSink(const std::string& filename, size_t frameSize); // "-" for stdout
+    ~FileSink();
+
+    glm::vec2* Acquire(size_t numDots);
+    void Submit(uint32_t timestamp, size_t numDots);
+    // flush and close, throws if anything could not be written
+    void Finish();
+
+    uint64_t GetFrames();
+    uint64_t GetBytes();
+
+private:
+    std::string m_Filename;
+    FILE* m_File;
+    std::vector<glm::vec2> m_Frame;
+    uint64_t m_Frames;
+    uint64_t m_Bytes;
+    bool m_Failed;
+};
+
+#endif //TIMELAPSEDOTMAP_ENGINE_H
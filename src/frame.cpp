@@ -1,21 +1,24 @@
 
+#include <algorithm>
 #include <cstdlib>
+#include <cstring>
+#include <stdexcept>
 
 #include <spdlog/spdlog.h>
 
 #include "frame.h"
+#include "profile.h"
 
 FrameProvider::FrameProvider(const char* filename)
-    : m_TimeIndex(0),
-      m_Db(filename),
-      m_TimestampsQuery(m_Db, "SELECT timestamp FROM timestamps WHERE timestamp > 0"),
-      m_SnapshotQuery(m_Db, "SELECT frame FROM snapshot WHERE timestamp = :timestamp"),
-      m_DeltaQuery(m_Db, "SELECT frame FROM delta WHERE timestamp = :timestamp")
+    : m_TimeIndex(0)
 {
-    m_FrameSize = 70000; // TODO: read it from DB
     spdlog::info("Opening {}...", filename);
-    m_Timestamps = GetTimestamps();
-    spdlog::info("Opened {}, found {} frames", filename, (uint32_t)GetTimestamps().size());
+    m_Source.reset(FrameSource::Open(filename));
+    m_FrameSize = m_Source->GetFrameSize();
+    m_Timestamps = m_Source->GetTimestamps();
+    m_SnapshotTimestamps = m_Source->GetSnapshotTimestamps();
+    spdlog::info("Opened {}, found {} frames and {} snapshots of {} dots", filename,
+                 (uint32_t)m_Timestamps.size(), (uint32_t)m_SnapshotTimestamps.size(), (uint32_t)m_FrameSize);
 }
 
 size_t FrameProvider::GetFrameSize() {
@@ -26,78 +29,223 @@ size_t FrameProvider::GetFrameSizeBytes() {
     return m_FrameSize * sizeof(glm::vec2);
 }
 std::vector<uint32_t> FrameProvider::GetTimestamps() {
-    std::vector<uint32_t> timestamps;
-    
-    // Loop to execute the query step by step, to get one a row of results at a time
-    while (m_TimestampsQuery.executeStep()) {
-        timestamps.push_back(m_TimestampsQuery.getColumn(0));
-    }
-    m_TimestampsQuery.reset();
-    return timestamps;
+    return m_Timestamps;
+}
+
+std::vector<uint32_t> FrameProvider::GetSnapshotTimestamps() {
+    return m_SnapshotTimestamps;
 }
 
 size_t FrameProvider::GetSnapshot(uint32_t timestamp, glm::vec2* buffer, size_t numLocations) {
-    const void* blobData = NULL;
-    size_t blobSize;
-    size_t locationSize = sizeof(float) * 2;
-    
-    m_SnapshotQuery.bind(":timestamp", timestamp);
-    if (m_SnapshotQuery.executeStep()) {
-        SQLite::Column colBlob = m_SnapshotQuery.getColumn(0);
-        blobData = colBlob.getBlob();
-        blobSize = colBlob.getBytes();
-        if (blobSize / locationSize < numLocations) {
-            numLocations = blobSize / locationSize;
-        }
+    TLDM_PROFILE_SCOPE("snapshot");
+    return m_Source->GetSnapshot(timestamp, buffer, numLocations);
+}
 
-        float* floatData = (float*)blobData;
-        spdlog::debug("converting {} floats ({} locations)", 2 * numLocations, numLocations);
-        for (size_t i = 0; i < numLocations; i++) { // TODO: in-situ blob placement by sqlite?
-            buffer[i] = glm::vec2(floatData[2 * i+1], floatData[2 * i]);
-        }
+size_t FrameProvider::FillDelta(uint32_t timestamp, glm::vec2 *frame, size_t numLocations) {
+    TLDM_PROFILE_SCOPE("fill delta");
+    size_t numUpdates;
+    const update_t* updates = m_Source->GetDelta(timestamp, numUpdates);
+    if (numUpdates < numLocations) {
+        numLocations = numUpdates;
     }
-    m_SnapshotQuery.clearBindings();
-    m_SnapshotQuery.reset();
-
+    spdlog::debug("converting {} floats ({} locations)", 2 * numLocations, numLocations);
+    ApplyDelta(updates, numLocations, frame);
     return numLocations;
 }
 
-size_t FrameProvider::FillDelta(uint32_t timestamp, glm::vec2 *frame, size_t numLocations) {
-    const void* blobData = NULL;
-    size_t blobSize;
-    size_t locationSize = sizeof(update_t);
-
-    m_DeltaQuery.bind(":timestamp", timestamp);
-    if (m_DeltaQuery.executeStep()) {
-        SQLite::Column colBlob = m_DeltaQuery.getColumn(0);
-        blobData = colBlob.getBlob();
-        blobSize = colBlob.getBytes();
-        if (blobSize / locationSize < numLocations) {
-            numLocations = blobSize / locationSize;
-        }
-
-        update_t* items = (update_t*)blobData;
-        spdlog::debug("converting {} floats ({} locations)", 2 * numLocations, numLocations);
-        for (size_t i = 0; i < numLocations; i++) {
-            uint32_t index = items[i].index;
-            frame[index] = glm::vec2(items[i].lon, items[i].lat);
-        }
+size_t FrameProvider::ReadDelta(uint32_t timestamp, std::vector<update_t>& updates) {
+    TLDM_PROFILE_SCOPE("read delta");
+    size_t numUpdates;
+    const update_t* data = m_Source->GetDelta(timestamp, numUpdates);
+    // resize() keeps the capacity, so a reused vector stops allocating once warmed up
+    updates.resize(numUpdates);
+    if (numUpdates) {
+        memcpy(updates.data(), data, numUpdates * sizeof(update_t));
     }
-    m_DeltaQuery.clearBindings();
-    m_DeltaQuery.reset();
+    return numUpdates;
+}
 
-    return numLocations;
+void FrameProvider::ApplyDelta(const update_t* updates, size_t numUpdates, glm::vec2* frame) {
+    for (size_t i = 0; i < numUpdates; i++) {
+        uint32_t index = updates[i].index;
+        frame[index] = glm::vec2(updates[i].lon, updates[i].lat);
+    }
 }
 
 void FrameProvider::Next(glm::vec2* frame) {
+    m_TimeIndex %= m_Timestamps.size();
     uint timestamp = m_Timestamps[m_TimeIndex];
     spdlog::debug("Loading frame {} at {} {}",
                   m_TimeIndex, timestamp, (void*)frame);
     FillDelta(timestamp, frame, m_FrameSize);
     m_TimeIndex++;
+}
+
+uint32_t FrameProvider::NextDelta(std::vector<update_t>& updates, AttributeDeltas* attributes) {
     m_TimeIndex %= m_Timestamps.size();
+    uint timestamp = m_Timestamps[m_TimeIndex];
+    ReadDelta(timestamp, updates);
+    if (attributes) {
+        ReadAttributes(timestamp, false, *attributes);
+    }
+    m_TimeIndex++;
+    return timestamp;
+}
+
+void FrameProvider::Prev(glm::vec2* frame) {
+    if (m_TimeIndex == 0) {
+        return;
+    }
+    m_TimeIndex--;
+    size_t numUpdates;
+    const update_t* updates = m_Source->GetReverseDelta(m_Timestamps[m_TimeIndex], numUpdates);
+    ApplyDelta(updates, numUpdates, frame);
+}
+
+uint32_t FrameProvider::PrevDelta(std::vector<update_t>& updates, AttributeDeltas* attributes) {
+    TLDM_PROFILE_SCOPE("read reverse delta");
+    if (m_TimeIndex == 0) {
+        updates.clear();
+        if (attributes) {
+            attributes->assign(m_Attributes.size(), std::vector<attribute_t>());
+        }
+        return m_Timestamps[0];
+    }
+    m_TimeIndex--;
+    size_t numUpdates;
+    const update_t* data = m_Source->GetReverseDelta(m_Timestamps[m_TimeIndex], numUpdates);
+    updates.resize(numUpdates);
+    if (numUpdates) {
+        memcpy(updates.data(), data, numUpdates * sizeof(update_t));
+    }
+    if (attributes) {
+        ReadAttributes(m_Timestamps[m_TimeIndex], true, *attributes);
+    }
+    return m_TimeIndex > 0 ? m_Timestamps[m_TimeIndex - 1] : m_Timestamps[0];
+}
+
+bool FrameProvider::IsReversible() {
+    return m_Source->IsReversible();
+}
+
+void FrameProvider::ApplyAttributes(const AttributeDeltas& attributes, AttributeColumns& columns) {
+    for (size_t c = 0; c < attributes.size() && c < columns.size(); c++) {
+        std::vector<float>& column = columns[c];
+        for (size_t i = 0; i < attributes[c].size(); i++) {
+            const attribute_t& update = attributes[c][i];
+            if (update.index < column.size()) {
+                column[update.index] = update.value;
+            }
+        }
+    }
+}
+
+uint32_t FrameProvider::Seek(uint32_t timestamp, glm::vec2* frame, AttributeColumns* columns) {
+    TLDM_PROFILE_SCOPE("provider seek");
+    if (m_SnapshotTimestamps.empty() || m_Timestamps.empty()) {
+        spdlog::warn("Cannot seek without snapshots");
+        return CurrentTimestamp();
+    }
+
+    // nearest snapshot at or before the target, it holds the state before its own delta
+    std::vector<uint32_t>::iterator snapshot =
+            std::upper_bound(m_SnapshotTimestamps.begin(), m_SnapshotTimestamps.end(), timestamp);
+    if (snapshot != m_SnapshotTimestamps.begin()) {
+        --snapshot;
+    }
+    uint32_t snapshotTimestamp = *snapshot;
+    GetSnapshot(snapshotTimestamp, frame, m_FrameSize);
+
+    size_t first = std::lower_bound(m_Timestamps.begin(), m_Timestamps.end(), snapshotTimestamp) -
+                   m_Timestamps.begin();
+    size_t last = std::upper_bound(m_Timestamps.begin(), m_Timestamps.end(), timestamp) -
+                  m_Timestamps.begin();
+
+    // Only the last write to a slot matters, so roll the deltas forward
+    // newest first and skip slots that already have their final position.
+    m_SeekWritten.assign(m_FrameSize, 0);
+    size_t numWritten = 0;
+    for (size_t t = last; t > first && numWritten < m_FrameSize; t--) {
+        size_t numUpdates;
+        const update_t* updates = m_Source->GetDelta(m_Timestamps[t - 1], numUpdates);
+        for (size_t i = numUpdates; i > 0; i--) {
+            const update_t& update = updates[i - 1];
+            if (update.index < m_FrameSize && !m_SeekWritten[update.index]) {
+                m_SeekWritten[update.index] = 1;
+                frame[update.index] = glm::vec2(update.lon, update.lat);
+                numWritten++;
+            }
+        }
+    }
+    spdlog::debug("Seek to {}: snapshot at {}, {} deltas, {} slots written",
+                  timestamp, snapshotTimestamp, last - first, numWritten);
+    if (columns) {
+        // raw and short, simply rolled forward
+        GetAttributeSnapshot(snapshotTimestamp, *columns);
+        AttributeDeltas attributes;
+        for (size_t t = first; t < last; t++) {
+            ReadAttributes(m_Timestamps[t], false, attributes);
+            ApplyAttributes(attributes, *columns);
+        }
+    }
+
+    m_TimeIndex = last;
+    return last > 0 ? m_Timestamps[last - 1] : m_Timestamps[0];
+}
+
+size_t FrameProvider::GetPosition() {
+    return m_TimeIndex;
+}
+
+void FrameProvider::SetPosition(size_t position) {
+    m_TimeIndex = std::min(position, m_Timestamps.size());
 }
 
 uint32_t FrameProvider::CurrentTimestamp() {
-    return m_Timestamps[m_TimeIndex];;
+    return m_Timestamps[m_TimeIndex % m_Timestamps.size()];
+}
+
+uint32_t FrameProvider::FirstTimestamp() {
+    return m_Timestamps.front();
+}
+
+uint32_t FrameProvider::LastTimestamp() {
+    return m_Timestamps.back();
+}
+
+std::vector<std::string> FrameProvider::GetAttributes() {
+    return m_Source->GetAttributes();
+}
+
+void FrameProvider::SelectAttributes(const std::vector<std::string>& names) {
+    std::vector<std::string> stored = GetAttributes();
+    for (size_t i = 0; i < names.size(); i++) {
+        if (std::find(stored.begin(), stored.end(), names[i]) == stored.end()) {
+            throw std::runtime_error("no attribute column " + names[i] + ", see tldm-convert --attributes");
+        }
+    }
+    m_Attributes = names;
+}
+
+size_t FrameProvider::GetNumAttributes() {
+    return m_Attributes.size();
+}
+
+void FrameProvider::GetAttributeSnapshot(uint32_t timestamp, AttributeColumns& columns) {
+    columns.resize(m_Attributes.size());
+    for (size_t c = 0; c < m_Attributes.size(); c++) {
+        columns[c].assign(m_FrameSize, 0.0f);
+        m_Source->GetAttributeSnapshot(m_Attributes[c], timestamp, columns[c].data(), m_FrameSize);
+    }
+}
+
+void FrameProvider::ReadAttributes(uint32_t timestamp, bool reverse, AttributeDeltas& attributes) {
+    TLDM_PROFILE_SCOPE("read attributes");
+    attributes.resize(m_Attributes.size());
+    for (size_t c = 0; c < m_Attributes.size(); c++) {
+        size_t numUpdates;
+        const attribute_t* data = reverse ? m_Source->GetReverseAttributeDelta(m_Attributes[c], timestamp, numUpdates)
+                                          : m_Source->GetAttributeDelta(m_Attributes[c], timestamp, numUpdates);
+        attributes[c].assign(data, data + numUpdates);
+    }
 }
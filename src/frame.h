@@ -1,35 +1,73 @@
 #ifndef __FRAME_H__
 #define __FRAME_H__
 
+#include <memory>
+#include <string>
 #include <vector>
 
 #include <glm/gtc/type_ptr.hpp>
-#include <SQLiteCpp/SQLiteCpp.h>
 
+#include "source.h"
 #include "update.h"
 
+// the selected attribute columns: their changes of one timestamp, and
+// their values by slot
+typedef std::vector<std::vector<attribute_t> > AttributeDeltas;
+typedef std::vector<std::vector<float> > AttributeColumns;
+
 class FrameProvider  {
 
 public:
+    // filename is a .tldm container or an SQLite database
     explicit FrameProvider(const char* filename);
     std::vector<uint32_t> GetTimestamps();
     size_t GetFrameSize();
     size_t GetFrameSizeBytes();
     size_t GetSnapshot(uint32_t timestamp, glm::vec2* frame, size_t size);
     size_t FillDelta(uint32_t timestamp, glm::vec2 *frame, size_t numLocations);
+    size_t ReadDelta(uint32_t timestamp, std::vector<update_t>& updates);
     void Next(glm::vec2 *frame);
+    // with attributes, also the changes of the selected attribute columns
+    uint32_t NextDelta(std::vector<update_t>& updates, AttributeDeltas* attributes = NULL);
+    // Step back over the last delta, with its reverse from a reversible
+    // source: no snapshot is read, so it costs the same as a step forward.
+    // At the first timestamp nothing changes.
+    void Prev(glm::vec2* frame);
+    // the reverse of the last delta, returns the timestamp of the delta before it
+    uint32_t PrevDelta(std::vector<update_t>& updates, AttributeDeltas* attributes = NULL);
+    bool IsReversible();
+    static void ApplyDelta(const update_t* updates, size_t numUpdates, glm::vec2* frame);
+    static void ApplyAttributes(const AttributeDeltas& attributes, AttributeColumns& columns);
+    // with columns, also the selected attribute columns at timestamp
+    uint32_t Seek(uint32_t timestamp, glm::vec2* frame, AttributeColumns* columns = NULL);
+    // index of the next delta, the number of timestamps after the last one
+    size_t GetPosition();
+    void SetPosition(size_t position);
     uint32_t CurrentTimestamp();
+    uint32_t FirstTimestamp();
+    uint32_t LastTimestamp();
+    std::vector<uint32_t> GetSnapshotTimestamps();
+
+    // Attribute columns stored in the source, and the ones read along with
+    // the positions from now on; the others are never read. Throws for a
+    // column that is not stored.
+    std::vector<std::string> GetAttributes();
+    void SelectAttributes(const std::vector<std::string>& names);
+    size_t GetNumAttributes();
+    // the selected columns at the snapshot at timestamp
+    void GetAttributeSnapshot(uint32_t timestamp, AttributeColumns& columns);
 
 private:
+    void ReadAttributes(uint32_t timestamp, bool reverse, AttributeDeltas& attributes);
+
+    std::unique_ptr<FrameSource> m_Source;
     size_t m_FrameSize;
     std::vector<uint32_t> m_Timestamps;
+    std::vector<uint32_t> m_SnapshotTimestamps; // keyframe index
+    std::vector<char> m_SeekWritten;
+    std::vector<std::string> m_Attributes; // selected
     uint m_TimeIndex;
-    SQLite::Database m_Db;
-    SQLite::Statement m_TimestampsQuery;
-    SQLite::Statement m_SnapshotQuery;
-    SQLite::Statement m_DeltaQuery;
 
 };
 
 #endif // __FRAME_H__
-
@@ -0,0 +1,326 @@
+
+#include <algorithm>
+#include <cfloat>
+
+#include <spdlog/spdlog.h>
+
+#include "glsink.h"
+#include "profile.h"
+
+// instance attribute layout of the uploaded positions
+static void PositionPointer(bool packed, size_t offset) {
+    if (packed) {
+        glVertexAttribPointer(3, 2, GL_UNSIGNED_SHORT, GL_FALSE, sizeof(PackedPosition), (void*)offset);
+    } else {
+        glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), (void*)offset);
+    }
+}
+
+// an attribute column at location, or a constant without one
+static void AttributePointer(GLuint location, InstanceBuffer* buffer, size_t offset) {
+    if (buffer) {
+        glBindBuffer(GL_ARRAY_BUFFER, buffer->GetBuffer());
+        glEnableVertexAttribArray(location);
+        glVertexAttribPointer(location, 1, GL_FLOAT, GL_FALSE, sizeof(float), (void*)offset);
+    } else {
+        glDisableVertexAttribArray(location);
+        glVertexAttrib1f(location, 0.0f);
+    }
+}
+
+// unchanged dots between two changed ranges that are uploaded anyway,
+// rather than starting another copy
+static const size_t DIRTY_GAP = 4;
+
+GlSink::GlSink(size_t frameSize, const GlSinkSettings& settings, Shader& shader,
+               const std::vector<Mesh>& meshes, GLuint texture) :
+        m_Settings(settings),
+        m_Shader(shader),
+        m_Meshes(meshes),
+        m_Texture(texture),
+        m_Instances(frameSize * (settings.packed ? sizeof(PackedPosition) : sizeof(glm::vec2))),
+        m_Weights(frameSize * sizeof(float)),
+        m_Columns(NULL),
+        m_Mapped(NULL),
+        m_Pack(SelectPackKernels("auto")),
+        m_PackScale(PACKED_STEPS / (settings.packedMaximum - settings.packedMinimum)),
+        m_ElementSize(settings.packed ? sizeof(PackedPosition) : sizeof(glm::vec2)),
+        m_Changed(NULL),
+        m_UploadedBytes(0),
+        m_FullBytes(0),
+        m_PartialUploads(0),
+        m_Projection(1.0f),
+        m_View(1.0f),
+        m_DotScale(1.0f),
+        m_XScale(1.0f),
+        m_CameraZ(0.0f)
+{
+    bool grid = m_Settings.cull || m_Settings.lodZoom > 0.0f;
+    if (grid || m_Settings.packed || m_Settings.dirtyThreshold > 0.0f) {
+        m_Display.resize(frameSize);
+    }
+    if (grid && m_Settings.packed) {
+        m_Visible.resize(frameSize);
+    }
+    if (m_Settings.colorAttribute >= 0) {
+        m_ColorValues.reset(new InstanceBuffer(frameSize * sizeof(float)));
+    }
+    if (m_Settings.filterAttribute >= 0) {
+        m_FilterValues.reset(new InstanceBuffer(frameSize * sizeof(float)));
+    }
+    if (grid && (m_ColorValues || m_FilterValues)) {
+        m_Found.resize(frameSize);
+    }
+    if (m_Settings.dirtyThreshold > 0.0f) {
+        // nothing has been written to any region yet
+        m_RegionChanges.assign(m_Instances.GetNumRegions(), DirtyRanges(frameSize));
+        for (size_t i = 0; i < m_RegionChanges.size(); i++) {
+            m_RegionChanges[i].MarkAll();
+        }
+    }
+    if (m_Settings.packed) {
+        glm::vec2 step = 1.0f / m_PackScale;
+        spdlog::info("Packing positions with {} kernels, steps of {:.6f} x {:.6f} degrees",
+                     m_Pack.name, step.x, step.y);
+    }
+    // set positions as an instance vertex attribute (with divisor 1)
+    for (size_t i = 0; i < m_Meshes.size(); i++) {
+        glBindVertexArray(m_Meshes[i].vao);
+        glBindBuffer(GL_ARRAY_BUFFER, m_Instances.GetBuffer());
+        glEnableVertexAttribArray(3);
+        PositionPointer(m_Settings.packed, 0);
+
+        glVertexAttribDivisor(3, 1);
+        glVertexAttribDivisor(4, 1);
+        glVertexAttribDivisor(5, 1);
+        glVertexAttribDivisor(6, 1);
+
+        glBindVertexArray(0);
+    }
+}
+
+void GlSink::SetView(const glm::mat4& projection, const glm::mat4& view, float dotScale, float xScale,
+                     float cameraZ) {
+    m_Projection = projection;
+    m_View = view;
+    m_DotScale = dotScale;
+    m_XScale = xScale;
+    m_CameraZ = cameraZ;
+}
+
+glm::vec2* GlSink::Acquire(size_t numDots) {
+    if (m_Display.empty()) {
+        // the engine writes the whole frame straight into the buffer
+        m_Mapped = (glm::vec2*)m_Instances.Map();
+        return m_Mapped;
+    }
+    return m_Display.data();
+}
+
+void GlSink::Changed(DirtyRanges& changed) {
+    m_Changed = &changed;
+}
+
+void GlSink::Attributes(const AttributeColumns& columns) {
+    m_Columns = &columns;
+}
+
+void GlSink::Write(const glm::vec2* positions, size_t begin, size_t end) {
+    if (m_Settings.packed) {
+        m_Pack.pack(positions + begin, end - begin, m_Settings.packedMinimum, m_PackScale,
+                    (PackedPosition*)m_Mapped + begin);
+    } else if (positions != m_Mapped) {
+        std::copy(positions + begin, positions + end, m_Mapped + begin);
+    }
+    m_Instances.Flush(begin * m_ElementSize, (end - begin) * m_ElementSize);
+    m_UploadedBytes += (end - begin) * m_ElementSize;
+}
+
+void GlSink::Upload(const glm::vec2* positions, size_t numDots, bool byInstance) {
+    m_FullBytes += numDots * m_ElementSize;
+    if (!m_RegionChanges.empty()) {
+        // Every region misses this frame's changes until it is written. A
+        // frame changed past the threshold means a full upload for each of
+        // them anyway, so they are marked whole instead of merged.
+        bool full = !m_Changed || (numDots > 0 && m_Changed->Count(numDots) >= m_Settings.dirtyThreshold * numDots);
+        for (size_t i = 0; i < m_RegionChanges.size(); i++) {
+            if (full) {
+                m_RegionChanges[i].MarkAll();
+            } else {
+                m_RegionChanges[i].Merge(*m_Changed);
+            }
+        }
+        DirtyRanges& changes = m_RegionChanges[m_Instances.GetRegion()];
+        if (byInstance && changes.Count(numDots) < m_Settings.dirtyThreshold * numDots) {
+            const std::vector<DirtyRanges::Range>& ranges = changes.Coalesce(numDots, DIRTY_GAP);
+            uint64_t uploaded = m_UploadedBytes;
+            for (size_t i = 0; i < ranges.size(); i++) {
+                Write(positions, ranges[i].begin, ranges[i].end);
+            }
+            spdlog::debug("Uploaded {} of {} bytes in {} ranges", m_UploadedBytes - uploaded,
+                          numDots * m_ElementSize, ranges.size());
+            changes.Clear();
+            m_PartialUploads++;
+            return;
+        }
+        // culled dots are not in instance order, so the next frame written
+        // to this region needs all of them again
+        if (byInstance) {
+            changes.Clear();
+        } else {
+            changes.MarkAll();
+        }
+    }
+    Write(positions, 0, numDots);
+}
+
+size_t GlSink::UploadAttribute(InstanceBuffer& buffer, int column, size_t numDots, bool byInstance) {
+    float* mapped = (float*)buffer.Map();
+    if (m_Columns && size_t(column) < m_Columns->size()) {
+        // in the order of the positions: by instance, or as the grid found them
+        const float* values = (*m_Columns)[column].data();
+        if (byInstance) {
+            std::copy(values, values + numDots, mapped);
+        } else {
+            for (size_t i = 0; i < numDots; i++) {
+                mapped[i] = values[m_Found[i]];
+            }
+        }
+    } else {
+        std::fill(mapped, mapped + numDots, 0.0f);
+    }
+    m_UploadedBytes += numDots * sizeof(float);
+    return buffer.Unmap();
+}
+
+void GlSink::Submit(uint32_t timestamp, size_t numDots) {
+    int level = -1;
+    size_t weightOffset = 0;
+    // the engine's frame, or the dots picked by the grid
+    const glm::vec2* positions = m_Display.empty() ? m_Mapped : m_Display.data();
+    bool query = false;
+    glm::vec2 viewMinimum(-FLT_MAX), viewMaximum(FLT_MAX);
+    if (m_Settings.cull || m_Settings.lodZoom > 0.0f) {
+        TLDM_PROFILE_SCOPE("cull");
+        if (!m_Grid && numDots > 0) {
+            glm::vec2 minimum = m_Display[0], maximum = m_Display[0];
+            for (size_t i = 1; i < numDots; i++) {
+                minimum = glm::min(minimum, m_Display[i]);
+                maximum = glm::max(maximum, m_Display[i]);
+            }
+            m_Grid.reset(new SpatialGrid(minimum, maximum, m_Settings.cullCells));
+        }
+        if (m_Grid) {
+            m_Grid->Sync(m_Display.data(), numDots);
+            SpatialGrid::ViewBounds(m_Projection, m_View, m_XScale, m_DotScale, viewMinimum, viewMaximum);
+            if (m_Settings.lodZoom > 0.0f && m_CameraZ >= m_Settings.lodZoom) {
+                level = m_Grid->GetLevel(m_Settings.lodCell * m_DotScale);
+            }
+            // with the whole grid in view there is next to nothing to cull,
+            // and drawing by instance allows uploading just the changes
+            query = level >= 0 || (m_Settings.cull && !m_Grid->Covers(viewMinimum, viewMaximum));
+        }
+    }
+    if (!m_Display.empty()) {
+        // keep the region's contents when only changes may be written
+        m_Mapped = (glm::vec2*)m_Instances.Map(!query && !m_RegionChanges.empty());
+    }
+    if (query) {
+        TLDM_PROFILE_SCOPE("cull");
+        // straight into the mapped buffer, unless they are packed first
+        glm::vec2* visible = m_Settings.packed ? m_Visible.data() : m_Mapped;
+        if (level >= 0) {
+            numDots = m_Grid->QueryDensity(viewMinimum, viewMaximum, level, visible,
+                                           (float*)m_Weights.Map());
+            weightOffset = m_Weights.Unmap();
+        } else {
+            numDots = m_Grid->Query(viewMinimum, viewMaximum, visible, m_Found.empty() ? NULL : m_Found.data());
+        }
+        positions = visible;
+    }
+    size_t instanceOffset;
+    {
+        TLDM_PROFILE_SCOPE("upload");
+        Upload(positions, numDots, !query);
+        instanceOffset = m_Instances.Unmap();
+    }
+    // density cells stand for many dots, their attributes are not drawn
+    InstanceBuffer* colors = level < 0 ? m_ColorValues.get() : NULL;
+    InstanceBuffer* filters = level < 0 ? m_FilterValues.get() : NULL;
+    size_t colorOffset = 0, filterOffset = 0;
+    {
+        TLDM_PROFILE_SCOPE("upload attributes");
+        if (colors) {
+            colorOffset = UploadAttribute(*colors, m_Settings.colorAttribute, numDots, !query);
+        }
+        if (filters) {
+            filterOffset = UploadAttribute(*filters, m_Settings.filterAttribute, numDots, !query);
+        }
+    }
+
+    TLDM_PROFILE_SCOPE("draw");
+    m_Shader.use();
+    m_Shader.setMat4("projection", m_Projection);
+    m_Shader.setMat4("view", m_View);
+    m_Shader.setFloat("dot_scale", m_DotScale);
+    m_Shader.setFloat("x_scale", m_XScale);
+    // packed positions back to degrees, unpacked ones are passed through
+    m_Shader.setBool("packed", m_Settings.packed);
+    if (m_Settings.packed) {
+        m_Shader.setVec2("packed_origin", m_Settings.packedMinimum);
+        m_Shader.setVec2("packed_step", 1.0f / m_PackScale);
+        m_Shader.setFloat("packed_outside", PACKED_OUTSIDE);
+    } else {
+        m_Shader.setVec2("packed_origin", glm::vec2(0.0f));
+        m_Shader.setVec2("packed_step", glm::vec2(1.0f));
+    }
+    m_Shader.setBool("color_attribute", colors != NULL);
+    m_Shader.setVec2("color_range", m_Settings.colorRange);
+    m_Shader.setBool("filter_attribute", filters != NULL);
+    m_Shader.setVec2("filter_range", m_Settings.filterRange);
+    m_Shader.setInt("texture1", 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, m_Texture);
+    for (size_t i = 0; i < m_Meshes.size(); i++) {
+        glBindVertexArray(m_Meshes[i].vao);
+        // point the instance attributes at the regions written this frame
+        glBindBuffer(GL_ARRAY_BUFFER, m_Instances.GetBuffer());
+        PositionPointer(m_Settings.packed, instanceOffset);
+        if (level >= 0) {
+            glBindBuffer(GL_ARRAY_BUFFER, m_Weights.GetBuffer());
+            glEnableVertexAttribArray(4);
+            glVertexAttribPointer(4, 1, GL_FLOAT, GL_FALSE, sizeof(float), (void*)weightOffset);
+        } else {
+            glDisableVertexAttribArray(4);
+            glVertexAttrib1f(4, 1.0f);
+        }
+        AttributePointer(5, colors, colorOffset);
+        AttributePointer(6, filters, filterOffset);
+        glDrawElementsInstanced(GL_TRIANGLES, m_Meshes[i].numIndices, GL_UNSIGNED_INT, nullptr, numDots);
+        glBindVertexArray(0);
+    }
+    m_Instances.Fence();
+    if (level >= 0) {
+        m_Weights.Fence();
+    }
+    if (colors) {
+        colors->Fence();
+    }
+    if (filters) {
+        filters->Fence();
+    }
+    m_Changed = NULL;
+    m_Columns = NULL;
+}
+
+uint64_t GlSink::GetUploadedBytes() {
+    return m_UploadedBytes;
+}
+
+uint64_t GlSink::GetFullBytes() {
+    return m_FullBytes;
+}
+
+uint64_t GlSink::GetPartialUploads() {
+    return m_PartialUploads;
+}
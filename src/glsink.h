@@ -0,0 +1,104 @@
+
+#ifndef TIMELAPSEDOTMAP_GLSINK_H
+#define TIMELAPSEDOTMAP_GLSINK_H
+
+#include <memory>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <learnopengl/shader.h>
+
+#include "engine.h"
+#include "grid.h"
+#include "instances.h"
+#include "kernels.h"
+
+struct GlSinkSettings {
+    bool cull;        // draw only the dots in view
+    size_t cullCells; // grid cells per side
+    float lodZoom;    // camera height from which density cells are drawn, 0: never
+    float lodCell;    // largest density cell, in dot sizes
+    bool packed;      // upload positions as PackedPosition within the region below
+    glm::vec2 packedMinimum;
+    glm::vec2 packedMaximum;
+    float dirtyThreshold; // upload just the changed dots while fewer than this fraction changed, 0: never
+    int colorAttribute;   // engine attribute column tinting the dots, -1: none
+    glm::vec2 colorRange; // its values from the first tint to the last
+    int filterAttribute;  // engine attribute column hiding the dots outside filterRange, -1: none
+    glm::vec2 filterRange;
+};
+
+// Uploads frames into the triple-buffered instance arrays and draws them as
+// instanced dots. Dots outside the view are not uploaded, and zoomed out
+// views draw density cells instead; the grid for this covers where the
+// dots are in the first frame. Packed positions halve the upload; the
+// shader turns them back into degrees. Frames drawn by instance, i.e. not
+// culled, only upload the dots that changed since the region of the
+// buffer was last written, as long as few enough did. The attribute
+// columns used for colour and filtering are uploaded whole each frame, one
+// float per dot next to the positions; density cells ignore them.
+class GlSink : public FrameSink {
+
+public:
+    // one instanced draw per mesh of the dot model
+    struct Mesh {
+        GLuint vao;
+        GLsizei numIndices;
+    };
+
+    GlSink(size_t frameSize, const GlSinkSettings& settings, Shader& shader,
+           const std::vector<Mesh>& meshes, GLuint texture);
+
+    // camera for the next Submit()
+    void SetView(const glm::mat4& projection, const glm::mat4& view, float dotScale, float xScale,
+                 float cameraZ);
+
+    glm::vec2* Acquire(size_t numDots);
+    void Changed(DirtyRanges& changed);
+    void Attributes(const AttributeColumns& columns);
+    void Submit(uint32_t timestamp, size_t numDots);
+
+    // bytes written to the instance buffer, and what whole frames would
+    // have taken, since the start
+    uint64_t GetUploadedBytes();
+    uint64_t GetFullBytes();
+    uint64_t GetPartialUploads();
+
+private:
+    GlSinkSettings m_Settings;
+    Shader& m_Shader;
+    std::vector<Mesh> m_Meshes;
+    GLuint m_Texture;
+
+    void Upload(const glm::vec2* positions, size_t numDots, bool byInstance);
+    void Write(const glm::vec2* positions, size_t begin, size_t end);
+    size_t UploadAttribute(InstanceBuffer& buffer, int column, size_t numDots, bool byInstance);
+
+    InstanceBuffer m_Instances;
+    InstanceBuffer m_Weights; // dots per instance, only used for density cells
+    std::unique_ptr<SpatialGrid> m_Grid;
+    std::vector<glm::vec2> m_Display;
+    std::vector<glm::vec2> m_Visible; // packed only: culled dots before packing
+    std::unique_ptr<InstanceBuffer> m_ColorValues;  // one float per instance, if used
+    std::unique_ptr<InstanceBuffer> m_FilterValues;
+    const AttributeColumns* m_Columns; // this frame's, from the engine
+    std::vector<uint32_t> m_Found;     // instances of the culled dots, for their attributes
+    glm::vec2* m_Mapped;
+    const PackKernels& m_Pack;
+    glm::vec2 m_PackScale;
+    size_t m_ElementSize; // in the instance buffer
+    DirtyRanges* m_Changed; // this frame's, from the engine
+    std::vector<DirtyRanges> m_RegionChanges; // since each region was written
+    uint64_t m_UploadedBytes;
+    uint64_t m_FullBytes;
+    uint64_t m_PartialUploads;
+
+    glm::mat4 m_Projection;
+    glm::mat4 m_View;
+    float m_DotScale;
+    float m_XScale;
+    float m_CameraZ;
+};
+
+#endif //TIMELAPSEDOTMAP_GLSINK_H
@@ -0,0 +1,202 @@
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "grid.h"
+
+SpatialGrid::SpatialGrid(const glm::vec2& minimum, const glm::vec2& maximum, size_t cellsPerSide) :
+        m_Minimum(minimum),
+        m_CellSize((maximum - minimum) / float(cellsPerSide)),
+        m_CellsPerSide(cellsPerSide),
+        m_Cells(cellsPerSide * cellsPerSide),
+        m_Sums(cellsPerSide * cellsPerSide),
+        m_Moves(0)
+{
+    // an empty extent (e.g. a single dot) still needs cells of some size
+    m_CellSize.x = std::max(m_CellSize.x, 1e-6f);
+    m_CellSize.y = std::max(m_CellSize.y, 1e-6f);
+}
+
+size_t SpatialGrid::GetSize() {
+    return m_Locations.size();
+}
+
+size_t SpatialGrid::GetMoves() {
+    return m_Moves;
+}
+
+glm::vec2 SpatialGrid::GetCellSize() {
+    return m_CellSize;
+}
+
+size_t SpatialGrid::CellX(float x) {
+    float cell = std::floor((x - m_Minimum.x) / m_CellSize.x);
+    return (size_t)std::min(std::max(cell, 0.0f), float(m_CellsPerSide - 1));
+}
+
+size_t SpatialGrid::CellY(float y) {
+    float cell = std::floor((y - m_Minimum.y) / m_CellSize.y);
+    return (size_t)std::min(std::max(cell, 0.0f), float(m_CellsPerSide - 1));
+}
+
+void SpatialGrid::Insert(uint32_t instance, const glm::vec2& position) {
+    uint32_t cell = CellY(position.y) * m_CellsPerSide + CellX(position.x);
+    m_Locations[instance].position = position;
+    m_Locations[instance].cell = cell;
+    m_Locations[instance].index = m_Cells[cell].size();
+    m_Cells[cell].push_back(instance);
+    m_Sums[cell].x += position.x;
+    m_Sums[cell].y += position.y;
+}
+
+void SpatialGrid::Remove(uint32_t instance) {
+    // the last instance of the cell takes the place of the removed one
+    const Location& location = m_Locations[instance];
+    std::vector<uint32_t>& instances = m_Cells[location.cell];
+    m_Sums[location.cell].x -= location.position.x;
+    m_Sums[location.cell].y -= location.position.y;
+    instances[location.index] = instances.back();
+    m_Locations[instances[location.index]].index = location.index;
+    instances.pop_back();
+    if (instances.empty()) {
+        // no rounding left over from the positions that passed through
+        m_Sums[location.cell].x = m_Sums[location.cell].y = 0.0;
+    }
+}
+
+void SpatialGrid::Update(uint32_t instance, const glm::vec2& position) {
+    Location& location = m_Locations[instance];
+    uint32_t cell = CellY(position.y) * m_CellsPerSide + CellX(position.x);
+    if (cell == location.cell) {
+        m_Sums[cell].x += position.x - location.position.x;
+        m_Sums[cell].y += position.y - location.position.y;
+        location.position = position;
+        return;
+    }
+    Remove(instance);
+    Insert(instance, position);
+    m_Moves++;
+}
+
+void SpatialGrid::Sync(const glm::vec2* positions, size_t numInstances) {
+    size_t numKept = std::min(numInstances, m_Locations.size());
+    for (size_t instance = numInstances; instance < m_Locations.size(); instance++) {
+        Remove(instance);
+    }
+    m_Locations.resize(numInstances);
+    for (size_t instance = 0; instance < numKept; instance++) {
+        if (m_Locations[instance].position != positions[instance]) {
+            Update(instance, positions[instance]);
+        }
+    }
+    for (size_t instance = numKept; instance < numInstances; instance++) {
+        Insert(instance, positions[instance]);
+    }
+}
+
+bool SpatialGrid::Covers(const glm::vec2& minimum, const glm::vec2& maximum) {
+    glm::vec2 extent = m_Minimum + m_CellSize * float(m_CellsPerSide);
+    return minimum.x <= m_Minimum.x && minimum.y <= m_Minimum.y &&
+           maximum.x >= extent.x && maximum.y >= extent.y;
+}
+
+size_t SpatialGrid::Query(const glm::vec2& minimum, const glm::vec2& maximum, glm::vec2* out,
+                          uint32_t* found) {
+    size_t count = 0;
+    size_t x0 = CellX(minimum.x), x1 = CellX(maximum.x);
+    size_t y0 = CellY(minimum.y), y1 = CellY(maximum.y);
+    size_t last = m_CellsPerSide - 1;
+    for (size_t y = y0; y <= y1; y++) {
+        // cells on the edge of the query need a test per dot, and so do the
+        // border cells of the grid which also hold the dots outside it
+        bool insideY = y > y0 && y < y1 && y > 0 && y < last;
+        for (size_t x = x0; x <= x1; x++) {
+            const std::vector<uint32_t>& instances = m_Cells[y * m_CellsPerSide + x];
+            if (insideY && x > x0 && x < x1 && x > 0 && x < last) {
+                for (size_t i = 0; i < instances.size(); i++) {
+                    if (found) {
+                        found[count] = instances[i];
+                    }
+                    out[count++] = m_Locations[instances[i]].position;
+                }
+                continue;
+            }
+            for (size_t i = 0; i < instances.size(); i++) {
+                const glm::vec2& position = m_Locations[instances[i]].position;
+                if (position.x >= minimum.x && position.x <= maximum.x &&
+                    position.y >= minimum.y && position.y <= maximum.y) {
+                    if (found) {
+                        found[count] = instances[i];
+                    }
+                    out[count++] = position;
+                }
+            }
+        }
+    }
+    return count;
+}
+
+int SpatialGrid::GetLevel(float size) {
+    int level = -1;
+    for (size_t block = 1; block <= m_CellsPerSide && m_CellSize.y * block <= size; block *= 2) {
+        level++;
+    }
+    return level;
+}
+
+size_t SpatialGrid::QueryDensity(const glm::vec2& minimum, const glm::vec2& maximum, int level,
+                                 glm::vec2* positions, float* weights) {
+    size_t count = 0;
+    size_t x0 = CellX(minimum.x) >> level, x1 = CellX(maximum.x) >> level;
+    size_t y0 = CellY(minimum.y) >> level, y1 = CellY(maximum.y) >> level;
+    for (size_t by = y0; by <= y1; by++) {
+        for (size_t bx = x0; bx <= x1; bx++) {
+            size_t numDots = 0;
+            Sum sum = {0.0, 0.0};
+            size_t yEnd = std::min((by + 1) << level, m_CellsPerSide);
+            size_t xEnd = std::min((bx + 1) << level, m_CellsPerSide);
+            for (size_t y = by << level; y < yEnd; y++) {
+                for (size_t x = bx << level; x < xEnd; x++) {
+                    size_t cell = y * m_CellsPerSide + x;
+                    numDots += m_Cells[cell].size();
+                    sum.x += m_Sums[cell].x;
+                    sum.y += m_Sums[cell].y;
+                }
+            }
+            if (numDots) {
+                positions[count] = glm::vec2(float(sum.x / numDots), float(sum.y / numDots));
+                weights[count] = float(numDots);
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+bool SpatialGrid::ViewBounds(const glm::mat4& projection, const glm::mat4& view, float xScale, float margin,
+                             glm::vec2& minimum, glm::vec2& maximum) {
+    glm::mat4 inverse = glm::inverse(projection * view);
+    glm::vec2 lower(std::numeric_limits<float>::max());
+    glm::vec2 upper(-std::numeric_limits<float>::max());
+    for (int corner = 0; corner < 4; corner++) {
+        float x = corner & 1 ? 1.0f : -1.0f;
+        float y = corner & 2 ? 1.0f : -1.0f;
+        glm::vec4 near = inverse * glm::vec4(x, y, -1.0f, 1.0f);
+        glm::vec4 far = inverse * glm::vec4(x, y, 1.0f, 1.0f);
+        near = near / near.w;
+        far = far / far.w;
+        // where the ray through this corner of the screen meets z = 0
+        if ((near.z > 0.0f) == (far.z > 0.0f)) {
+            return false;
+        }
+        float t = near.z / (near.z - far.z);
+        glm::vec2 point(near.x + (far.x - near.x) * t, near.y + (far.y - near.y) * t);
+        lower = glm::min(lower, point);
+        upper = glm::max(upper, point);
+    }
+    // offsets are stored in degrees, the shader scales x
+    minimum = glm::vec2((lower.x - margin) / xScale, lower.y - margin);
+    maximum = glm::vec2((upper.x + margin) / xScale, upper.y + margin);
+    return true;
+}
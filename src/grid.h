@@ -0,0 +1,86 @@
+
+#ifndef TIMELAPSEDOTMAP_GRID_H
+#define TIMELAPSEDOTMAP_GRID_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// Uniform lon/lat grid over the displayed dot positions, by instance, for
+// drawing only the dots in view. Positions outside the grid extent are
+// kept in the border cells. Cells list their instances; positions stay in
+// one array by instance, because the interpolation moves nearly every dot
+// a little each frame and only a few of them change cell. A query copies
+// the dots of cells inside the view and tests single dots only in the
+// cells on its edge.
+//
+// For zoomed out views the grid is also a density pyramid: level l merges
+// 2^l x 2^l cells, and each occupied block is drawn as one dot at the mean
+// position of its dots, weighted by their number. Cells keep their count
+// and position sum up to date as dots move, the blocks are summed from the
+// cells in view.
+class SpatialGrid {
+
+public:
+    SpatialGrid(const glm::vec2& minimum, const glm::vec2& maximum, size_t cellsPerSide = 256);
+
+    size_t GetSize();
+    size_t GetMoves();
+    glm::vec2 GetCellSize();
+
+    // make the grid hold positions[0, numInstances), only dots that moved to
+    // another cell are touched; instances from numInstances on are dropped
+    void Sync(const glm::vec2* positions, size_t numInstances);
+    void Update(uint32_t instance, const glm::vec2& position);
+
+    // [minimum, maximum] holds the whole grid extent; only dots outside the
+    // extent, kept in the border cells, may be out of view
+    bool Covers(const glm::vec2& minimum, const glm::vec2& maximum);
+    // copy the positions inside [minimum, maximum] to out, and their
+    // instances to instances if given, return the count
+    size_t Query(const glm::vec2& minimum, const glm::vec2& maximum, glm::vec2* out,
+                 uint32_t* instances = NULL);
+
+    // coarsest level with blocks no larger than size degrees of latitude,
+    // -1 if the cells themselves are larger
+    int GetLevel(float size);
+    // one position and weight per occupied block of the level overlapping
+    // [minimum, maximum], return the count
+    size_t QueryDensity(const glm::vec2& minimum, const glm::vec2& maximum, int level,
+                        glm::vec2* positions, float* weights);
+
+    // lon/lat rectangle where the z = 0 plane is seen through projection * view,
+    // widened by margin world units; false (and left alone) if the view
+    // reaches the horizon
+    static bool ViewBounds(const glm::mat4& projection, const glm::mat4& view, float xScale, float margin,
+                           glm::vec2& minimum, glm::vec2& maximum);
+
+private:
+    struct Sum {
+        double x;
+        double y;
+    };
+
+    struct Location {
+        glm::vec2 position;
+        uint32_t cell;
+        uint32_t index;     // in the cell
+    };
+
+    size_t CellX(float x);
+    size_t CellY(float y);
+    void Insert(uint32_t instance, const glm::vec2& position);
+    void Remove(uint32_t instance);
+
+    glm::vec2 m_Minimum;
+    glm::vec2 m_CellSize;
+    size_t m_CellsPerSide;
+    std::vector<std::vector<uint32_t> > m_Cells; // instances
+    std::vector<Sum> m_Sums;           // of the positions in each cell
+    std::vector<Location> m_Locations; // by instance
+    size_t m_Moves;                     // dots that changed cell
+};
+
+#endif //TIMELAPSEDOTMAP_GRID_H
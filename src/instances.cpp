@@ -0,0 +1,108 @@
+
+#include <spdlog/spdlog.h>
+
+#include "instances.h"
+
+// 1 second, the GPU is in trouble if a region is still in use after that
+static const GLuint64 FENCE_TIMEOUT_NS = 1000000000;
+
+InstanceBuffer::InstanceBuffer(size_t regionSize, size_t numRegions) :
+        m_RegionSize(regionSize),
+        m_NumRegions(numRegions),
+        m_Region(numRegions - 1),
+        m_Persistent(false),
+        m_Keep(false),
+        m_Mapped(NULL),
+        m_Fences(numRegions, (GLsync)NULL)
+{
+    glGenBuffers(1, &m_Buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, m_Buffer);
+
+#ifdef GL_VERSION_4_4
+    if (GLAD_GL_VERSION_4_4 || GLAD_GL_ARB_buffer_storage) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_ARRAY_BUFFER, m_RegionSize * m_NumRegions, NULL, flags);
+        m_Mapped = (char*)glMapBufferRange(GL_ARRAY_BUFFER, 0, m_RegionSize * m_NumRegions, flags);
+        m_Persistent = m_Mapped != NULL;
+    }
+#endif
+    if (!m_Persistent) {
+        glBufferData(GL_ARRAY_BUFFER, m_RegionSize * m_NumRegions, NULL, GL_STREAM_DRAW);
+    }
+    spdlog::info("Instance buffer: {} x {} bytes, {} mapping", m_NumRegions, m_RegionSize,
+                 m_Persistent ? "persistent" : "per-frame");
+}
+
+InstanceBuffer::~InstanceBuffer() {
+    for (size_t i = 0; i < m_Fences.size(); i++) {
+        if (m_Fences[i]) {
+            glDeleteSync(m_Fences[i]);
+        }
+    }
+    if (m_Persistent) {
+        glBindBuffer(GL_ARRAY_BUFFER, m_Buffer);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+    }
+    glDeleteBuffers(1, &m_Buffer);
+}
+
+GLuint InstanceBuffer::GetBuffer() {
+    return m_Buffer;
+}
+
+bool InstanceBuffer::IsPersistent() {
+    return m_Persistent;
+}
+
+size_t InstanceBuffer::GetRegion() {
+    return m_Region;
+}
+
+size_t InstanceBuffer::GetNumRegions() {
+    return m_NumRegions;
+}
+
+void* InstanceBuffer::Map(bool keep) {
+    m_Region = (m_Region + 1) % m_NumRegions;
+
+    GLsync& fence = m_Fences[m_Region];
+    if (fence) {
+        GLenum result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT_NS);
+        if (result == GL_TIMEOUT_EXPIRED || result == GL_WAIT_FAILED) {
+            spdlog::warn("Instance buffer region {} is still in use", m_Region);
+        }
+        glDeleteSync(fence);
+        fence = NULL;
+    }
+
+    size_t offset = m_Region * m_RegionSize;
+    if (m_Persistent) {
+        return m_Mapped + offset;
+    }
+    // the fence already guarantees the GPU is done with this region
+    m_Keep = keep;
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT;
+    flags |= keep ? GL_MAP_FLUSH_EXPLICIT_BIT : GL_MAP_INVALIDATE_RANGE_BIT;
+    glBindBuffer(GL_ARRAY_BUFFER, m_Buffer);
+    return glMapBufferRange(GL_ARRAY_BUFFER, offset, m_RegionSize, flags);
+}
+
+void InstanceBuffer::Flush(size_t offset, size_t size) {
+    // coherent and invalidated mappings need no flush
+    if (!m_Persistent && m_Keep) {
+        glBindBuffer(GL_ARRAY_BUFFER, m_Buffer);
+        glFlushMappedBufferRange(GL_ARRAY_BUFFER, offset, size);
+    }
+}
+
+size_t InstanceBuffer::Unmap() {
+    glBindBuffer(GL_ARRAY_BUFFER, m_Buffer);
+    if (!m_Persistent) {
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+    }
+    return m_Region * m_RegionSize;
+}
+
+void InstanceBuffer::Fence() {
+    m_Fences[m_Region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
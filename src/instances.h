@@ -0,0 +1,48 @@
+
+#ifndef TIMELAPSEDOTMAP_INSTANCES_H
+#define TIMELAPSEDOTMAP_INSTANCES_H
+
+#include <vector>
+
+#include <glad/glad.h>
+
+// Multi-buffered instance array. With GL 4.4 (or ARB_buffer_storage) the
+// whole buffer is mapped once, persistently; otherwise each region is
+// mapped unsynchronized. Either way the CPU writes one region while the GPU
+// may still read the others, and fences keep it from overwriting a region
+// before the draw that reads it has finished.
+class InstanceBuffer {
+
+public:
+    explicit InstanceBuffer(size_t regionSize, size_t numRegions = 3);
+    ~InstanceBuffer();
+
+    GLuint GetBuffer();
+    bool IsPersistent();
+
+    size_t GetRegion();
+    size_t GetNumRegions();
+
+    // wait for the next region to be free and return it for writing. With
+    // keep the region holds what was last written to it, and only the parts
+    // passed to Flush() are updated; otherwise it is all rewritten.
+    void* Map(bool keep = false);
+    // the bytes [offset, offset + size) of the mapped region were written
+    void Flush(size_t offset, size_t size);
+    // finish writing, return the byte offset of the region to draw from
+    size_t Unmap();
+    // call after the draw calls reading the region have been issued
+    void Fence();
+
+private:
+    GLuint m_Buffer;
+    size_t m_RegionSize;
+    size_t m_NumRegions;
+    size_t m_Region;
+    bool m_Persistent;
+    bool m_Keep;
+    char* m_Mapped;
+    std::vector<GLsync> m_Fences;
+};
+
+#endif //TIMELAPSEDOTMAP_INSTANCES_H
@@ -1,25 +1,35 @@
 
+#include <algorithm>
+
 #include <spdlog/spdlog.h>
 
 #include "queue.h"
 #include "interpolator.h"
+#include "profile.h"
 
+// dots per work item, a multiple of a cache line (8 dots) so chunks never share one
+static const size_t CHUNK_DOTS = 4096;
 
-// do not interpolate if jump is more than this
-static constexpr const float MAX_DISTANCE_DEGREE = 0.01f;
-
-Interpolator::Interpolator(FrameQueue& queue) :
+Interpolator::Interpolator(FrameQueue& queue, const InterpolationKernels& kernels, WorkerPool* pool) :
         m_Q(queue),
-        m_FrameSize(queue.GetFrameSize())
+        m_FrameSize(queue.GetFrameSize()),
+        m_Kernels(kernels),
+        m_Pool(pool),
+        m_Frames(queue.Size()),
+        m_Workers(pool ? pool->Size() : 1)
 {
+    for (size_t i = 0; i < m_Workers.size(); i++) {
+        m_Workers[i].changed.resize(CHUNK_DOTS);
+    }
+    spdlog::info("Interpolating with {} kernels on {} threads", m_Kernels.name, m_Workers.size());
 }
 
 uint Interpolator::FindChangeIndex(uint pointIndex) {
-    glm::vec2 point = m_Q.PreviousFrame()[pointIndex];
+    glm::vec2 point = m_Frames[m_Q.Size() - 2][pointIndex];
 
     // find earliest frame index where the point's value was the same
     for (int i = m_Q.Size() - 2; i > 0; i--) {
-        glm::vec2* frame = m_Q.m_Frames[i];
+        glm::vec2* frame = m_Frames[i];
         if (frame[pointIndex].x != point.x ||
             frame[pointIndex].y != point.y){
             return i + 1;
@@ -28,46 +38,92 @@ uint Interpolator::FindChangeIndex(uint pointIndex) {
     return 0;
 }
 
-void Interpolator::Interpolate() {
+void Interpolator::InterpolateRange(size_t begin, size_t end, Worker& worker) {
+    glm::vec2* last = m_Frames[m_Q.Size() - 1];
+    glm::vec2* previous = m_Frames[m_Q.Size() - 2];
+
+    // check each point: has it changed since previous?
+    size_t numChanged = m_Kernels.changedDots(last + begin, previous + begin, end - begin,
+                                              worker.changed.data());
+    worker.pointCounter += numChanged;
+
+    // find the range to interpolate over
+    worker.changeIndex.resize(numChanged);
+    worker.start.resize(numChanged);
+    worker.end.resize(numChanged);
+    worker.within.resize(numChanged);
+    for (size_t c = 0; c < numChanged; c++) {
+        uint i = begin + worker.changed[c];
+        uint changeIndex = FindChangeIndex(i);
+        worker.changed[c] = i;
+        worker.changeIndex[c] = changeIndex;
+        worker.start[c] = m_Frames[changeIndex][i];
+        worker.end[c] = last[i];
+
+        uint range = m_Q.Size() - 1 - changeIndex;
+        if (range > worker.maxRange) {worker.maxRange = range;}
+    }
+
+    // do not interpolate if delta is more than ~1km
+    m_Kernels.withinDistance(worker.start.data(), worker.end.data(), numChanged,
+                             MAX_DISTANCE_DEGREE, worker.within.data());
+
+    for (size_t c = 0; c < numChanged; c++) {
+        if (!worker.within[c]) {
+            continue;
+        }
+        uint changeIndex = worker.changeIndex[c];
+
+        // calculate delta per step for interpolation
+        uint range = m_Q.Size() - 1 - changeIndex;
+        glm::vec2 delta = worker.end[c] - worker.start[c];
+        delta /= float(range);
+
+        // interpolate from change
+        size_t steps = m_Q.Size() - 2 - changeIndex;
+        m_Kernels.ramp(&m_Frames[changeIndex + 1], steps, worker.changed[c], delta);
+        worker.stepCounter += steps;
+    }
+}
+
+void Interpolator::Interpolate(size_t numDots) {
+    TLDM_PROFILE_SCOPE("interpolate window");
+    numDots = std::min(numDots, m_FrameSize);
+
+    for (size_t i = 0; i < m_Frames.size(); i++) {
+        m_Frames[i] = m_Q.Frame(i);
+    }
+    for (size_t i = 0; i < m_Workers.size(); i++) {
+        m_Workers[i].pointCounter = 0;
+        m_Workers[i].stepCounter = 0;
+        m_Workers[i].maxRange = 0;
+    }
+
+    // every dot is interpolated independently, so chunks can run on any thread
+    size_t numChunks = (numDots + CHUNK_DOTS - 1) / CHUNK_DOTS;
+    WorkerPool::Task task = [this, numDots](size_t chunk, size_t worker) {
+        TLDM_PROFILE_SCOPE("interpolate chunk");
+        size_t begin = chunk * CHUNK_DOTS;
+        size_t end = std::min(begin + CHUNK_DOTS, numDots);
+        InterpolateRange(begin, end, m_Workers[worker]);
+    };
+    if (m_Pool) {
+        m_Pool->Run(numChunks, task);
+    } else {
+        for (size_t chunk = 0; chunk < numChunks; chunk++) {
+            task(chunk, 0);
+        }
+    }
 
     // collect some stats
     uint pointCounter = 0;
     uint stepCounter = 0;
     uint maxRange = 0;
-
-    // check each point: has it changed since previous?
-    for (uint i = 0; i < m_FrameSize; i++) {
-        if (m_Q.LastFrame()[i].x != m_Q.PreviousFrame()[i].x ||
-            m_Q.LastFrame()[i].y != m_Q.PreviousFrame()[i].y) {
-
-            pointCounter++;
-
-            // find the range to interpolate over
-            uint changeIndex = FindChangeIndex(i);
-            glm::vec2 start = m_Q.m_Frames[changeIndex][i];
-            glm::vec2 end = m_Q.LastFrame()[i];
-
-            // calculate delta per step for interpolation
-            uint range = m_Q.Size() - 1 - changeIndex;
-            if (range > maxRange) {maxRange = range;}
-            glm::vec2 delta = end - start;
-            if ((delta.x * delta.x + delta.y * delta.y) >
-                MAX_DISTANCE_DEGREE * MAX_DISTANCE_DEGREE) {
-                // do not interpolate if delta is more than ~1km
-                continue;
-            }
-
-            // delta.x = (end.x - start.x) / float(range);
-            // delta.y = (end.y - start.y) / float(range);
-            delta /= float(range);
-
-            // interpolate from change
-            for (uint j = changeIndex + 1, n = 1; j < m_Q.Size() - 1; j++, n++) {
-                m_Q.m_Frames[j][i] += (delta * float(n));
-                stepCounter++;
-            }
-        }
+    for (size_t i = 0; i < m_Workers.size(); i++) {
+        pointCounter += m_Workers[i].pointCounter;
+        stepCounter += m_Workers[i].stepCounter;
+        maxRange = std::max(maxRange, m_Workers[i].maxRange);
     }
     spdlog::debug("Interpolated {} points in {} steps, avg range {:.4f} max range {}",
             pointCounter, stepCounter, float(stepCounter)/float(pointCounter), maxRange);
-}
\ No newline at end of file
+}
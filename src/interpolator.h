@@ -3,24 +3,50 @@
 #define TIMELAPSEDOTMAP_INTERPOLATOR_H
 
 #include <cstdlib>
+#include <vector>
 
 #include <glm/gtc/type_ptr.hpp>
 
 #include "frame.h"
+#include "kernels.h"
+#include "pool.h"
+#include "queue.h"
 #include "update.h"
 
+// do not interpolate if jump is more than this
+static constexpr const float MAX_DISTANCE_DEGREE = 0.01f;
+
 class Interpolator {
 
 public:
-    Interpolator(FrameQueue& frameQueue);
+    Interpolator(FrameQueue& frameQueue, const InterpolationKernels& kernels = DetectKernels(),
+                 WorkerPool* pool = NULL);
 
-    void Interpolate();
+    // interpolate the first numDots dots of the window
+    void Interpolate(size_t numDots = SIZE_MAX);
 
 private:
+    // per worker scratch and stats, reused every frame
+    struct Worker {
+        std::vector<uint32_t> changed;
+        std::vector<uint32_t> changeIndex;
+        std::vector<glm::vec2> start;
+        std::vector<glm::vec2> end;
+        std::vector<uint8_t> within;
+        uint pointCounter;
+        uint stepCounter;
+        uint maxRange;
+    };
 
     uint FindChangeIndex(uint pointIndex);
+    void InterpolateRange(size_t begin, size_t end, Worker& worker);
 
     FrameQueue& m_Q;
     size_t m_FrameSize;
+    const InterpolationKernels& m_Kernels;
+    WorkerPool* m_Pool;
+
+    std::vector<glm::vec2*> m_Frames;
+    std::vector<Worker> m_Workers;
 };
 #endif //TIMELAPSEDOTMAP_INTERPOLATOR_H
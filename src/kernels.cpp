@@ -0,0 +1,421 @@
+
+#include "kernels.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TLDM_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+//
+// scalar reference, also used for the tails of the vector loops
+//
+
+static size_t ChangedDotsRange(const glm::vec2* last, const glm::vec2* previous,
+                               size_t begin, size_t end, uint32_t* changed) {
+    size_t count = 0;
+    for (size_t i = begin; i < end; i++) {
+        if (last[i].x != previous[i].x ||
+            last[i].y != previous[i].y) {
+            changed[count++] = i;
+        }
+    }
+    return count;
+}
+
+static void WithinDistanceRange(const glm::vec2* start, const glm::vec2* end, size_t begin, size_t count,
+                                float maxDistance, uint8_t* within) {
+    for (size_t i = begin; i < count; i++) {
+        glm::vec2 delta = end[i] - start[i];
+        within[i] = !((delta.x * delta.x + delta.y * delta.y) > maxDistance * maxDistance);
+    }
+}
+
+static void RampRange(glm::vec2* const* frames, size_t begin, size_t numFrames, uint32_t dot, glm::vec2 delta) {
+    for (size_t k = begin; k < numFrames; k++) {
+        frames[k][dot] += (delta * float(k + 1));
+    }
+}
+
+static size_t ChangedDotsScalar(const glm::vec2* last, const glm::vec2* previous, size_t numDots,
+                                uint32_t* changed) {
+    return ChangedDotsRange(last, previous, 0, numDots, changed);
+}
+
+static void WithinDistanceScalar(const glm::vec2* start, const glm::vec2* end, size_t count,
+                                 float maxDistance, uint8_t* within) {
+    WithinDistanceRange(start, end, 0, count, maxDistance, within);
+}
+
+static void RampScalar(glm::vec2* const* frames, size_t numFrames, uint32_t dot, glm::vec2 delta) {
+    RampRange(frames, 0, numFrames, dot, delta);
+}
+
+static void PackRange(const glm::vec2* positions, size_t begin, size_t count, glm::vec2 minimum,
+                      glm::vec2 scale, PackedPosition* packed) {
+    for (size_t i = begin; i < count; i++) {
+        glm::vec2 step = (positions[i] - minimum) * scale;
+        // half a step of margin for rounding; written so that NaN is outside, like the vector compares
+        if (step.x > -0.5f && step.x < PACKED_STEPS + 0.5f && step.y > -0.5f && step.y < PACKED_STEPS + 0.5f) {
+            packed[i].x = uint16_t(step.x + 0.5f);
+            packed[i].y = uint16_t(step.y + 0.5f);
+        } else {
+            packed[i].x = packed[i].y = PACKED_OUTSIDE;
+        }
+    }
+}
+
+static void PackScalar(const glm::vec2* positions, size_t count, glm::vec2 minimum, glm::vec2 scale,
+                       PackedPosition* packed) {
+    PackRange(positions, 0, count, minimum, scale, packed);
+}
+
+static void SwizzleRange(const float* latLon, size_t begin, size_t count, glm::vec2* positions) {
+    for (size_t i = begin; i < count; i++) {
+        float lat = latLon[2 * i];
+        float lon = latLon[2 * i + 1];
+        positions[i] = glm::vec2(lon, lat);
+    }
+}
+
+static void SwizzleScalar(const float* latLon, size_t count, glm::vec2* positions) {
+    SwizzleRange(latLon, 0, count, positions);
+}
+
+#ifdef TLDM_X86_KERNELS
+
+static bool IsAligned(const void* ptr, size_t alignment) {
+    return ((uintptr_t)ptr & (alignment - 1)) == 0;
+}
+
+//
+// SSE2: two dots (or two frames) per instruction
+//
+
+__attribute__((target("sse2")))
+static size_t ChangedDotsSse2(const glm::vec2* last, const glm::vec2* previous, size_t numDots,
+                              uint32_t* changed) {
+    if (!IsAligned(last, 16) || !IsAligned(previous, 16)) {
+        return ChangedDotsScalar(last, previous, numDots, changed);
+    }
+    const float* a = (const float*)last;
+    const float* b = (const float*)previous;
+    size_t count = 0;
+    size_t i = 0;
+    for (; i + 2 <= numDots; i += 2) {
+        // not-equal is true for NaN, same as the scalar != comparison
+        int mask = _mm_movemask_ps(_mm_cmpneq_ps(_mm_load_ps(a + 2 * i), _mm_load_ps(b + 2 * i)));
+        if (mask) {
+            if (mask & 0x3) { changed[count++] = i; }
+            if (mask & 0xc) { changed[count++] = i + 1; }
+        }
+    }
+    return count + ChangedDotsRange(last, previous, i, numDots, changed + count);
+}
+
+__attribute__((target("sse2")))
+static void WithinDistanceSse2(const glm::vec2* start, const glm::vec2* end, size_t count,
+                               float maxDistance, uint8_t* within) {
+    const float* s = (const float*)start;
+    const float* e = (const float*)end;
+    const __m128 limit = _mm_set1_ps(maxDistance * maxDistance);
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        __m128 delta = _mm_sub_ps(_mm_loadu_ps(e + 2 * i), _mm_loadu_ps(s + 2 * i));
+        __m128 square = _mm_mul_ps(delta, delta);
+        // x*x + y*y in lanes 0 and 2
+        __m128 sum = _mm_add_ps(square, _mm_shuffle_ps(square, square, _MM_SHUFFLE(2, 3, 0, 1)));
+        int far = _mm_movemask_ps(_mm_cmpgt_ps(sum, limit));
+        within[i] = !(far & 0x1);
+        within[i + 1] = !(far & 0x4);
+    }
+    WithinDistanceRange(start, end, i, count, maxDistance, within);
+}
+
+__attribute__((target("sse2")))
+static void RampSse2(glm::vec2* const* frames, size_t numFrames, uint32_t dot, glm::vec2 delta) {
+    const __m128 step = _mm_setr_ps(delta.x, delta.y, delta.x, delta.y);
+    size_t k = 0;
+    for (; k + 2 <= numFrames; k += 2) {
+        __m64* p0 = (__m64*)(frames[k] + dot);
+        __m64* p1 = (__m64*)(frames[k + 1] + dot);
+        __m128 value = _mm_loadh_pi(_mm_loadl_pi(_mm_setzero_ps(), p0), p1);
+        __m128 n = _mm_setr_ps(float(k + 1), float(k + 1), float(k + 2), float(k + 2));
+        value = _mm_add_ps(value, _mm_mul_ps(step, n));
+        _mm_storel_pi(p0, value);
+        _mm_storeh_pi(p1, value);
+    }
+    RampRange(frames, k, numFrames, dot, delta);
+}
+
+// two dots of steps to PackedPosition, as int32 lanes ready for packing
+__attribute__((target("sse2")))
+static __m128i PackSteps(__m128 step) {
+    const __m128 lower = _mm_set1_ps(-0.5f);
+    const __m128 upper = _mm_set1_ps(PACKED_STEPS + 0.5f);
+    __m128 inside = _mm_and_ps(_mm_cmpgt_ps(step, lower), _mm_cmplt_ps(step, upper));
+    // a dot is inside if both of its components are
+    inside = _mm_and_ps(inside, _mm_shuffle_ps(inside, inside, _MM_SHUFFLE(2, 3, 0, 1)));
+    __m128i rounded = _mm_cvttps_epi32(_mm_add_ps(step, _mm_set1_ps(0.5f)));
+    __m128i mask = _mm_castps_si128(inside);
+    return _mm_or_si128(_mm_and_si128(mask, rounded), _mm_andnot_si128(mask, _mm_set1_epi32(PACKED_OUTSIDE)));
+}
+
+// uint32 lanes up to 65535 to uint16: SSE2 only packs with signed saturation
+__attribute__((target("sse2")))
+static __m128i PackUnsigned(__m128i a, __m128i b) {
+    const __m128i bias = _mm_set1_epi32(32768);
+    __m128i packed = _mm_packs_epi32(_mm_sub_epi32(a, bias), _mm_sub_epi32(b, bias));
+    return _mm_xor_si128(packed, _mm_set1_epi16(-32768));
+}
+
+__attribute__((target("sse2")))
+static void PackSse2(const glm::vec2* positions, size_t count, glm::vec2 minimum, glm::vec2 scale,
+                     PackedPosition* packed) {
+    const float* p = (const float*)positions;
+    const __m128 origin = _mm_setr_ps(minimum.x, minimum.y, minimum.x, minimum.y);
+    const __m128 factor = _mm_setr_ps(scale.x, scale.y, scale.x, scale.y);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i low = PackSteps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(p + 2 * i), origin), factor));
+        __m128i high = PackSteps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(p + 2 * i + 4), origin), factor));
+        _mm_storeu_si128((__m128i*)(packed + i), PackUnsigned(low, high));
+    }
+    PackRange(positions, i, count, minimum, scale, packed);
+}
+
+// each block is loaded before it is stored, so in place works too
+__attribute__((target("sse2")))
+static void SwizzleSse2(const float* latLon, size_t count, glm::vec2* positions) {
+    float* p = (float*)positions;
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 low = _mm_loadu_ps(latLon + 2 * i);
+        __m128 high = _mm_loadu_ps(latLon + 2 * i + 4);
+        _mm_storeu_ps(p + 2 * i, _mm_shuffle_ps(low, low, _MM_SHUFFLE(2, 3, 0, 1)));
+        _mm_storeu_ps(p + 2 * i + 4, _mm_shuffle_ps(high, high, _MM_SHUFFLE(2, 3, 0, 1)));
+    }
+    SwizzleRange(latLon, i, count, positions);
+}
+
+//
+// AVX2: four dots (or four frames) per instruction
+//
+
+__attribute__((target("avx2")))
+static size_t ChangedDotsAvx2(const glm::vec2* last, const glm::vec2* previous, size_t numDots,
+                              uint32_t* changed) {
+    if (!IsAligned(last, 32) || !IsAligned(previous, 32)) {
+        return ChangedDotsSse2(last, previous, numDots, changed);
+    }
+    const float* a = (const float*)last;
+    const float* b = (const float*)previous;
+    size_t count = 0;
+    size_t i = 0;
+    for (; i + 8 <= numDots; i += 8) {
+        __m256 ne0 = _mm256_cmp_ps(_mm256_load_ps(a + 2 * i), _mm256_load_ps(b + 2 * i), _CMP_NEQ_UQ);
+        __m256 ne1 = _mm256_cmp_ps(_mm256_load_ps(a + 2 * i + 8), _mm256_load_ps(b + 2 * i + 8), _CMP_NEQ_UQ);
+        int mask = _mm256_movemask_ps(ne0) | (_mm256_movemask_ps(ne1) << 8);
+        // most dots do not change, skip eight of them at once
+        if (mask) {
+            for (int d = 0; d < 8; d++) {
+                if (mask & (0x3 << (2 * d))) {
+                    changed[count++] = i + d;
+                }
+            }
+        }
+    }
+    return count + ChangedDotsRange(last, previous, i, numDots, changed + count);
+}
+
+__attribute__((target("avx2")))
+static void WithinDistanceAvx2(const glm::vec2* start, const glm::vec2* end, size_t count,
+                               float maxDistance, uint8_t* within) {
+    const float* s = (const float*)start;
+    const float* e = (const float*)end;
+    const __m256 limit = _mm256_set1_ps(maxDistance * maxDistance);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256 delta = _mm256_sub_ps(_mm256_loadu_ps(e + 2 * i), _mm256_loadu_ps(s + 2 * i));
+        __m256 square = _mm256_mul_ps(delta, delta);
+        __m256 sum = _mm256_add_ps(square, _mm256_shuffle_ps(square, square, _MM_SHUFFLE(2, 3, 0, 1)));
+        int far = _mm256_movemask_ps(_mm256_cmp_ps(sum, limit, _CMP_GT_OQ));
+        within[i] = !(far & 0x01);
+        within[i + 1] = !(far & 0x04);
+        within[i + 2] = !(far & 0x10);
+        within[i + 3] = !(far & 0x40);
+    }
+    WithinDistanceRange(start, end, i, count, maxDistance, within);
+}
+
+__attribute__((target("avx2")))
+static void RampAvx2(glm::vec2* const* frames, size_t numFrames, uint32_t dot, glm::vec2 delta) {
+    const __m256 step = _mm256_setr_ps(delta.x, delta.y, delta.x, delta.y,
+                                       delta.x, delta.y, delta.x, delta.y);
+    size_t k = 0;
+    for (; k + 4 <= numFrames; k += 4) {
+        __m64* p0 = (__m64*)(frames[k] + dot);
+        __m64* p1 = (__m64*)(frames[k + 1] + dot);
+        __m64* p2 = (__m64*)(frames[k + 2] + dot);
+        __m64* p3 = (__m64*)(frames[k + 3] + dot);
+        __m128 low = _mm_loadh_pi(_mm_loadl_pi(_mm_setzero_ps(), p0), p1);
+        __m128 high = _mm_loadh_pi(_mm_loadl_pi(_mm_setzero_ps(), p2), p3);
+        __m256 value = _mm256_insertf128_ps(_mm256_castps128_ps256(low), high, 1);
+        __m256 n = _mm256_setr_ps(float(k + 1), float(k + 1), float(k + 2), float(k + 2),
+                                  float(k + 3), float(k + 3), float(k + 4), float(k + 4));
+        value = _mm256_add_ps(value, _mm256_mul_ps(step, n));
+        low = _mm256_castps256_ps128(value);
+        high = _mm256_extractf128_ps(value, 1);
+        _mm_storel_pi(p0, low);
+        _mm_storeh_pi(p1, low);
+        _mm_storel_pi(p2, high);
+        _mm_storeh_pi(p3, high);
+    }
+    RampRange(frames, k, numFrames, dot, delta);
+}
+
+__attribute__((target("avx2")))
+static void PackAvx2(const glm::vec2* positions, size_t count, glm::vec2 minimum, glm::vec2 scale,
+                     PackedPosition* packed) {
+    const float* p = (const float*)positions;
+    const __m256 origin = _mm256_setr_ps(minimum.x, minimum.y, minimum.x, minimum.y,
+                                         minimum.x, minimum.y, minimum.x, minimum.y);
+    const __m256 factor = _mm256_setr_ps(scale.x, scale.y, scale.x, scale.y, scale.x, scale.y, scale.x, scale.y);
+    const __m256 lower = _mm256_set1_ps(-0.5f);
+    const __m256 upper = _mm256_set1_ps(PACKED_STEPS + 0.5f);
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256i outside = _mm256_set1_epi32(PACKED_OUTSIDE);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i lanes[2];
+        for (int k = 0; k < 2; k++) {
+            __m256 step = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(p + 2 * i + 8 * k), origin), factor);
+            __m256 inside = _mm256_and_ps(_mm256_cmp_ps(step, lower, _CMP_GT_OQ),
+                                          _mm256_cmp_ps(step, upper, _CMP_LT_OQ));
+            inside = _mm256_and_ps(inside, _mm256_permute_ps(inside, _MM_SHUFFLE(2, 3, 0, 1)));
+            __m256i rounded = _mm256_cvttps_epi32(_mm256_add_ps(step, half));
+            lanes[k] = _mm256_blendv_epi8(outside, rounded, _mm256_castps_si256(inside));
+        }
+        // packus works within 128-bit lanes, put the dots back in order after it
+        __m256i words = _mm256_packus_epi32(lanes[0], lanes[1]);
+        _mm256_storeu_si256((__m256i*)(packed + i), _mm256_permute4x64_epi64(words, _MM_SHUFFLE(3, 1, 2, 0)));
+    }
+    PackSse2(positions + i, count - i, minimum, scale, packed + i);
+}
+
+__attribute__((target("avx2")))
+static void SwizzleAvx2(const float* latLon, size_t count, glm::vec2* positions) {
+    float* p = (float*)positions;
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 low = _mm256_loadu_ps(latLon + 2 * i);
+        __m256 high = _mm256_loadu_ps(latLon + 2 * i + 8);
+        _mm256_storeu_ps(p + 2 * i, _mm256_permute_ps(low, _MM_SHUFFLE(2, 3, 0, 1)));
+        _mm256_storeu_ps(p + 2 * i + 8, _mm256_permute_ps(high, _MM_SHUFFLE(2, 3, 0, 1)));
+    }
+    SwizzleSse2(latLon + 2 * i, count - i, positions + i);
+}
+
+#endif // TLDM_X86_KERNELS
+
+static const InterpolationKernels SCALAR_KERNELS = {
+        "scalar", ChangedDotsScalar, WithinDistanceScalar, RampScalar
+};
+
+#ifdef TLDM_X86_KERNELS
+static const InterpolationKernels SSE2_KERNELS = {
+        "sse2", ChangedDotsSse2, WithinDistanceSse2, RampSse2
+};
+
+static const InterpolationKernels AVX2_KERNELS = {
+        "avx2", ChangedDotsAvx2, WithinDistanceAvx2, RampAvx2
+};
+#endif
+
+static const PackKernels SCALAR_PACK_KERNELS = {"scalar", PackScalar};
+
+#ifdef TLDM_X86_KERNELS
+static const PackKernels SSE2_PACK_KERNELS = {"sse2", PackSse2};
+
+static const PackKernels AVX2_PACK_KERNELS = {"avx2", PackAvx2};
+#endif
+
+static const SwizzleKernels SCALAR_SWIZZLE_KERNELS = {"scalar", SwizzleScalar};
+
+#ifdef TLDM_X86_KERNELS
+static const SwizzleKernels SSE2_SWIZZLE_KERNELS = {"sse2", SwizzleSse2};
+
+static const SwizzleKernels AVX2_SWIZZLE_KERNELS = {"avx2", SwizzleAvx2};
+#endif
+
+const InterpolationKernels& ScalarKernels() {
+    return SCALAR_KERNELS;
+}
+
+const InterpolationKernels& DetectKernels() {
+#ifdef TLDM_X86_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return AVX2_KERNELS;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return SSE2_KERNELS;
+    }
+#endif
+    return SCALAR_KERNELS;
+}
+
+const InterpolationKernels& SelectKernels(const std::string& name) {
+    if (name == "scalar") {
+        return SCALAR_KERNELS;
+    }
+#ifdef TLDM_X86_KERNELS
+    __builtin_cpu_init();
+    if (name == "sse2" && __builtin_cpu_supports("sse2")) {
+        return SSE2_KERNELS;
+    }
+    if (name == "avx2" && __builtin_cpu_supports("avx2")) {
+        return AVX2_KERNELS;
+    }
+#endif
+    return DetectKernels();
+}
+
+const PackKernels& ScalarPackKernels() {
+    return SCALAR_PACK_KERNELS;
+}
+
+const PackKernels& SelectPackKernels(const std::string& name) {
+    if (name == "scalar") {
+        return SCALAR_PACK_KERNELS;
+    }
+#ifdef TLDM_X86_KERNELS
+    __builtin_cpu_init();
+    if (name != "sse2" && __builtin_cpu_supports("avx2")) {
+        return AVX2_PACK_KERNELS;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return SSE2_PACK_KERNELS;
+    }
+#endif
+    return SCALAR_PACK_KERNELS;
+}
+
+const SwizzleKernels& ScalarSwizzleKernels() {
+    return SCALAR_SWIZZLE_KERNELS;
+}
+
+const SwizzleKernels& SelectSwizzleKernels(const std::string& name) {
+    if (name == "scalar") {
+        return SCALAR_SWIZZLE_KERNELS;
+    }
+#ifdef TLDM_X86_KERNELS
+    __builtin_cpu_init();
+    if (name != "sse2" && __builtin_cpu_supports("avx2")) {
+        return AVX2_SWIZZLE_KERNELS;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return SSE2_SWIZZLE_KERNELS;
+    }
+#endif
+    return SCALAR_SWIZZLE_KERNELS;
+}
@@ -0,0 +1,76 @@
+
+#ifndef TIMELAPSEDOTMAP_KERNELS_H
+#define TIMELAPSEDOTMAP_KERNELS_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+#include <glm/glm.hpp>
+
+// Hot loops of the Interpolator. Every variant gives bit-identical results
+// to the scalar one, the vector ones just process several dots (or frames)
+// per instruction. Frames must be FRAME_ALIGNMENT aligned.
+struct InterpolationKernels {
+    const char* name;
+
+    // indices of dots where last and previous differ, returns their count
+    size_t (*changedDots)(const glm::vec2* last, const glm::vec2* previous, size_t numDots,
+                          uint32_t* changed);
+
+    // within[i] = 1 if start[i] and end[i] are no more than maxDistance apart
+    void (*withinDistance)(const glm::vec2* start, const glm::vec2* end, size_t count,
+                           float maxDistance, uint8_t* within);
+
+    // frames[k][dot] += delta * (k + 1) for k < numFrames
+    void (*ramp)(glm::vec2* const* frames, size_t numFrames, uint32_t dot, glm::vec2 delta);
+};
+
+const InterpolationKernels& ScalarKernels();
+// best variant supported by this CPU
+const InterpolationKernels& DetectKernels();
+// "auto", "scalar", "sse2" or "avx2"; falls back to DetectKernels() if unsupported
+const InterpolationKernels& SelectKernels(const std::string& name);
+
+// Dot position as a uint16 pair within a fixed region, half the size of a
+// glm::vec2. Each axis of the region is split into PACKED_STEPS steps;
+// dots more than half a step outside it get PACKED_OUTSIDE in both
+// components and are not drawn.
+struct PackedPosition {
+    uint16_t x;
+    uint16_t y;
+};
+
+static const float PACKED_STEPS = 65534.0f;
+static const uint16_t PACKED_OUTSIDE = 65535;
+
+// Quantizes the instance positions for upload. Every variant gives the
+// same result as the scalar one.
+struct PackKernels {
+    const char* name;
+
+    // packed[i] = (positions[i] - minimum) * scale rounded, scale being
+    // PACKED_STEPS / region size
+    void (*pack)(const glm::vec2* positions, size_t count, glm::vec2 minimum, glm::vec2 scale,
+                 PackedPosition* packed);
+};
+
+const PackKernels& ScalarPackKernels();
+// "auto", "scalar", "sse2" or "avx2", like SelectKernels()
+const PackKernels& SelectPackKernels(const std::string& name);
+
+// Snapshots are stored as lat, lon float pairs, frames hold lon, lat.
+// Every variant gives the same result as the scalar one.
+struct SwizzleKernels {
+    const char* name;
+
+    // positions[i] = (latLon[2 * i + 1], latLon[2 * i]); positions may be
+    // latLon itself, to swap in place
+    void (*swizzle)(const float* latLon, size_t count, glm::vec2* positions);
+};
+
+const SwizzleKernels& ScalarSwizzleKernels();
+// "auto", "scalar", "sse2" or "avx2", like SelectKernels()
+const SwizzleKernels& SelectSwizzleKernels(const std::string& name);
+
+#endif //TIMELAPSEDOTMAP_KERNELS_H
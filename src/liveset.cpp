@@ -0,0 +1,112 @@
+
+#include <algorithm>
+
+#include <spdlog/spdlog.h>
+
+#include "liveset.h"
+
+const uint32_t LiveSet::NO_INSTANCE;
+
+// seconds between two timestamps, in either order since playback can rewind
+static uint32_t Distance(uint32_t a, uint32_t b) {
+    return a > b ? a - b : b - a;
+}
+
+LiveSet::LiveSet(size_t frameSize, uint32_t idleSeconds) :
+        m_FrameSize(frameSize),
+        m_Idle(idleSeconds),
+        m_Instances(frameSize, NO_INSTANCE),
+        m_LastSeen(frameSize, 0),
+        m_Positions(frameSize, glm::vec2(0.0f)),
+        m_LastScan(0),
+        m_Expired(0)
+{
+    m_Slots.reserve(frameSize);
+}
+
+size_t LiveSet::GetFrameSize() {
+    return m_FrameSize;
+}
+
+size_t LiveSet::GetActive() {
+    return m_Slots.size();
+}
+
+size_t LiveSet::GetExpired() {
+    return m_Expired;
+}
+
+uint32_t LiveSet::GetSlot(uint32_t instance) {
+    return m_Slots[instance];
+}
+
+size_t LiveSet::Reset(uint32_t timestamp, const glm::vec2* frame, glm::vec2* instances) {
+    m_Slots.clear();
+    for (size_t slot = 0; slot < m_FrameSize; slot++) {
+        m_Positions[slot] = frame[slot];
+        // slots that never had a location are all zero
+        if (frame[slot].x == 0.0f && frame[slot].y == 0.0f) {
+            m_Instances[slot] = NO_INSTANCE;
+            continue;
+        }
+        m_Instances[slot] = m_Slots.size();
+        m_LastSeen[slot] = timestamp;
+        instances[m_Slots.size()] = frame[slot];
+        m_Slots.push_back(slot);
+    }
+    m_LastScan = timestamp;
+    spdlog::debug("{} of {} dots live at {}", m_Slots.size(), m_FrameSize, timestamp);
+    return m_Slots.size();
+}
+
+const update_t* LiveSet::Remap(uint32_t timestamp, const update_t* updates, size_t numUpdates,
+                               InstanceStore& store) {
+    m_Remapped.resize(numUpdates);
+    for (size_t i = 0; i < numUpdates; i++) {
+        uint32_t slot = updates[i].index;
+        glm::vec2 position(updates[i].lon, updates[i].lat);
+        if (m_Instances[slot] == NO_INSTANCE) {
+            // start from the last known position, so the engine moves the
+            // dot from there as if it had never expired
+            bool known = m_Positions[slot].x != 0.0f || m_Positions[slot].y != 0.0f;
+            m_Instances[slot] = m_Slots.size();
+            m_Slots.push_back(slot);
+            store.Activate(m_Instances[slot], known ? m_Positions[slot] : position);
+        }
+        m_LastSeen[slot] = timestamp;
+        m_Positions[slot] = position;
+        m_Remapped[i] = updates[i];
+        m_Remapped[i].index = m_Instances[slot];
+    }
+    return m_Remapped.data();
+}
+
+void LiveSet::Expire(uint32_t timestamp, InstanceStore& store) {
+    // a full scan every sixteenth of the idle time is precise enough
+    if (m_Idle == 0 || Distance(timestamp, m_LastScan) < std::max<uint32_t>(m_Idle / 16, 1)) {
+        return;
+    }
+    m_LastScan = timestamp;
+
+    size_t expired = 0;
+    for (size_t instance = 0; instance < m_Slots.size();) {
+        uint32_t slot = m_Slots[instance];
+        if (Distance(timestamp, m_LastSeen[slot]) <= m_Idle) {
+            instance++;
+            continue;
+        }
+        uint32_t last = m_Slots.size() - 1;
+        if (instance != last) {
+            store.Move(last, instance);
+            m_Slots[instance] = m_Slots[last];
+            m_Instances[m_Slots[instance]] = instance;
+        }
+        m_Slots.pop_back();
+        m_Instances[slot] = NO_INSTANCE;
+        expired++;
+    }
+    m_Expired += expired;
+    if (expired) {
+        spdlog::debug("Expired {} dots at {}, {} live", expired, timestamp, m_Slots.size());
+    }
+}
@@ -0,0 +1,62 @@
+
+#ifndef TIMELAPSEDOTMAP_LIVESET_H
+#define TIMELAPSEDOTMAP_LIVESET_H
+
+#include <cstdlib>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "update.h"
+
+// Per-dot engine state indexed by instance, kept in step with a LiveSet
+class InstanceStore {
+
+public:
+    virtual ~InstanceStore() {}
+
+    // a dot got this instance, showing it at position from now on
+    virtual void Activate(uint32_t instance, const glm::vec2& position) = 0;
+    // the dot at instance 'from' is moved to 'to', the dot at 'to' is gone
+    virtual void Move(uint32_t from, uint32_t to) = 0;
+};
+
+// Dots that reported within the idle time. Live dots are numbered densely
+// from 0 (their instance), so frames only need to hold, interpolate and
+// draw the first GetActive() entries. Expired dots are compacted out by
+// moving the last instance into the hole; a dot that reports again gets a
+// new instance at the end.
+class LiveSet {
+
+public:
+    LiveSet(size_t frameSize, uint32_t idleSeconds); // 0: never expire
+
+    size_t GetFrameSize();
+    size_t GetActive();
+    size_t GetExpired();
+    uint32_t GetSlot(uint32_t instance);
+
+    // every located dot of frame (by slot) is live, written by instance to instances
+    size_t Reset(uint32_t timestamp, const glm::vec2* frame, glm::vec2* instances);
+    // translate a delta from slots to instances, valid until the next call
+    const update_t* Remap(uint32_t timestamp, const update_t* updates, size_t numUpdates,
+                          InstanceStore& store);
+    // drop dots idle for longer than the idle time; when rewinding, dots
+    // whose next report is further away than that
+    void Expire(uint32_t timestamp, InstanceStore& store);
+
+private:
+    static const uint32_t NO_INSTANCE = UINT32_MAX;
+
+    size_t m_FrameSize;
+    uint32_t m_Idle;
+    std::vector<uint32_t> m_Slots;      // by instance
+    std::vector<uint32_t> m_Instances;  // by slot
+    std::vector<uint32_t> m_LastSeen;   // by slot
+    std::vector<glm::vec2> m_Positions; // last known position by slot
+    std::vector<update_t> m_Remapped;
+    uint32_t m_LastScan;
+    size_t m_Expired;
+};
+
+#endif //TIMELAPSEDOTMAP_LIVESET_H
@@ -7,28 +7,39 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include <spdlog/spdlog.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
 
 #include <learnopengl/filesystem.h>
 #include <learnopengl/shader.h>
 #include <learnopengl/model.h>
 
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
 #include <iostream>
+#include <string>
+#include <vector>
 
 #include <INIReader.h>
 
 #include "camera.h"
+#include "clock.h"
 #include "replay.h"
 #include "render.h"
-#include "frame.h"
-#include "queue.h"
-#include "interpolator.h"
+#include "engine.h"
+#include "glsink.h"
+#include "pool.h"
+#include "profile.h"
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void processInput(GLFWwindow *window);
 void mouse_button_callback(GLFWwindow* window, int button, int action, int mods);
-void printHUD(time_t epochTime);
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
+void printHUD(time_t epochTime, Prefetcher& prefetcher, size_t numDots);
+int runHeadless(ReplayEngine& engine, uint64_t maxFrames, const std::string& dumpFilename);
 
 INIReader config;
 ReplayParam replay;
@@ -43,18 +54,55 @@ bool firstMouse = true;
 
 // timing
 float deltaTime = 0.0f;
-float lastFrame = 0.0f;
+float frameRate;
+
+// time slider
+bool sliding = false;
+bool seekPending = false;
+float sliderPosition = 0.0f; // 0: first timestamp, 1: last timestamp
+uint32_t firstTimestamp;
+uint32_t lastTimestamp;
+uint32_t currentTimestamp;
 
 char* iniFilename;
-string dbFilename;
+ReplaySettings replaySettings;
+GlSinkSettings glSettings;
+size_t workerThreads;
+float profileWindow;
+string profileTrace;
 
 INIReader readIni(char *filename) {
     INIReader reader(filename);
 
-    dbFilename = reader.Get("database", "filename", "frames.fb");
+    replaySettings = ReplaySettings(reader);
+    workerThreads = reader.GetInteger("threads", "workers", 0);
+    glSettings.cull = reader.GetBoolean("render", "cull", true);
+    glSettings.cullCells = reader.GetInteger("render", "cull_cells", 256);
+    glSettings.lodZoom = reader.GetReal("render", "lod_z", 15.0f);
+    glSettings.lodCell = reader.GetReal("render", "lod_cell", 1.0f);
+    // the camera limits unless given
+    glSettings.packed = reader.GetBoolean("render", "packed", false);
+    glSettings.packedMinimum = glm::vec2(reader.GetReal("render", "packed_x_min", reader.GetReal("camera", "x_min", -180.0f)),
+                                         reader.GetReal("render", "packed_y_min", reader.GetReal("camera", "y_min", -90.0f)));
+    glSettings.packedMaximum = glm::vec2(reader.GetReal("render", "packed_x_max", reader.GetReal("camera", "x_max", 180.0f)),
+                                         reader.GetReal("render", "packed_y_max", reader.GetReal("camera", "y_max", 90.0f)));
+    glSettings.dirtyThreshold = reader.GetReal("render", "dirty_threshold", 0.25f);
+    // columns by their place among the ones the engine reads
+    const std::vector<std::string>& attributes = replaySettings.attributes;
+    std::string color = reader.Get("attributes", "color", "");
+    std::string filter = reader.Get("attributes", "filter", "");
+    glSettings.colorAttribute = color.empty() ? -1 : std::find(attributes.begin(), attributes.end(), color) - attributes.begin();
+    glSettings.colorRange = glm::vec2(reader.GetReal("attributes", "color_min", 0.0f),
+                                      reader.GetReal("attributes", "color_max", 30.0f));
+    glSettings.filterAttribute = filter.empty() ? -1 : std::find(attributes.begin(), attributes.end(), filter) - attributes.begin();
+    glSettings.filterRange = glm::vec2(reader.GetReal("attributes", "filter_min", -FLT_MAX),
+                                       reader.GetReal("attributes", "filter_max", FLT_MAX));
+    profileWindow = reader.GetReal("profile", "window", 5.0f);
+    profileTrace = reader.Get("profile", "trace", "trace.json");
 
     screenWidth = reader.GetReal("window", "width", 960);
     screenHeight = reader.GetReal("window", "height", 540);
+    frameRate = reader.GetReal("window", "fps", 60);
 
     lastX = screenWidth / 2;
     lastY = screenHeight / 2;
@@ -90,19 +138,45 @@ INIReader readIni(char *filename) {
 
 int main(int argc, char* argv[])
 {
-    if (argc < 2 ){
-        fprintf(stderr, "Usage:   %s <inifile>\n", argv[0]);
+    bool headless = false;
+    uint64_t maxFrames = 0;
+    std::string dumpFilename;
+    iniFilename = NULL;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--headless") {
+            headless = true;
+        } else if (arg == "--frames" && i + 1 < argc) {
+            maxFrames = strtoull(argv[++i], NULL, 10);
+        } else if (arg == "--dump" && i + 1 < argc) {
+            dumpFilename = argv[++i];
+        } else {
+            iniFilename = argv[i];
+        }
+    }
+    if (iniFilename == NULL) {
+        fprintf(stderr, "Usage:   %s [--headless [--frames N] [--dump file|-]] <inifile>\n", argv[0]);
         fprintf(stderr, "Example: %s config.ini\n", argv[0]);
         exit(1);
     }
     spdlog::set_level(spdlog::level::info);
+    if (dumpFilename == "-") {
+        // keep the log out of the frame stream
+        spdlog::set_default_logger(spdlog::stderr_color_mt("stderr"));
+    }
+    TLDM_PROFILE_THREAD("render");
 
-    iniFilename = argv[1];
     config = readIni(iniFilename);
-    FrameProvider frameProvider(dbFilename.c_str());
-    spdlog::info("Creating frame queue...");
-    FrameQueue frameQueue(frameProvider, 120);
-    Interpolator interpolator(frameQueue);
+    WorkerPool workers(workerThreads);
+    // the window keeps replaying, a headless run plays the data once
+    replaySettings.loop = !headless;
+    ReplayEngine engine(replaySettings, workers);
+    firstTimestamp = engine.FirstTimestamp();
+    lastTimestamp = engine.LastTimestamp();
+    if (headless) {
+        return runHeadless(engine, maxFrames, dumpFilename);
+    }
+    Prefetcher& prefetcher = engine.GetPrefetcher();
     spdlog::info("Creating window...");
     
     glfwInit();
@@ -126,6 +200,7 @@ int main(int argc, char* argv[])
     glfwSetCursorPosCallback(window, mouse_callback);
     glfwSetScrollCallback(window, scroll_callback);
     glfwSetMouseButtonCallback(window, mouse_button_callback);
+    glfwSetKeyCallback(window, key_callback);
 
     // tell GLFW to capture our mouse
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
@@ -144,47 +219,50 @@ int main(int argc, char* argv[])
     Shader dotShader("dots.vs", "dots.fs");
     Model dot(FileSystem::getPath("resources/dot/dot.obj")); // FIXME: move resources during build
 
-    // configure instanced array
-    unsigned int buffer;
-    glGenBuffers(1, &buffer);
-    glBindBuffer(GL_ARRAY_BUFFER, buffer);
-    glBufferData(GL_ARRAY_BUFFER, frameQueue.GetFrameSizeBytes(),
-            frameQueue.OldestFrame(), GL_STATIC_DRAW);
-
-    // set transformation matrices as an instance vertex attribute (with divisor 1)
-    for (unsigned int i = 0; i < dot.meshes.size(); i++)
-    {
-        unsigned int VAO = dot.meshes[i].VAO;
-        glBindVertexArray(VAO);
-        // set attribute pointers for vec2
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), nullptr);
+    // dots go straight into triple-buffered instance arrays, so the CPU never waits for the GPU
+    std::vector<GlSink::Mesh> meshes;
+    for (unsigned int i = 0; i < dot.meshes.size(); i++) {
+        GlSink::Mesh mesh = {dot.meshes[i].VAO, GLsizei(dot.meshes[i].indices.size())};
+        meshes.push_back(mesh);
+    }
+    // note: we also made the textures_loaded vector public (instead of private) from the model class.
+    GlSink sink(engine.GetFrameSize(), glSettings, dotShader, meshes, dot.textures_loaded[0].id);
 
-        glVertexAttribDivisor(3, 1);
+    // frames are paced by the scheduler, replay by elapsed time
+    SteadyClock clock;
+    FrameScheduler scheduler(clock, frameRate);
+    PlaybackClock playback(clock, replaySettings.prefetchDepth);
 
-        glBindVertexArray(0);
-    }
-    
     // render loop
     // -----------
     while (!glfwWindowShouldClose(window))
     {
-        static float phase = 0.0f;
-        phase += replay.GetSpeed();
-        while (phase >= 1.0f) {
-            phase -= 1.0f;
-            frameProvider.Next(frameQueue.LastFrame());
+        {
+            TLDM_PROFILE_SCOPE("frame limit");
+            deltaTime = scheduler.Wait();
         }
-        interpolator.Interpolate();
-        void* ptr = glMapBuffer(GL_ARRAY_BUFFER, GL_WRITE_ONLY);
-        frameQueue.Pop((glm::vec2*)ptr);
-        glUnmapBuffer(GL_ARRAY_BUFFER);
-
-        float currentFrame;
-        while ((currentFrame = glfwGetTime()) < lastFrame + (1 / 60.f)) {/* do nothing */}
-        deltaTime = currentFrame - lastFrame;
-        printHUD(frameProvider.CurrentTimestamp());
-        lastFrame = currentFrame;
+        TLDM_PROFILE_SCOPE("frame");
+        if (seekPending) {
+            seekPending = false;
+            float seekStart = glfwGetTime();
+            uint32_t target = firstTimestamp + uint32_t(sliderPosition * (lastTimestamp - firstTimestamp));
+            engine.Seek(target);
+            playback.Reset();
+            spdlog::info("Seek to {} took {:.1f} ms", target, (glfwGetTime() - seekStart) * 1000);
+        }
+        if ((replay.GetSpeed() < 0.0f) != engine.IsReverse()) {
+            if (!engine.SetReverse(replay.GetSpeed() < 0.0f)) {
+                replay.Reverse();
+            }
+            playback.Reset();
+        }
+        // a slow frame applies more deltas at once rather than slowing the replay
+        size_t due = playback.Advance(std::fabs(replay.GetSpeed()));
+        playback.Defer(due - engine.Advance(due, false));
+        currentTimestamp = engine.CurrentTimestamp();
+        printHUD(sliding ? firstTimestamp + uint32_t(sliderPosition * (lastTimestamp - firstTimestamp))
+                         : currentTimestamp,
+                 prefetcher, engine.GetActiveDots());
 
         processInput(window);
 
@@ -196,28 +274,22 @@ int main(int argc, char* argv[])
         glm::mat4 view = camera.GetViewMatrix();
         render.UpdateDotScale(camera.Position.z);
 
-        dotShader.use();
-        dotShader.setMat4("projection", projection);
-        dotShader.setMat4("view", view);
-        dotShader.setFloat("dot_scale", render.GetDotScale());
-        dotShader.setFloat("x_scale", render.GetXScale());
-        
-        // draw dots
-        dotShader.use();
-        dotShader.setInt("texture1", 0);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, dot.textures_loaded[0].id); // note: we also made the textures_loaded vector public (instead of private) from the model class.
-        for (unsigned int i = 0; i < dot.meshes.size(); i++)
-        {
-            glBindVertexArray(dot.meshes[i].VAO);
-            glDrawElementsInstanced(GL_TRIANGLES, dot.meshes[i].indices.size(),
-                    GL_UNSIGNED_INT, nullptr, frameQueue.GetFrameSize());
-            glBindVertexArray(0);
-        }
+        sink.SetView(projection, view, render.GetDotScale(), render.GetXScale(), camera.Position.z);
+        engine.Render(sink);
 
+        TLDM_PROFILE_SCOPE("swap");
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
+    TLDM_PROFILE_REPORT(profileWindow);
+
+    prefetcher.Stop();
+    spdlog::info("Prefetch stalls: {} producer, {} consumer",
+                 prefetcher.GetProducerStalls(), prefetcher.GetConsumerStalls());
+    spdlog::info("Late frames: {}, deltas dropped behind decode: {}",
+                 scheduler.GetLateFrames(), playback.GetDropped());
+    spdlog::info("Instance uploads: {:.1f} of {:.1f} MB, {} frames with just the changes",
+                 sink.GetUploadedBytes() / 1e6, sink.GetFullBytes() / 1e6, sink.GetPartialUploads());
 
     glfwTerminate();
     return 0;
@@ -280,6 +352,12 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos)
     lastX = xpos;
     lastY = ypos;
 
+    if (sliding) {
+        // horizontal movement across the window spans the whole replay
+        sliderPosition += xoffset / screenWidth;
+        sliderPosition = std::min(std::max(sliderPosition, 0.0f), 1.0f);
+        return;
+    }
     camera.ProcessMouseMovement(xoffset, yoffset);
 }
 
@@ -309,18 +387,83 @@ void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
             replay.ChangeSpeed(glfwGetTime() - rightDown);
         }
     }
-    if (button == GLFW_MOUSE_BUTTON_MIDDLE && action == GLFW_PRESS) {
-        // TODO: slider
+    if (button == GLFW_MOUSE_BUTTON_MIDDLE) {
+        if (action == GLFW_PRESS && lastTimestamp > firstTimestamp) {
+            sliding = true;
+            sliderPosition = float(currentTimestamp - firstTimestamp) / float(lastTimestamp - firstTimestamp);
+        }
+        if (action == GLFW_RELEASE && sliding) {
+            sliding = false;
+            seekPending = true;
+        }
     }
 }
 
-void printHUD(time_t epochTime) {
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+    // reports need a build with TLDM_PROFILE
+    if (key == GLFW_KEY_P && action == GLFW_PRESS) {
+        TLDM_PROFILE_REPORT(profileWindow);
+    }
+    if (key == GLFW_KEY_T && action == GLFW_PRESS) {
+        TLDM_PROFILE_TRACE(profileTrace, profileWindow);
+    }
+    // rewind, needs a database or container with reverse deltas
+    if (key == GLFW_KEY_B && action == GLFW_PRESS) {
+        replay.Reverse();
+    }
+}
+
+void printHUD(time_t epochTime, Prefetcher& prefetcher, size_t numDots) {
     char buffer[80];
     strftime (buffer, 80, "%F %T UTC", std::localtime(&epochTime));
-    printf("%s, dot: %.4f speed: %.2f x:%.3f y:%.3f z:%.3f FPS:%3.1f \r",
+    printf("%s, dot: %.4f speed: %.2f x:%.3f y:%.3f z:%.3f FPS:%3.1f queue:%zu/%zu stalls:%lu dots:%zu \r",
            buffer,
            render.GetDotSize(), replay.GetSpeed(),
            camera.Position.x / render.GetXScale(), camera.Position.y, camera.Position.z,
-           1 / deltaTime);
+           1 / deltaTime,
+           prefetcher.GetDepth(), prefetcher.GetCapacity(),
+           (unsigned long)prefetcher.GetConsumerStalls(),
+           numDots);
     fflush(stdout);
-}
\ No newline at end of file
+}
+
+// replay as fast as possible without a window, frames are 1/fps of replay apart
+int runHeadless(ReplayEngine& engine, uint64_t maxFrames, const std::string& dumpFilename) {
+    std::unique_ptr<FileSink> fileSink;
+    NullSink nullSink(engine.GetFrameSize());
+    FrameSink* sink = &nullSink;
+    if (!dumpFilename.empty()) {
+        fileSink.reset(new FileSink(dumpFilename, engine.GetFrameSize()));
+        sink = fileSink.get();
+    }
+    ManualClock clock;
+    PlaybackClock playback(clock, SIZE_MAX);
+    double fps = frameRate > 0.0f ? frameRate : 60.0;
+    if (replay.GetSpeed() < 0.0f) {
+        // a negative speed rewinds from the end
+        engine.Seek(engine.LastTimestamp());
+        if (!engine.SetReverse(true)) {
+            return 1;
+        }
+    }
+    spdlog::info("Replaying headless at {} fps{}", fps,
+                 maxFrames ? " for " + std::to_string(maxFrames) + " frames" : "");
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    uint64_t frames = 0;
+    uint64_t dots = 0;
+    while (!engine.AtEnd() && (maxFrames == 0 || frames < maxFrames)) {
+        clock.Advance(1.0 / fps);
+        engine.Advance(playback.Advance(std::fabs(replay.GetSpeed())), true);
+        dots += engine.Render(*sink);
+        frames++;
+    }
+    if (fileSink) {
+        fileSink->Finish();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    spdlog::info("Replayed {} frames ({:.1f} M dots) in {:.2f} s: {:.1f} fps, {:.1f} M dots/s, {:.1f}x real time",
+                 frames, dots / 1e6, seconds, frames / seconds, dots / seconds / 1e6, frames / seconds / fps);
+    return 0;
+}
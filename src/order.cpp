@@ -0,0 +1,116 @@
+
+#include <algorithm>
+#include <cfloat>
+
+#include <spdlog/spdlog.h>
+
+#include "order.h"
+
+static const uint32_t HILBERT_SIDE = 65536;
+
+static bool EarlierSlot(const update_t& a, const update_t& b) {
+    return a.index < b.index;
+}
+
+SlotOrder::SlotOrder(size_t frameSize) :
+        m_NewSlots(frameSize)
+{
+    Sum zero = {0.0, 0.0, 0};
+    m_Sums.assign(frameSize, zero);
+    for (size_t i = 0; i < frameSize; i++) {
+        m_NewSlots[i] = i;
+    }
+}
+
+void SlotOrder::AddFrame(const glm::vec2* frame, size_t numLocations) {
+    numLocations = std::min(numLocations, m_Sums.size());
+    for (size_t i = 0; i < numLocations; i++) {
+        if (frame[i].x != 0.0f || frame[i].y != 0.0f) {
+            m_Sums[i].x += frame[i].x;
+            m_Sums[i].y += frame[i].y;
+            m_Sums[i].count++;
+        }
+    }
+}
+
+void SlotOrder::AddDelta(const update_t* updates, size_t numUpdates) {
+    for (size_t i = 0; i < numUpdates; i++) {
+        if (updates[i].index < m_Sums.size()) {
+            Sum& sum = m_Sums[updates[i].index];
+            sum.x += updates[i].lon;
+            sum.y += updates[i].lat;
+            sum.count++;
+        }
+    }
+}
+
+uint32_t SlotOrder::HilbertIndex(uint32_t x, uint32_t y) {
+    uint32_t index = 0;
+    for (uint32_t s = HILBERT_SIDE / 2; s > 0; s /= 2) {
+        uint32_t rx = (x & s) > 0;
+        uint32_t ry = (y & s) > 0;
+        index += s * s * ((3 * rx) ^ ry);
+        // rotate the quadrant so the curve continues where it left off
+        if (ry == 0) {
+            if (rx == 1) {
+                x = HILBERT_SIDE - 1 - x;
+                y = HILBERT_SIDE - 1 - y;
+            }
+            std::swap(x, y);
+        }
+    }
+    return index;
+}
+
+const std::vector<uint32_t>& SlotOrder::Build() {
+    glm::vec2 minimum(FLT_MAX), maximum(-FLT_MAX);
+    std::vector<glm::vec2> locations(m_Sums.size());
+    for (size_t i = 0; i < m_Sums.size(); i++) {
+        if (m_Sums[i].count) {
+            locations[i] = glm::vec2(float(m_Sums[i].x / m_Sums[i].count), float(m_Sums[i].y / m_Sums[i].count));
+            minimum = glm::min(minimum, locations[i]);
+            maximum = glm::max(maximum, locations[i]);
+        }
+    }
+    glm::vec2 scale = float(HILBERT_SIDE - 1) / glm::max(maximum - minimum, glm::vec2(1e-6f));
+
+    // (curve index, old slot), never located dots sort last
+    std::vector<std::pair<uint64_t, uint32_t> > keys(m_Sums.size());
+    size_t numLocated = 0;
+    for (size_t i = 0; i < m_Sums.size(); i++) {
+        uint64_t key = UINT64_MAX;
+        if (m_Sums[i].count) {
+            glm::vec2 cell = (locations[i] - minimum) * scale;
+            key = HilbertIndex(uint32_t(cell.x + 0.5f), uint32_t(cell.y + 0.5f));
+            numLocated++;
+        }
+        keys[i] = std::make_pair(key, uint32_t(i));
+    }
+    std::sort(keys.begin(), keys.end());
+    for (size_t i = 0; i < keys.size(); i++) {
+        m_NewSlots[keys[i].second] = i;
+    }
+    spdlog::info("Ordered {} located of {} slots along a Hilbert curve", numLocated, m_Sums.size());
+    return m_NewSlots;
+}
+
+const std::vector<uint32_t>& SlotOrder::GetNewSlots() {
+    return m_NewSlots;
+}
+
+void SlotOrder::ReorderFrame(const glm::vec2* frame, size_t numLocations, glm::vec2* out) {
+    std::fill(out, out + m_NewSlots.size(), glm::vec2(0.0f));
+    numLocations = std::min(numLocations, m_NewSlots.size());
+    for (size_t i = 0; i < numLocations; i++) {
+        out[m_NewSlots[i]] = frame[i];
+    }
+}
+
+void SlotOrder::ReorderDelta(const update_t* updates, size_t numUpdates, std::vector<update_t>& out) {
+    out.resize(numUpdates);
+    for (size_t i = 0; i < numUpdates; i++) {
+        out[i] = updates[i];
+        out[i].index = m_NewSlots[updates[i].index];
+    }
+    std::stable_sort(out.begin(), out.end(), EarlierSlot);
+}
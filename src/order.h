@@ -0,0 +1,52 @@
+
+#ifndef TIMELAPSEDOTMAP_ORDER_H
+#define TIMELAPSEDOTMAP_ORDER_H
+
+#include <cstdlib>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "update.h"
+
+// Renumbers slots along a Hilbert curve through the typical location of
+// each dot, the mean of its reported positions. Slots are otherwise
+// numbered in order of first appearance, which scatters neighbours over
+// the whole frame; along the curve dots close on the map get close slots,
+// so deltas and the dots in view touch fewer cache lines and form longer
+// ranges. Dots that are never located keep their order after the others.
+class SlotOrder {
+
+public:
+    explicit SlotOrder(size_t frameSize);
+
+    // positions of the dots, zero for none, e.g. a snapshot
+    void AddFrame(const glm::vec2* frame, size_t numLocations);
+    void AddDelta(const update_t* updates, size_t numUpdates);
+    // number the slots from the locations added so far, returns the new
+    // slot of every old one
+    const std::vector<uint32_t>& Build();
+    const std::vector<uint32_t>& GetNewSlots();
+
+    // frame by old slot into out by new slot, all frameSize entries of out
+    // are written and dots without a location are zero
+    void ReorderFrame(const glm::vec2* frame, size_t numLocations, glm::vec2* out);
+    // updates with new slots, sorted by slot; updates of the same slot keep
+    // their order, so the last one still wins
+    void ReorderDelta(const update_t* updates, size_t numUpdates, std::vector<update_t>& out);
+
+    // distance along the curve through a 65536 x 65536 grid
+    static uint32_t HilbertIndex(uint32_t x, uint32_t y);
+
+private:
+    struct Sum {
+        double x;
+        double y;
+        uint32_t count;
+    };
+
+    std::vector<Sum> m_Sums;
+    std::vector<uint32_t> m_NewSlots;
+};
+
+#endif //TIMELAPSEDOTMAP_ORDER_H
@@ -0,0 +1,110 @@
+
+#include <spdlog/spdlog.h>
+
+#include "pool.h"
+#include "profile.h"
+
+WorkerPool::WorkerPool(size_t numThreads) :
+        m_Size(numThreads ? numThreads : std::thread::hardware_concurrency()),
+        m_Task(NULL),
+        m_Generation(0),
+        m_Busy(0),
+        m_Quit(false)
+{
+    if (m_Size == 0) {
+        m_Size = 1;
+    }
+    m_Ranges.reset(new Range[m_Size]);
+    for (size_t i = 0; i < m_Size; i++) {
+        m_Ranges[i].next = 0;
+        m_Ranges[i].end = 0;
+    }
+    for (size_t i = 1; i < m_Size; i++) {
+        m_Threads.push_back(std::thread(&WorkerPool::Work, this, i));
+    }
+    spdlog::info("Worker pool has {} threads", m_Size);
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Quit = true;
+    }
+    m_Start.notify_all();
+    for (size_t i = 0; i < m_Threads.size(); i++) {
+        m_Threads[i].join();
+    }
+}
+
+size_t WorkerPool::Size() {
+    return m_Size;
+}
+
+void WorkerPool::Run(size_t numChunks, const Task& task) {
+    if (m_Size == 1 || numChunks < 2) {
+        for (size_t chunk = 0; chunk < numChunks; chunk++) {
+            task(chunk, 0);
+        }
+        return;
+    }
+
+    // contiguous share per worker, stealing evens it out
+    for (size_t i = 0; i < m_Size; i++) {
+        m_Ranges[i].next = numChunks * i / m_Size;
+        m_Ranges[i].end = numChunks * (i + 1) / m_Size;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Task = &task;
+        m_Busy = m_Size - 1;
+        m_Generation++;
+    }
+    m_Start.notify_all();
+
+    Drain(0);
+
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    m_Finish.wait(lock, [this] { return m_Busy == 0; });
+    m_Task = NULL;
+}
+
+void WorkerPool::Work(size_t worker) {
+    TLDM_PROFILE_THREAD("worker " + std::to_string(worker));
+    uint64_t generation = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            m_Start.wait(lock, [this, generation] { return m_Quit || m_Generation != generation; });
+            if (m_Quit) {
+                return;
+            }
+            generation = m_Generation;
+        }
+
+        Drain(worker);
+
+        bool last;
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            last = --m_Busy == 0;
+        }
+        if (last) {
+            m_Finish.notify_one();
+        }
+    }
+}
+
+void WorkerPool::Drain(size_t worker) {
+    const Task& task = *m_Task;
+    // own chunks first, then steal from the others in turn
+    for (size_t i = 0; i < m_Size; i++) {
+        Range& range = m_Ranges[(worker + i) % m_Size];
+        while (true) {
+            size_t chunk = range.next.fetch_add(1, std::memory_order_relaxed);
+            if (chunk >= range.end) {
+                break;
+            }
+            task(chunk, worker);
+        }
+    }
+}
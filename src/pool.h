@@ -0,0 +1,53 @@
+
+#ifndef TIMELAPSEDOTMAP_POOL_H
+#define TIMELAPSEDOTMAP_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent worker threads for data-parallel loops. Run() splits the
+// chunks evenly between the workers up front; a worker that runs out of
+// its own chunks steals single chunks from the others, so uneven work per
+// chunk still keeps every core busy. The calling thread is worker 0.
+class WorkerPool {
+
+public:
+    typedef std::function<void(size_t chunk, size_t worker)> Task;
+
+    explicit WorkerPool(size_t numThreads = 0); // 0: one per core
+    ~WorkerPool();
+
+    size_t Size();
+
+    // run task for every chunk in [0, numChunks), returns when all are done
+    void Run(size_t numChunks, const Task& task);
+
+private:
+    struct Range {
+        std::atomic<size_t> next;
+        size_t end;
+        char padding[64 - sizeof(std::atomic<size_t>) - sizeof(size_t)]; // one cache line each
+    };
+
+    void Work(size_t worker);
+    void Drain(size_t worker);
+
+    size_t m_Size;
+    std::vector<std::thread> m_Threads;
+    std::unique_ptr<Range[]> m_Ranges;
+
+    std::mutex m_Mutex;
+    std::condition_variable m_Start;
+    std::condition_variable m_Finish;
+    const Task* m_Task;
+    uint64_t m_Generation;
+    size_t m_Busy;
+    bool m_Quit;
+};
+
+#endif //TIMELAPSEDOTMAP_POOL_H
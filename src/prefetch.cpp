@@ -0,0 +1,138 @@
+
+#include <chrono>
+
+#include <spdlog/spdlog.h>
+
+#include "prefetch.h"
+#include "profile.h"
+
+// how long the prefetch thread sleeps when the ring is full, or when
+// rewinding has reached the first timestamp
+static const std::chrono::microseconds FULL_WAIT(500);
+
+Prefetcher::Prefetcher(FrameProvider& frameProvider, size_t depth) :
+        m_FrameProvider(frameProvider),
+        m_Ring(depth),
+        m_Running(false),
+        m_ProducerStalls(0),
+        m_ConsumerStalls(0),
+        m_Timestamp(frameProvider.CurrentTimestamp()),
+        m_Position(frameProvider.GetPosition()),
+        m_Reverse(false)
+{
+    spdlog::info("Prefetching up to {} timestamps", m_Ring.Capacity());
+}
+
+Prefetcher::~Prefetcher() {
+    Stop();
+}
+
+void Prefetcher::Start() {
+    if (m_Running) {
+        return;
+    }
+    m_Running = true;
+    m_Thread = std::thread(&Prefetcher::Run, this);
+}
+
+void Prefetcher::Stop() {
+    m_Running = false;
+    if (m_Thread.joinable()) {
+        m_Thread.join();
+    }
+}
+
+uint32_t Prefetcher::Seek(uint32_t timestamp, glm::vec2* frame, AttributeColumns* columns) {
+    bool running = m_Running;
+    Stop();
+    m_Ring.Clear();
+    m_Timestamp = m_FrameProvider.Seek(timestamp, frame, columns);
+    m_Position = m_FrameProvider.GetPosition();
+    if (running) {
+        Start();
+    }
+    return m_Timestamp;
+}
+
+void Prefetcher::SetReverse(bool reverse) {
+    if (reverse == m_Reverse) {
+        return;
+    }
+    bool running = m_Running;
+    Stop();
+    m_Ring.Clear();
+    // continue from what the render thread has, not from how far decode got
+    m_FrameProvider.SetPosition(m_Position);
+    m_Reverse = reverse;
+    if (running) {
+        Start();
+    }
+}
+
+bool Prefetcher::IsReverse() {
+    return m_Reverse;
+}
+
+void Prefetcher::Run() {
+    TLDM_PROFILE_THREAD("prefetch");
+    // columns are selected before the thread starts
+    bool attributes = m_FrameProvider.GetNumAttributes() > 0;
+    while (m_Running) {
+        DeltaFrame* delta = m_Ring.WriteSlot();
+        if (delta == NULL) {
+            m_ProducerStalls++;
+            std::this_thread::sleep_for(FULL_WAIT);
+            continue;
+        }
+        if (m_Reverse) {
+            if (m_FrameProvider.GetPosition() == 0) {
+                std::this_thread::sleep_for(FULL_WAIT);
+                continue;
+            }
+            delta->timestamp = m_FrameProvider.PrevDelta(delta->updates, attributes ? &delta->attributes : NULL);
+        } else {
+            delta->timestamp = m_FrameProvider.NextDelta(delta->updates, attributes ? &delta->attributes : NULL);
+        }
+        delta->position = m_FrameProvider.GetPosition();
+        m_Ring.Push();
+    }
+}
+
+const DeltaFrame* Prefetcher::Front() {
+    const DeltaFrame* delta = m_Ring.ReadSlot();
+    if (delta == NULL) {
+        m_ConsumerStalls++;
+    }
+    return delta;
+}
+
+void Prefetcher::Pop() {
+    const DeltaFrame* delta = m_Ring.ReadSlot();
+    m_Timestamp = delta->timestamp;
+    m_Position = delta->position;
+    m_Ring.Pop();
+}
+
+uint32_t Prefetcher::CurrentTimestamp() {
+    return m_Timestamp;
+}
+
+size_t Prefetcher::GetPosition() {
+    return m_Position;
+}
+
+size_t Prefetcher::GetDepth() {
+    return m_Ring.Size();
+}
+
+size_t Prefetcher::GetCapacity() {
+    return m_Ring.Capacity();
+}
+
+uint64_t Prefetcher::GetProducerStalls() {
+    return m_ProducerStalls;
+}
+
+uint64_t Prefetcher::GetConsumerStalls() {
+    return m_ConsumerStalls;
+}
@@ -0,0 +1,67 @@
+
+#ifndef TIMELAPSEDOTMAP_PREFETCH_H
+#define TIMELAPSEDOTMAP_PREFETCH_H
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "frame.h"
+#include "spsc.h"
+#include "update.h"
+
+// one decoded timestamp, as produced by the prefetch thread
+struct DeltaFrame {
+    uint32_t timestamp;
+    size_t position; // provider position once applied
+    std::vector<update_t> updates;
+    AttributeDeltas attributes; // of the selected columns, if any
+};
+
+// Decodes deltas on a background thread, up to 'depth' timestamps ahead of
+// the render loop. Once started, the FrameProvider (and its database) is
+// only touched by the prefetch thread; the render thread just applies
+// already decoded updates.
+class Prefetcher {
+
+public:
+    Prefetcher(FrameProvider& frameProvider, size_t depth);
+    ~Prefetcher();
+
+    void Start();
+    void Stop();
+    // discard prefetched deltas, seek the provider and restart from there
+    uint32_t Seek(uint32_t timestamp, glm::vec2* frame, AttributeColumns* columns = NULL);
+    // Decode reverse deltas from the last one popped backwards, or deltas
+    // forwards again. Prefetched deltas of the old direction are dropped.
+    void SetReverse(bool reverse);
+    bool IsReverse();
+
+    // next decoded delta, NULL if none is ready yet
+    const DeltaFrame* Front();
+    // done with the delta returned by Front()
+    void Pop();
+    uint32_t CurrentTimestamp();
+    // provider position after the last delta popped, 0 at the first timestamp
+    size_t GetPosition();
+
+    size_t GetDepth();
+    size_t GetCapacity();
+    uint64_t GetProducerStalls();
+    uint64_t GetConsumerStalls();
+
+private:
+    void Run();
+
+    FrameProvider& m_FrameProvider;
+    SpscRing<DeltaFrame> m_Ring;
+    std::thread m_Thread;
+    std::atomic<bool> m_Running;
+    std::atomic<uint64_t> m_ProducerStalls; // ring was full, decode is ahead
+    uint64_t m_ConsumerStalls;              // ring was empty, render loop had to wait
+    uint32_t m_Timestamp;
+    size_t m_Position;
+    bool m_Reverse; // only changed while the thread is stopped
+};
+
+#endif //TIMELAPSEDOTMAP_PREFETCH_H
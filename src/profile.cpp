@@ -0,0 +1,196 @@
+
+#include "profile.h"
+
+#ifdef TLDM_PROFILE
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+// samples kept per thread, a power of two
+static const size_t RING_SIZE = 1 << 16;
+
+struct ProfileSample {
+    const char* name;
+    uint64_t start;
+    uint64_t end;
+};
+
+// written by its own thread only
+struct ProfileRing {
+    std::string name;
+    size_t id;
+    std::unique_ptr<ProfileSample[]> samples;
+    std::atomic<uint64_t> count;
+};
+
+struct ProfileCopy {
+    const ProfileRing* ring;
+    std::vector<ProfileSample> samples;
+};
+
+// Rings are never freed, so samples of threads that have exited can still
+// be reported; threads are few and long-lived.
+static std::mutex s_Mutex;
+static std::vector<ProfileRing*> s_Rings;
+static thread_local ProfileRing* t_Ring = NULL;
+
+static ProfileRing* GetRing() {
+    if (t_Ring == NULL) {
+        ProfileRing* ring = new ProfileRing();
+        ring->samples.reset(new ProfileSample[RING_SIZE]);
+        ring->count = 0;
+        std::lock_guard<std::mutex> lock(s_Mutex);
+        ring->id = s_Rings.size();
+        ring->name = "thread " + std::to_string(ring->id);
+        s_Rings.push_back(ring);
+        t_Ring = ring;
+    }
+    return t_Ring;
+}
+
+// samples of every thread that ended in the last seconds
+static std::vector<ProfileCopy> CopyRings(double seconds) {
+    uint64_t since = Profiler::Now() - uint64_t(seconds * 1e9);
+    std::vector<ProfileRing*> rings;
+    {
+        std::lock_guard<std::mutex> lock(s_Mutex);
+        rings = s_Rings;
+    }
+    std::vector<ProfileCopy> copies(rings.size());
+    for (size_t r = 0; r < rings.size(); r++) {
+        const ProfileRing& ring = *rings[r];
+        ProfileCopy& copy = copies[r];
+        copy.ring = &ring;
+        uint64_t end = ring.count.load(std::memory_order_acquire);
+        uint64_t begin = end > RING_SIZE ? end - RING_SIZE : 0;
+        copy.samples.reserve(end - begin);
+        for (uint64_t i = begin; i < end; i++) {
+            copy.samples.push_back(ring.samples[i & (RING_SIZE - 1)]);
+        }
+        // The owner kept writing while we copied, drop what it overwrote. It
+        // writes sample 'written' before counting it, so that one's slot may
+        // be half written too.
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t written = ring.count.load(std::memory_order_relaxed) + 1;
+        size_t overwritten = written > begin + RING_SIZE ? written - begin - RING_SIZE : 0;
+        copy.samples.erase(copy.samples.begin(),
+                           copy.samples.begin() + std::min(overwritten, copy.samples.size()));
+        copy.samples.erase(std::remove_if(copy.samples.begin(), copy.samples.end(),
+                                          [since](const ProfileSample& sample) { return sample.end < since; }),
+                           copy.samples.end());
+    }
+    return copies;
+}
+
+static void Escape(FILE* file, const std::string& text) {
+    for (size_t i = 0; i < text.size(); i++) {
+        if (text[i] == '"' || text[i] == '\\') {
+            fputc('\\', file);
+        }
+        fputc(text[i], file);
+    }
+}
+
+uint64_t Profiler::Now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Profiler::Record(const char* name, uint64_t start, uint64_t end) {
+    ProfileRing* ring = GetRing();
+    uint64_t count = ring->count.load(std::memory_order_relaxed);
+    ProfileSample& sample = ring->samples[count & (RING_SIZE - 1)];
+    sample.name = name;
+    sample.start = start;
+    sample.end = end;
+    ring->count.store(count + 1, std::memory_order_release);
+}
+
+void Profiler::SetThreadName(const std::string& name) {
+    ProfileRing* ring = GetRing();
+    std::lock_guard<std::mutex> lock(s_Mutex);
+    ring->name = name;
+}
+
+void Profiler::Report(double seconds) {
+    std::vector<ProfileCopy> copies = CopyRings(seconds);
+    // stages by name, the same stage on several threads is reported together
+    std::map<std::string, std::vector<uint64_t> > durations;
+    for (size_t r = 0; r < copies.size(); r++) {
+        for (size_t i = 0; i < copies[r].samples.size(); i++) {
+            const ProfileSample& sample = copies[r].samples[i];
+            durations[sample.name].push_back(sample.end - sample.start);
+        }
+    }
+    spdlog::info("Stage times over the last {:.1f} s (us):", seconds);
+    spdlog::info("{:<20} {:>8} {:>10} {:>10} {:>10}", "stage", "count", "p50", "p99", "max");
+    for (std::map<std::string, std::vector<uint64_t> >::iterator it = durations.begin();
+         it != durations.end(); ++it) {
+        std::vector<uint64_t>& times = it->second;
+        std::sort(times.begin(), times.end());
+        spdlog::info("{:<20} {:>8} {:>10.1f} {:>10.1f} {:>10.1f}", it->first, times.size(),
+                     times[times.size() / 2] / 1000.0,
+                     times[std::min(times.size() - 1, times.size() * 99 / 100)] / 1000.0,
+                     times.back() / 1000.0);
+    }
+}
+
+bool Profiler::WriteTrace(const std::string& filename, double seconds) {
+    std::vector<ProfileCopy> copies = CopyRings(seconds);
+    FILE* file = fopen(filename.c_str(), "w");
+    if (file == NULL) {
+        spdlog::error("Cannot write trace to {}", filename);
+        return false;
+    }
+    uint64_t origin = UINT64_MAX;
+    size_t numSamples = 0;
+    for (size_t r = 0; r < copies.size(); r++) {
+        for (size_t i = 0; i < copies[r].samples.size(); i++) {
+            origin = std::min(origin, copies[r].samples[i].start);
+        }
+        numSamples += copies[r].samples.size();
+    }
+
+    // Chrome trace event format: complete events with microsecond times
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    for (size_t r = 0; r < copies.size(); r++) {
+        std::string name;
+        {
+            std::lock_guard<std::mutex> lock(s_Mutex);
+            name = copies[r].ring->name;
+        }
+        size_t id = copies[r].ring->id;
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%zu,\"args\":{\"name\":\"",
+                first ? "" : ",\n", id);
+        Escape(file, name);
+        fprintf(file, "\"}}");
+        first = false;
+        for (size_t i = 0; i < copies[r].samples.size(); i++) {
+            const ProfileSample& sample = copies[r].samples[i];
+            fprintf(file, ",\n{\"name\":\"");
+            Escape(file, sample.name);
+            fprintf(file, "\",\"ph\":\"X\",\"pid\":1,\"tid\":%zu,\"ts\":%.3f,\"dur\":%.3f}", id,
+                    (sample.start - origin) / 1000.0, (sample.end - sample.start) / 1000.0);
+        }
+    }
+    fprintf(file, "\n]}\n");
+    bool ok = !ferror(file);
+    ok = fclose(file) == 0 && ok;
+    if (!ok) {
+        spdlog::error("Cannot write trace to {}", filename);
+        return false;
+    }
+    spdlog::info("Wrote {} samples over the last {:.1f} s to {}", numSamples, seconds, filename);
+    return true;
+}
+
+#endif // TLDM_PROFILE
@@ -0,0 +1,73 @@
+
+#ifndef TIMELAPSEDOTMAP_PROFILE_H
+#define TIMELAPSEDOTMAP_PROFILE_H
+
+#include <cstdint>
+#include <string>
+
+// Scoped timers for the stages of a frame. Build with -DTLDM_PROFILE
+// (cmake -DTLDM_PROFILE=ON) to record them; otherwise every macro below
+// expands to nothing and no profiling code is compiled in.
+//
+// Each thread records into its own fixed-size ring, so a timer costs two
+// clock reads and a store with no locks or shared cache lines. Reports
+// copy the rings from another thread and drop samples that were
+// overwritten while being copied, so the newest ~64K samples per thread
+// are always available.
+#ifdef TLDM_PROFILE
+#define TLDM_PROFILE_CONCAT2(a, b) a##b
+#define TLDM_PROFILE_CONCAT(a, b) TLDM_PROFILE_CONCAT2(a, b)
+// time from here to the end of the enclosing block; name must be a literal
+#define TLDM_PROFILE_SCOPE(name) ProfileScope TLDM_PROFILE_CONCAT(profileScope, __LINE__)(name)
+// name of the calling thread in reports and traces
+#define TLDM_PROFILE_THREAD(name) Profiler::SetThreadName(name)
+// log count, p50, p99 and max per stage over the last seconds
+#define TLDM_PROFILE_REPORT(seconds) Profiler::Report(seconds)
+// write the last seconds as a Chrome trace (chrome://tracing, Perfetto)
+#define TLDM_PROFILE_TRACE(filename, seconds) Profiler::WriteTrace(filename, seconds)
+#else
+#define TLDM_PROFILE_SCOPE(name)
+#define TLDM_PROFILE_THREAD(name)
+#define TLDM_PROFILE_REPORT(seconds)
+#define TLDM_PROFILE_TRACE(filename, seconds)
+#endif
+
+#ifdef TLDM_PROFILE
+
+class Profiler {
+
+public:
+    // nanoseconds on a monotonic clock
+    static uint64_t Now();
+
+    static void Record(const char* name, uint64_t start, uint64_t end);
+    static void SetThreadName(const std::string& name);
+
+    static void Report(double seconds);
+    static bool WriteTrace(const std::string& filename, double seconds);
+};
+
+class ProfileScope {
+
+public:
+    explicit ProfileScope(const char* name) :
+            m_Name(name),
+            m_Start(Profiler::Now())
+    {
+    }
+
+    ~ProfileScope() {
+        Profiler::Record(m_Name, m_Start, Profiler::Now());
+    }
+
+private:
+    ProfileScope(const ProfileScope&);
+    ProfileScope& operator=(const ProfileScope&);
+
+    const char* m_Name;
+    uint64_t m_Start;
+};
+
+#endif // TLDM_PROFILE
+
+#endif //TIMELAPSEDOTMAP_PROFILE_H
@@ -4,27 +4,22 @@
 #include <glm/glm.hpp>
 
 #include "frame.h"
+#include "ring.h"
 
-class FrameQueue {
+class FrameQueue : public FrameRing {
 
 public:
     FrameQueue(FrameProvider& frameProvider, size_t frameSize);
     ~FrameQueue();
 
-    size_t Size();
-    size_t GetFrameSize();
-    size_t GetFrameSizeBytes();
+    // copy the oldest frame, or its first numDots entries
+    void Pop(glm::vec2* frame, size_t numDots = SIZE_MAX);
+    // dots of the last popped frame that may differ from the one before it
+    DirtyRanges& GetChanged();
 
-    glm::vec2* OldestFrame();
-    glm::vec2* LastFrame();
-    glm::vec2* PreviousFrame();
-
-    void Pop(glm::vec2* frame);
-
-    std::vector<glm::vec2*> m_Frames;
 private:
     FrameProvider& m_FrameProvider;
-    size_t m_FrameSize;
+    DirtyRanges m_Changed;
 };
 
 #endif //TIMELAPSEDOTMAP_QUEUE_H
@@ -0,0 +1,213 @@
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "raster.h"
+
+const size_t Rasterizer::TILE_SIZE;
+
+// first filter tap of a texel coordinate, which is never below -0.5
+static inline int FloorTexel(float coordinate) {
+    return (int)(coordinate + 1.0f) - 1;
+}
+
+// texel index of a filter tap, clamped to the edge
+static inline size_t ClampTexel(int index, size_t size) {
+    return index <= 0 ? 0 : std::min((size_t)index, size - 1);
+}
+
+static inline uint8_t ToByte(float value) {
+    return (uint8_t)(std::min(std::max(value, 0.0f), 1.0f) * 255.0f + 0.5f);
+}
+
+Rasterizer::Rasterizer(size_t width, size_t height, WorkerPool* pool) :
+        m_Width(width),
+        m_Height(height),
+        m_TilesX((width + TILE_SIZE - 1) / TILE_SIZE),
+        m_TilesY((height + TILE_SIZE - 1) / TILE_SIZE),
+        m_Pool(pool),
+        m_Background(0.1f, 0.1f, 0.1f),
+        m_Bins(m_TilesX * m_TilesY),
+        m_Accumulators(pool ? pool->Size() : 1, std::vector<glm::vec3>(TILE_SIZE * TILE_SIZE)),
+        m_Pixels(width * height * 4, 255)
+{
+    SetRoundSprite(64);
+}
+
+size_t Rasterizer::GetWidth() {
+    return m_Width;
+}
+
+size_t Rasterizer::GetHeight() {
+    return m_Height;
+}
+
+void Rasterizer::SetSprite(const uint8_t* rgba, size_t width, size_t height) {
+    m_Levels.assign(1, Level());
+    m_Levels[0].width = width;
+    m_Levels[0].height = height;
+    m_Levels[0].texels.resize(width * height);
+    for (size_t i = 0; i < width * height; i++) {
+        m_Levels[0].texels[i] = glm::vec4(rgba[4 * i], rgba[4 * i + 1], rgba[4 * i + 2], rgba[4 * i + 3]) / 255.0f;
+    }
+    // box filtered mipmaps, like glGenerateMipmap
+    while (m_Levels.back().width > 1 || m_Levels.back().height > 1) {
+        const Level& previous = m_Levels.back();
+        Level level;
+        level.width = std::max<size_t>(previous.width / 2, 1);
+        level.height = std::max<size_t>(previous.height / 2, 1);
+        level.texels.resize(level.width * level.height);
+        for (size_t y = 0; y < level.height; y++) {
+            for (size_t x = 0; x < level.width; x++) {
+                size_t x0 = std::min(2 * x, previous.width - 1), x1 = std::min(2 * x + 1, previous.width - 1);
+                size_t y0 = std::min(2 * y, previous.height - 1), y1 = std::min(2 * y + 1, previous.height - 1);
+                level.texels[y * level.width + x] =
+                        (previous.texels[y0 * previous.width + x0] + previous.texels[y0 * previous.width + x1] +
+                         previous.texels[y1 * previous.width + x0] + previous.texels[y1 * previous.width + x1]) / 4.0f;
+            }
+        }
+        m_Levels.push_back(level);
+    }
+}
+
+void Rasterizer::SetRoundSprite(size_t size) {
+    std::vector<uint8_t> rgba(size * size * 4, 255);
+    for (size_t y = 0; y < size; y++) {
+        for (size_t x = 0; x < size; x++) {
+            float dx = (x + 0.5f) / size * 2.0f - 1.0f;
+            float dy = (y + 0.5f) / size * 2.0f - 1.0f;
+            float r = std::sqrt(dx * dx + dy * dy);
+            rgba[4 * (y * size + x) + 3] = (uint8_t)(255.0f * std::max(0.0f, std::min(1.0f, (1.0f - r) * 3.0f)));
+        }
+    }
+    SetSprite(rgba.data(), size, size);
+}
+
+void Rasterizer::SetBackground(const glm::vec3& color) {
+    m_Background = color;
+}
+
+void Rasterizer::Render(const glm::vec2* dots, size_t numDots, const glm::mat4& projection, const glm::mat4& view,
+                        float dotScale, float xScale) {
+    // the quad is in the z = 0 plane, so clip = X * col0 + Y * col1 + col3
+    glm::mat4 mvp = projection * view;
+    glm::vec4 col0 = mvp[0];
+    glm::vec4 col1 = mvp[1];
+    glm::vec4 col3 = mvp[3];
+    float half = 0.5f * dotScale;
+
+    m_Rects.resize(numDots);
+    for (size_t t = 0; t < m_Bins.size(); t++) {
+        m_Bins[t].clear();
+    }
+    for (size_t i = 0; i < numDots; i++) {
+        float x = dots[i].x * xScale;
+        float y = dots[i].y;
+        glm::vec4 bottomLeft = col0 * (x - half) + col1 * (y - half) + col3;
+        glm::vec4 topRight = col0 * (x + half) + col1 * (y + half) + col3;
+        if (bottomLeft.w <= 0.0f || topRight.w <= 0.0f) {
+            continue;
+        }
+        Rect& rect = m_Rects[i];
+        rect.x0 = (bottomLeft.x / bottomLeft.w * 0.5f + 0.5f) * m_Width;
+        rect.x1 = (topRight.x / topRight.w * 0.5f + 0.5f) * m_Width;
+        rect.y0 = (0.5f - topRight.y / topRight.w * 0.5f) * m_Height;
+        rect.y1 = (0.5f - bottomLeft.y / bottomLeft.w * 0.5f) * m_Height;
+        // pixel centres covered, like GL rasterization
+        long px0 = std::max<long>(std::lround(std::ceil(rect.x0 - 0.5f)), 0);
+        long px1 = std::min<long>(std::lround(std::ceil(rect.x1 - 0.5f)), m_Width) - 1;
+        long py0 = std::max<long>(std::lround(std::ceil(rect.y0 - 0.5f)), 0);
+        long py1 = std::min<long>(std::lround(std::ceil(rect.y1 - 0.5f)), m_Height) - 1;
+        if (px0 > px1 || py0 > py1) {
+            continue;
+        }
+        for (long ty = py0 / TILE_SIZE; ty <= py1 / (long)TILE_SIZE; ty++) {
+            for (long tx = px0 / TILE_SIZE; tx <= px1 / (long)TILE_SIZE; tx++) {
+                m_Bins[ty * m_TilesX + tx].push_back(i);
+            }
+        }
+    }
+
+    WorkerPool::Task task = [this](size_t tile, size_t worker) {
+        RenderTile(tile, m_Accumulators[worker]);
+    };
+    if (m_Pool) {
+        m_Pool->Run(m_Bins.size(), task);
+    } else {
+        for (size_t tile = 0; tile < m_Bins.size(); tile++) {
+            task(tile, 0);
+        }
+    }
+}
+
+void Rasterizer::RenderTile(size_t tile, std::vector<glm::vec3>& accumulator) {
+    size_t tileX = (tile % m_TilesX) * TILE_SIZE;
+    size_t tileY = (tile / m_TilesX) * TILE_SIZE;
+    size_t width = std::min(TILE_SIZE, m_Width - tileX);
+    size_t height = std::min(TILE_SIZE, m_Height - tileY);
+    const std::vector<uint32_t>& bin = m_Bins[tile];
+    if (bin.empty()) {
+        uint8_t background[4] = {ToByte(m_Background.x), ToByte(m_Background.y), ToByte(m_Background.z), 255};
+        for (size_t y = 0; y < height; y++) {
+            uint8_t* pixel = &m_Pixels[((tileY + y) * m_Width + tileX) * 4];
+            for (size_t x = 0; x < width; x++, pixel += 4) {
+                memcpy(pixel, background, 4);
+            }
+        }
+        return;
+    }
+    std::fill(accumulator.begin(), accumulator.end(), m_Background);
+
+    for (size_t b = 0; b < bin.size(); b++) {
+        const Rect& rect = m_Rects[bin[b]];
+        float rectWidth = rect.x1 - rect.x0;
+        float rectHeight = rect.y1 - rect.y0;
+        // mipmap level with about one texel per pixel
+        float texelsPerPixel = m_Levels[0].width / std::max(rectWidth, 1e-6f);
+        size_t levelIndex = texelsPerPixel > 1.0f ? (size_t)std::log2(texelsPerPixel) : 0;
+        const Level& level = m_Levels[std::min(levelIndex, m_Levels.size() - 1)];
+
+        long px0 = std::max<long>(std::lround(std::ceil(rect.x0 - 0.5f)), tileX);
+        long px1 = std::min<long>(std::lround(std::ceil(rect.x1 - 0.5f)), tileX + width);
+        long py0 = std::max<long>(std::lround(std::ceil(rect.y0 - 0.5f)), tileY);
+        long py1 = std::min<long>(std::lround(std::ceil(rect.y1 - 0.5f)), tileY + height);
+        // bilinear filtering clamped to the edge, like GL_LINEAR with GL_CLAMP_TO_EDGE
+        float texelsX = level.width / rectWidth;
+        float texelsY = level.height / rectHeight;
+        for (long py = py0; py < py1; py++) {
+            // texture row 0 is at the bottom of the quad
+            float ty = (rect.y1 - (py + 0.5f)) * texelsY - 0.5f;
+            int fy = FloorTexel(ty);
+            float ay = ty - fy;
+            const glm::vec4* row0 = &level.texels[ClampTexel(fy, level.height) * level.width];
+            const glm::vec4* row1 = &level.texels[ClampTexel(fy + 1, level.height) * level.width];
+            glm::vec3* row = &accumulator[(py - tileY) * TILE_SIZE];
+            for (long px = px0; px < px1; px++) {
+                float tx = ((px + 0.5f) - rect.x0) * texelsX - 0.5f;
+                int fx = FloorTexel(tx);
+                float ax = tx - fx;
+                size_t x0 = ClampTexel(fx, level.width);
+                size_t x1 = ClampTexel(fx + 1, level.width);
+                glm::vec4 texel = (row0[x0] * (1.0f - ax) + row0[x1] * ax) * (1.0f - ay) +
+                                  (row1[x0] * (1.0f - ax) + row1[x1] * ax) * ay;
+                row[px - tileX] += glm::vec3(texel.x, texel.y, texel.z) * texel.w;
+            }
+        }
+    }
+
+    for (size_t y = 0; y < height; y++) {
+        uint8_t* pixel = &m_Pixels[((tileY + y) * m_Width + tileX) * 4];
+        const glm::vec3* row = &accumulator[y * TILE_SIZE];
+        for (size_t x = 0; x < width; x++) {
+            pixel[0] = ToByte(row[x].x);
+            pixel[1] = ToByte(row[x].y);
+            pixel[2] = ToByte(row[x].z);
+            pixel += 4;
+        }
+    }
+}
+
+const uint8_t* Rasterizer::GetPixels() {
+    return m_Pixels.data();
+}
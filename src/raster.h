@@ -0,0 +1,69 @@
+
+#ifndef TIMELAPSEDOTMAP_RASTER_H
+#define TIMELAPSEDOTMAP_RASTER_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "pool.h"
+
+// CPU version of the dots.vs/dots.fs pass for headless export. Every dot
+// is the textured unit quad of dot.obj scaled by dotScale, placed at its
+// offset and drawn with additive blending (GL_SRC_ALPHA, GL_ONE) over the
+// background. The camera looks straight down, so every quad covers an axis
+// aligned rectangle. Dots are binned into tiles and the tiles are rendered
+// on the worker pool; additive blending makes the result independent of
+// the order.
+class Rasterizer {
+
+public:
+    Rasterizer(size_t width, size_t height, WorkerPool* pool = NULL);
+
+    size_t GetWidth();
+    size_t GetHeight();
+
+    // straight RGBA texture, top row first like stbi_load() returns it
+    void SetSprite(const uint8_t* rgba, size_t width, size_t height);
+    // a soft round dot, when dot.png is not available
+    void SetRoundSprite(size_t size);
+    void SetBackground(const glm::vec3& color);
+
+    // same inputs as the projection, view, dot_scale and x_scale uniforms
+    void Render(const glm::vec2* dots, size_t numDots, const glm::mat4& projection, const glm::mat4& view,
+                float dotScale, float xScale);
+
+    // RGBA, top row first
+    const uint8_t* GetPixels();
+
+private:
+    static const size_t TILE_SIZE = 64;
+
+    struct Level {
+        size_t width;
+        size_t height;
+        std::vector<glm::vec4> texels; // alpha multiplied in at sampling
+    };
+
+    struct Rect {
+        float x0, y0, x1, y1; // pixels, y0 is the top edge
+    };
+
+    void RenderTile(size_t tile, std::vector<glm::vec3>& accumulator);
+
+    size_t m_Width;
+    size_t m_Height;
+    size_t m_TilesX;
+    size_t m_TilesY;
+    WorkerPool* m_Pool;
+    glm::vec3 m_Background;
+    std::vector<Level> m_Levels;     // mipmaps of the sprite
+    std::vector<Rect> m_Rects;
+    std::vector<std::vector<uint32_t> > m_Bins; // rect indices by tile
+    std::vector<std::vector<glm::vec3> > m_Accumulators; // one tile per worker
+    std::vector<uint8_t> m_Pixels;
+};
+
+#endif //TIMELAPSEDOTMAP_RASTER_H
@@ -1,4 +1,6 @@
 
+#include <cmath>
+
 #include "replay.h"
 
 const float SPEED = 1.0f;
@@ -11,13 +13,18 @@ ReplayParam::ReplayParam(float speed, float minSpeed, float maxSpeed) :
 }
 
 void ReplayParam::ChangeSpeed(float increase) {
-    m_Speed *= 1.0f + increase;
-    if (m_Speed > m_MaxSpeed) {
-        m_Speed = m_MaxSpeed;
+    float speed = std::fabs(m_Speed) * (1.0f + increase);
+    if (speed > m_MaxSpeed) {
+        speed = m_MaxSpeed;
     }
-    if (m_Speed < m_MinSpeed) {
-        m_Speed = m_MinSpeed;
+    if (speed < m_MinSpeed) {
+        speed = m_MinSpeed;
     }
+    m_Speed = m_Speed < 0.0f ? -speed : speed;
+}
+
+void ReplayParam::Reverse() {
+    m_Speed = -m_Speed;
 }
 
 float ReplayParam::GetSpeed() {
@@ -2,12 +2,14 @@
 #ifndef TIMELAPSEDOTMAP_REPLAY_H
 #define TIMELAPSEDOTMAP_REPLAY_H
 
+// Replay speed, negative when rewinding. The limits apply to its magnitude.
 class ReplayParam {
 public:
     ReplayParam(float speed = 1.0, float minSpeed = 0.1f, float maxSpeed = 120.0f);
     float GetSpeed();
 
     void ChangeSpeed(float increase);
+    void Reverse();
     void SetDotScale(float dotScale);
 
 private:
@@ -0,0 +1,160 @@
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#include "aligned.h"
+#include "ring.h"
+
+FrameRing::FrameRing(size_t numFrames, size_t frameSize) :
+        m_Touched(numFrames),
+        m_Head(0),
+        m_FrameSize(frameSize),
+        m_FullCopies(0),
+        m_CopiedDots(0),
+        m_Activated(frameSize) {
+
+    assert(numFrames > 1);
+
+    for (size_t i = 0; i < numFrames; i++) {
+        glm::vec2* frame = (glm::vec2*)AlignedAlloc(GetFrameSizeBytes());
+        std::fill(frame, frame + m_FrameSize, glm::vec2(0.0f));
+        m_Frames.push_back(frame);
+    }
+}
+
+FrameRing::~FrameRing() {
+    for (size_t i = 0; i < m_Frames.size(); i++) {
+        AlignedFree(m_Frames[i]);
+    }
+}
+
+size_t FrameRing::Slot(size_t index) {
+    size_t slot = m_Head + index;
+    return slot < m_Frames.size() ? slot : slot - m_Frames.size();
+}
+
+size_t FrameRing::Size() {
+    return m_Frames.size();
+}
+
+size_t FrameRing::GetFrameSize() {
+    return m_FrameSize;
+}
+
+size_t FrameRing::GetFrameSizeBytes() {
+    return m_FrameSize * sizeof(glm::vec2);
+}
+
+glm::vec2* FrameRing::Frame(size_t index) {
+    return m_Frames[Slot(index)];
+}
+
+glm::vec2* FrameRing::OldestFrame() {
+    return m_Frames[m_Head];
+}
+
+glm::vec2* FrameRing::LastFrame() {
+    return Frame(m_Frames.size() - 1);
+}
+
+glm::vec2* FrameRing::PreviousFrame() {
+    return Frame(m_Frames.size() - 2);
+}
+
+void FrameRing::Fill(const glm::vec2* frame) {
+    for (size_t i = 0; i < m_Frames.size(); i++) {
+        memcpy(m_Frames[i], frame, GetFrameSizeBytes());
+        m_Touched[i].clear();
+    }
+    m_FullCopies = 0;
+    m_Activated.MarkAll();
+}
+
+void FrameRing::Apply(const update_t* updates, size_t numUpdates) {
+    glm::vec2* frame = LastFrame();
+    std::vector<uint32_t>& touched = m_Touched[Slot(m_Frames.size() - 1)];
+    for (size_t i = 0; i < numUpdates; i++) {
+        uint32_t index = updates[i].index;
+        frame[index] = glm::vec2(updates[i].lon, updates[i].lat);
+        touched.push_back(index);
+    }
+}
+
+void FrameRing::Invalidate() {
+    // untracked changes are only gone once the frame holding them is evicted
+    m_FullCopies = m_Frames.size();
+}
+
+void FrameRing::Advance() {
+    // the oldest slot becomes the newest
+    size_t last = m_Head;
+    m_Head = Slot(1);
+    m_Touched[last].clear();
+
+    // The recycled slot can only differ from its predecessor where a dot
+    // was updated (or interpolated because of an update) while the other
+    // frames were newest, so copy just those dots if there are few enough.
+    size_t numTouched = 0;
+    for (size_t i = 0; i < m_Touched.size(); i++) {
+        numTouched += m_Touched[i].size();
+    }
+
+    glm::vec2* frame = m_Frames[last];
+    glm::vec2* previous = PreviousFrame();
+    if (m_FullCopies > 0 || numTouched > m_FrameSize / 4) {
+        memcpy(frame, previous, GetFrameSizeBytes());
+        m_CopiedDots = m_FrameSize;
+    } else {
+        for (size_t i = 0; i < m_Touched.size(); i++) {
+            const std::vector<uint32_t>& touched = m_Touched[i];
+            for (size_t j = 0; j < touched.size(); j++) {
+                frame[touched[j]] = previous[touched[j]];
+            }
+        }
+        m_CopiedDots = numTouched;
+    }
+    if (m_FullCopies > 0) {
+        m_FullCopies--;
+    }
+}
+
+void FrameRing::Activate(uint32_t instance, const glm::vec2& position) {
+    // the same value in every frame, nothing for Advance() to copy
+    for (size_t i = 0; i < m_Frames.size(); i++) {
+        m_Frames[i][instance] = position;
+    }
+    m_Activated.Mark(instance);
+}
+
+void FrameRing::Move(uint32_t from, uint32_t to) {
+    for (size_t i = 0; i < m_Frames.size(); i++) {
+        m_Frames[i][to] = m_Frames[i][from];
+    }
+    // 'from' may differ between frames, track 'to' for a full window too
+    m_Touched[Slot(m_Frames.size() - 1)].push_back(to);
+}
+
+size_t FrameRing::GetCopiedDots() {
+    return m_CopiedDots;
+}
+
+void FrameRing::GetOldestChanges(DirtyRanges& changed) {
+    changed.Clear();
+    changed.Merge(m_Activated);
+    m_Activated.Clear();
+    if (m_FullCopies > 0) {
+        changed.MarkAll();
+        return;
+    }
+    // Frames only change where Apply() or Move() touched a dot, or where
+    // the interpolation ramps towards such a dot's new position. The ramp
+    // only writes frames older than the slot holding the touch, so every
+    // dot that changed in the frames still in the window is listed here.
+    for (size_t i = 0; i < m_Touched.size(); i++) {
+        const std::vector<uint32_t>& touched = m_Touched[i];
+        for (size_t j = 0; j < touched.size(); j++) {
+            changed.Mark(touched[j]);
+        }
+    }
+}
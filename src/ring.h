@@ -0,0 +1,66 @@
+
+#ifndef TIMELAPSEDOTMAP_RING_H
+#define TIMELAPSEDOTMAP_RING_H
+
+#include <cstdlib>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "dirty.h"
+#include "liveset.h"
+#include "update.h"
+
+// Circular window of frames, index 0 is the oldest and Size()-1 the newest.
+// Advance() recycles the oldest slot as the newest one in O(1). The new
+// slot is copy-on-write from its predecessor: only the dots that received
+// updates while the window was filled are copied, not the whole frame.
+// Updates to the newest frame must go through Apply() (or be followed by
+// Invalidate()) so they are tracked. Frames are FRAME_ALIGNMENT aligned.
+class FrameRing : public InstanceStore {
+
+public:
+    FrameRing(size_t numFrames, size_t frameSize);
+    ~FrameRing();
+
+    size_t Size();
+    size_t GetFrameSize();
+    size_t GetFrameSizeBytes();
+
+    glm::vec2* Frame(size_t index);
+    glm::vec2* OldestFrame();
+    glm::vec2* LastFrame();
+    glm::vec2* PreviousFrame();
+
+    // set every frame to the same content
+    void Fill(const glm::vec2* frame);
+    // apply updates to the newest frame
+    void Apply(const update_t* updates, size_t numUpdates);
+    // the newest frame was written directly, stop copying just the tracked dots
+    void Invalidate();
+    // drop the oldest frame and start a new one from the newest
+    void Advance();
+
+    // InstanceStore, dots are moved in every frame
+    void Activate(uint32_t instance, const glm::vec2& position);
+    void Move(uint32_t from, uint32_t to);
+
+    size_t GetCopiedDots();
+    // set changed to the dots where the oldest frame may differ from the
+    // frame that was oldest before the last Advance()
+    void GetOldestChanges(DirtyRanges& changed);
+
+private:
+    size_t Slot(size_t index);
+
+    std::vector<glm::vec2*> m_Frames;
+    // dot indices updated while the slot was the newest frame
+    std::vector<std::vector<uint32_t>> m_Touched;
+    size_t m_Head;
+    size_t m_FrameSize;
+    size_t m_FullCopies;
+    size_t m_CopiedDots;
+    DirtyRanges m_Activated; // since the last GetOldestChanges(), in every frame
+};
+
+#endif //TIMELAPSEDOTMAP_RING_H
@@ -0,0 +1,256 @@
+
+#include <algorithm>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <glob.h>
+#endif
+
+#include <spdlog/spdlog.h>
+
+#include "profile.h"
+#include "shards.h"
+
+static bool IsPattern(const std::string& filename) {
+    return filename.find_first_of("*?") != std::string::npos;
+}
+
+// the files matching a wildcard pattern, sorted by name
+static std::vector<std::string> Match(const std::string& pattern) {
+    std::vector<std::string> filenames;
+#ifdef _WIN32
+    size_t slash = pattern.find_last_of("/\\");
+    std::string directory = slash == std::string::npos ? "" : pattern.substr(0, slash + 1);
+    WIN32_FIND_DATAA found;
+    HANDLE find = FindFirstFileA(pattern.c_str(), &found);
+    if (find != INVALID_HANDLE_VALUE) {
+        do {
+            if (!(found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+                filenames.push_back(directory + found.cFileName);
+            }
+        } while (FindNextFileA(find, &found));
+        FindClose(find);
+    }
+#else
+    glob_t matches;
+    if (glob(pattern.c_str(), 0, NULL, &matches) == 0) {
+        filenames.assign(matches.gl_pathv, matches.gl_pathv + matches.gl_pathc);
+    }
+    globfree(&matches);
+#endif
+    std::sort(filenames.begin(), filenames.end());
+    return filenames;
+}
+
+bool ShardedSource::IsSharded(const std::string& filename) {
+    return filename.find(',') != std::string::npos || IsPattern(filename);
+}
+
+std::vector<std::string> ShardedSource::Expand(const std::string& filename) {
+    std::vector<std::string> filenames;
+    size_t begin = 0;
+    while (begin <= filename.size()) {
+        size_t end = std::min(filename.find(',', begin), filename.size());
+        std::string part = filename.substr(begin, end - begin);
+        part.erase(0, part.find_first_not_of(" \t"));
+        part.erase(part.find_last_not_of(" \t") + 1);
+        if (IsPattern(part)) {
+            std::vector<std::string> matches = Match(part);
+            if (matches.empty()) {
+                throw std::runtime_error("no files match " + part);
+            }
+            filenames.insert(filenames.end(), matches.begin(), matches.end());
+        } else if (!part.empty()) {
+            filenames.push_back(part);
+        }
+        begin = end + 1;
+    }
+    return filenames;
+}
+
+ShardedSource::ShardedSource(const std::vector<std::string>& filenames) :
+        m_FrameSize(0),
+        m_Reversible(true),
+        m_Current(SIZE_MAX),
+        m_NextIndex(SIZE_MAX)
+{
+    // each shard is opened just long enough to read its timestamps
+    std::vector<std::vector<uint32_t> > timestamps, snapshots;
+    for (size_t i = 0; i < filenames.size(); i++) {
+        std::unique_ptr<FrameSource> source(FrameSource::Open(filenames[i].c_str()));
+        timestamps.push_back(source->GetTimestamps());
+        snapshots.push_back(source->GetSnapshotTimestamps());
+        if (timestamps.back().empty()) {
+            spdlog::warn("Skipping shard {} without frames", filenames[i]);
+            timestamps.pop_back();
+            snapshots.pop_back();
+            continue;
+        }
+        Shard shard;
+        shard.filename = filenames[i];
+        shard.firstDelta = timestamps.back().front();
+        shard.lastDelta = timestamps.back().back();
+        shard.begin = shard.firstDelta;
+        shard.end = shard.lastDelta;
+        if (!snapshots.back().empty()) {
+            shard.begin = std::min(shard.begin, snapshots.back().front());
+            shard.end = std::max(shard.end, snapshots.back().back());
+        }
+        m_Shards.push_back(shard);
+        m_FrameSize = std::max(m_FrameSize, source->GetFrameSize());
+        m_Reversible = m_Reversible && source->IsReversible();
+        std::vector<std::string> attributes = source->GetAttributes();
+        for (size_t j = 0; j < attributes.size(); j++) {
+            if (std::find(m_Attributes.begin(), m_Attributes.end(), attributes[j]) == m_Attributes.end()) {
+                m_Attributes.push_back(attributes[j]);
+            }
+        }
+    }
+    if (m_Shards.empty()) {
+        throw std::runtime_error("no shards with frames");
+    }
+
+    std::vector<size_t> order(m_Shards.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(),
+              [this](size_t a, size_t b) { return m_Shards[a].begin < m_Shards[b].begin; });
+    std::vector<Shard> shards;
+    for (size_t i = 0; i < order.size(); i++) {
+        const Shard& shard = m_Shards[order[i]];
+        if (!shards.empty() && shard.begin <= shards.back().end) {
+            throw std::runtime_error("shards " + shards.back().filename + " and " + shard.filename +
+                                     " overlap in time");
+        }
+        shards.push_back(shard);
+        // in time order, so the timestamps stay sorted
+        m_Timestamps.insert(m_Timestamps.end(), timestamps[order[i]].begin(), timestamps[order[i]].end());
+        m_SnapshotTimestamps.insert(m_SnapshotTimestamps.end(), snapshots[order[i]].begin(),
+                                    snapshots[order[i]].end());
+    }
+    m_Shards.swap(shards);
+    spdlog::info("Indexed {} shards from {} to {}", m_Shards.size(), m_Shards.front().filename,
+                 m_Shards.back().filename);
+}
+
+ShardedSource::~ShardedSource() {
+    JoinNext();
+}
+
+size_t ShardedSource::GetFrameSize() {
+    return m_FrameSize;
+}
+
+std::vector<uint32_t> ShardedSource::GetTimestamps() {
+    return m_Timestamps;
+}
+
+std::vector<uint32_t> ShardedSource::GetSnapshotTimestamps() {
+    return m_SnapshotTimestamps;
+}
+
+size_t ShardedSource::GetSnapshot(uint32_t timestamp, glm::vec2* frame, size_t numLocations) {
+    return Select(timestamp).GetSnapshot(timestamp, frame, numLocations);
+}
+
+const update_t* ShardedSource::GetDelta(uint32_t timestamp, size_t& numUpdates) {
+    return Select(timestamp).GetDelta(timestamp, numUpdates);
+}
+
+const update_t* ShardedSource::GetReverseDelta(uint32_t timestamp, size_t& numUpdates) {
+    return Select(timestamp).GetReverseDelta(timestamp, numUpdates);
+}
+
+bool ShardedSource::IsReversible() {
+    return m_Reversible;
+}
+
+std::vector<std::string> ShardedSource::GetAttributes() {
+    return m_Attributes;
+}
+
+size_t ShardedSource::GetAttributeSnapshot(const std::string& name, uint32_t timestamp, float* column,
+                                           size_t numValues) {
+    return Select(timestamp).GetAttributeSnapshot(name, timestamp, column, numValues);
+}
+
+const attribute_t* ShardedSource::GetAttributeDelta(const std::string& name, uint32_t timestamp,
+                                                    size_t& numUpdates) {
+    return Select(timestamp).GetAttributeDelta(name, timestamp, numUpdates);
+}
+
+const attribute_t* ShardedSource::GetReverseAttributeDelta(const std::string& name, uint32_t timestamp,
+                                                           size_t& numUpdates) {
+    return Select(timestamp).GetReverseAttributeDelta(name, timestamp, numUpdates);
+}
+
+FrameSource& ShardedSource::Select(uint32_t timestamp) {
+    std::vector<Shard>::iterator shard = std::upper_bound(m_Shards.begin(), m_Shards.end(), timestamp,
+            [](uint32_t t, const Shard& s) { return t < s.begin; });
+    size_t index = shard == m_Shards.begin() ? 0 : shard - m_Shards.begin() - 1;
+    if (index == m_Current) {
+        return *m_Source;
+    }
+
+    TLDM_PROFILE_SCOPE("switch shard");
+    // stepping back into the previous shard is playing in reverse, anything
+    // else (the start, a seek, a loop) is taken as playing forwards
+    bool forward = m_Current == SIZE_MAX || index + 1 != m_Current;
+    JoinNext();
+    // close the old shard first, at most two are open at any time
+    m_Source.reset();
+    m_Current = SIZE_MAX;
+    if (m_NextIndex == index) {
+        m_NextIndex = SIZE_MAX;
+        if (m_NextError) {
+            std::exception_ptr error = m_NextError;
+            m_NextError = NULL;
+            std::rethrow_exception(error);
+        }
+        m_Source = std::move(m_Next);
+        spdlog::debug("Switched to prefetched shard {}", m_Shards[index].filename);
+    } else {
+        spdlog::info("Opening shard {}...", m_Shards[index].filename);
+        m_Source.reset(FrameSource::Open(m_Shards[index].filename.c_str()));
+    }
+    m_Current = index;
+
+    size_t next = forward ? index + 1 : index - 1;
+    if (next != m_NextIndex) {
+        m_Next.reset();
+        m_NextIndex = SIZE_MAX;
+        if (next < m_Shards.size()) {
+            OpenNext(next, forward);
+        }
+    }
+    return *m_Source;
+}
+
+void ShardedSource::OpenNext(size_t index, bool forward) {
+    m_NextError = NULL;
+    m_NextIndex = index;
+    m_Opener = std::thread([this, index, forward]() {
+        try {
+            std::unique_ptr<FrameSource> source(FrameSource::Open(m_Shards[index].filename.c_str()));
+            // read where playback enters the shard, for the file cache
+            size_t numUpdates;
+            if (forward) {
+                source->GetDelta(m_Shards[index].firstDelta, numUpdates);
+            } else {
+                source->GetReverseDelta(m_Shards[index].lastDelta, numUpdates);
+            }
+            m_Next = std::move(source);
+        } catch (...) {
+            m_NextError = std::current_exception();
+        }
+    });
+}
+
+void ShardedSource::JoinNext() {
+    if (m_Opener.joinable()) {
+        m_Opener.join();
+    }
+}
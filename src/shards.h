@@ -0,0 +1,75 @@
+
+#ifndef TIMELAPSEDOTMAP_SHARDS_H
+#define TIMELAPSEDOTMAP_SHARDS_H
+
+#include <exception>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "source.h"
+
+// Frames split by time over several files, e.g. one per day from
+// tldm-convert --shard, read as one source. Only the timestamps of the
+// shards are read up front. A shard's file is opened when a read first
+// needs it and closed when the next one takes over. Meanwhile the shard
+// after it in the direction of playback is opened on a thread of its own
+// and its first delta read, so that crossing over does not stall. Shards
+// may not overlap in time and must share the slot numbering; each should
+// start with a snapshot, for seeking into it.
+class ShardedSource : public FrameSource {
+
+public:
+    explicit ShardedSource(const std::vector<std::string>& filenames);
+    ~ShardedSource();
+
+    // a comma separated list of files and/or wildcard patterns
+    static bool IsSharded(const std::string& filename);
+    // the files of such a list, the matches of each pattern sorted by name
+    static std::vector<std::string> Expand(const std::string& filename);
+
+    size_t GetFrameSize();
+    std::vector<uint32_t> GetTimestamps();
+    std::vector<uint32_t> GetSnapshotTimestamps();
+    size_t GetSnapshot(uint32_t timestamp, glm::vec2* frame, size_t numLocations);
+    const update_t* GetDelta(uint32_t timestamp, size_t& numUpdates);
+    const update_t* GetReverseDelta(uint32_t timestamp, size_t& numUpdates);
+    bool IsReversible();
+    // the columns of any shard, shards without one have no changes in it
+    std::vector<std::string> GetAttributes();
+    size_t GetAttributeSnapshot(const std::string& name, uint32_t timestamp, float* column, size_t numValues);
+    const attribute_t* GetAttributeDelta(const std::string& name, uint32_t timestamp, size_t& numUpdates);
+    const attribute_t* GetReverseAttributeDelta(const std::string& name, uint32_t timestamp, size_t& numUpdates);
+
+private:
+    struct Shard {
+        std::string filename;
+        uint32_t begin;      // earliest timestamp or snapshot
+        uint32_t end;        // latest one
+        uint32_t firstDelta;
+        uint32_t lastDelta;
+    };
+
+    // the open shard holding timestamp
+    FrameSource& Select(uint32_t timestamp);
+    void OpenNext(size_t index, bool forward);
+    void JoinNext();
+
+    std::vector<Shard> m_Shards;
+    size_t m_FrameSize;
+    std::vector<uint32_t> m_Timestamps;
+    std::vector<uint32_t> m_SnapshotTimestamps;
+    bool m_Reversible;
+    std::vector<std::string> m_Attributes;
+
+    size_t m_Current; // SIZE_MAX before the first read
+    std::unique_ptr<FrameSource> m_Source;
+    // the neighbour opened in the background, valid after JoinNext()
+    size_t m_NextIndex;
+    std::unique_ptr<FrameSource> m_Next;
+    std::exception_ptr m_NextError;
+    std::thread m_Opener;
+};
+
+#endif //TIMELAPSEDOTMAP_SHARDS_H
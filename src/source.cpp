@@ -0,0 +1,23 @@
+
+#include <string>
+
+#include "container.h"
+#include "database.h"
+#include "shards.h"
+#include "source.h"
+
+bool FrameSource::IsContainer(const std::string& filename) {
+    static const std::string extension(".tldm");
+    return filename.size() >= extension.size() &&
+           filename.compare(filename.size() - extension.size(), extension.size(), extension) == 0;
+}
+
+FrameSource* FrameSource::Open(const char* filename) {
+    if (ShardedSource::IsSharded(filename)) {
+        return new ShardedSource(ShardedSource::Expand(filename));
+    }
+    if (IsContainer(filename)) {
+        return new ContainerSource(filename);
+    }
+    return new DatabaseSource(filename);
+}
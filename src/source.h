@@ -0,0 +1,69 @@
+
+#ifndef TIMELAPSEDOTMAP_SOURCE_H
+#define TIMELAPSEDOTMAP_SOURCE_H
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "update.h"
+
+// Storage behind a FrameProvider: an SQLite database, a .tldm container or
+// several of either split by time.
+class FrameSource {
+
+public:
+    // a ShardedSource for a list or pattern of files, a ContainerSource for
+    // .tldm files, a DatabaseSource otherwise
+    static FrameSource* Open(const char* filename);
+    static bool IsContainer(const std::string& filename);
+
+    virtual ~FrameSource() {}
+
+    // number of slots, every update index is below it
+    virtual size_t GetFrameSize() = 0;
+    virtual std::vector<uint32_t> GetTimestamps() = 0;
+    virtual std::vector<uint32_t> GetSnapshotTimestamps() = 0;
+
+    // copy the snapshot at timestamp into frame as (lon, lat), returns the locations copied
+    virtual size_t GetSnapshot(uint32_t timestamp, glm::vec2* frame, size_t numLocations) = 0;
+
+    // updates of the delta at timestamp, valid until the next GetDelta() call
+    virtual const update_t* GetDelta(uint32_t timestamp, size_t& numUpdates) = 0;
+
+    // The delta at timestamp undone: the previous position of every located
+    // slot it moves, so that applying it like a delta restores the state
+    // before timestamp. Valid until the next GetReverseDelta() call.
+    virtual const update_t* GetReverseDelta(uint32_t timestamp, size_t& numUpdates) {
+        numUpdates = 0;
+        return NULL;
+    }
+    // written with reverse deltas (tldm-convert/tldm-ingest --reversible)
+    virtual bool IsReversible() { return false; }
+
+    // Names of the attribute columns stored next to the positions (see
+    // tldm-convert --attributes). Each column has its own snapshots and
+    // deltas, so reading one costs nothing for the others. A column has
+    // 0 for slots without a value.
+    virtual std::vector<std::string> GetAttributes() { return std::vector<std::string>(); }
+    // copy the column at the snapshot at timestamp, one value per slot;
+    // returns the values copied
+    virtual size_t GetAttributeSnapshot(const std::string& name, uint32_t timestamp, float* column,
+                                        size_t numValues) { return 0; }
+    // changes of the column at timestamp, and the values they replace; valid
+    // until the next call of either
+    virtual const attribute_t* GetAttributeDelta(const std::string& name, uint32_t timestamp,
+                                                 size_t& numUpdates) {
+        numUpdates = 0;
+        return NULL;
+    }
+    virtual const attribute_t* GetReverseAttributeDelta(const std::string& name, uint32_t timestamp,
+                                                        size_t& numUpdates) {
+        numUpdates = 0;
+        return NULL;
+    }
+};
+
+#endif //TIMELAPSEDOTMAP_SOURCE_H
@@ -0,0 +1,81 @@
+
+#ifndef TIMELAPSEDOTMAP_SPSC_H
+#define TIMELAPSEDOTMAP_SPSC_H
+
+#include <atomic>
+#include <cstdlib>
+#include <vector>
+
+// Bounded lock-free ring for exactly one producer and one consumer thread.
+// Slots are preallocated and reused, so the producer fills a slot in place
+// (WriteSlot/Push) and the consumer reads it in place (ReadSlot/Pop).
+template <typename T>
+class SpscRing {
+
+public:
+    explicit SpscRing(size_t capacity) :
+            m_Slots(RoundUp(capacity)),
+            m_Mask(m_Slots.size() - 1),
+            m_Head(0),
+            m_Tail(0)
+    {
+    }
+
+    // producer: free slot to fill, or NULL if the ring is full
+    T* WriteSlot() {
+        size_t tail = m_Tail.load(std::memory_order_relaxed);
+        if (tail - m_Head.load(std::memory_order_acquire) > m_Mask) {
+            return NULL;
+        }
+        return &m_Slots[tail & m_Mask];
+    }
+
+    // producer: publish the slot returned by WriteSlot()
+    void Push() {
+        m_Tail.store(m_Tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // consumer: oldest published slot, or NULL if the ring is empty
+    T* ReadSlot() {
+        size_t head = m_Head.load(std::memory_order_relaxed);
+        if (head == m_Tail.load(std::memory_order_acquire)) {
+            return NULL;
+        }
+        return &m_Slots[head & m_Mask];
+    }
+
+    // consumer: hand the slot returned by ReadSlot() back to the producer
+    void Pop() {
+        m_Head.store(m_Head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // consumer: drop everything published so far
+    void Clear() {
+        m_Head.store(m_Tail.load(std::memory_order_acquire), std::memory_order_release);
+    }
+
+    size_t Size() const {
+        return m_Tail.load(std::memory_order_acquire) - m_Head.load(std::memory_order_acquire);
+    }
+
+    size_t Capacity() const {
+        return m_Slots.size();
+    }
+
+private:
+    static size_t RoundUp(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        return size;
+    }
+
+    std::vector<T> m_Slots;
+    size_t m_Mask;
+    // keep the indices on separate cache lines, they are written by different threads
+    alignas(64) std::atomic<size_t> m_Head;
+    alignas(64) std::atomic<size_t> m_Tail;
+};
+
+#endif //TIMELAPSEDOTMAP_SPSC_H
@@ -0,0 +1,232 @@
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#include <spdlog/spdlog.h>
+
+#include "interpolator.h"
+#include "tracker.h"
+
+const uint32_t SegmentTracker::NO_WAYPOINT;
+
+SegmentTracker::SegmentTracker(FrameProvider& frameProvider, size_t window) :
+        m_FrameSize(frameProvider.GetFrameSize()),
+        m_Window(window),
+        m_Segments(m_FrameSize),
+        m_Queues(m_FrameSize),
+        m_FreeWaypoint(NO_WAYPOINT),
+        m_Display(m_FrameSize, glm::vec2(0.0f)),
+        m_ActivePosition(m_FrameSize, 0),
+        m_Time(0),
+        m_Pending(m_FrameSize),
+        m_Changed(m_FrameSize)
+{
+    assert(window > 1);
+
+    uint32_t oldestTimestamp = frameProvider.GetTimestamps()[0];
+    frameProvider.GetSnapshot(oldestTimestamp, m_Display.data(), m_FrameSize);
+    Reset(m_Display.data());
+    spdlog::info("Segment tracker has been initialised, {} frames behind", m_Window);
+}
+
+size_t SegmentTracker::GetFrameSize() {
+    return m_FrameSize;
+}
+
+size_t SegmentTracker::GetFrameSizeBytes() {
+    return m_FrameSize * sizeof(glm::vec2);
+}
+
+size_t SegmentTracker::GetWindow() {
+    return m_Window;
+}
+
+size_t SegmentTracker::GetActiveDots() {
+    return m_Active.size();
+}
+
+void SegmentTracker::Reset(const glm::vec2* frame) {
+    m_Time = m_Window;
+    for (size_t i = 0; i < m_FrameSize; i++) {
+        Segment& segment = m_Segments[i];
+        segment.start = segment.end = frame[i];
+        segment.startTime = segment.endTime = 0;
+        segment.jump = false;
+        m_Queues[i].head = m_Queues[i].tail = NO_WAYPOINT;
+        m_Display[i] = frame[i];
+        m_ActivePosition[i] = 0;
+    }
+    m_Active.clear();
+    m_Waypoints.clear();
+    m_FreeWaypoint = NO_WAYPOINT;
+    m_Pending.MarkAll();
+}
+
+glm::vec2 SegmentTracker::Evaluate(const Segment& segment, uint32_t time) {
+    if (time >= segment.endTime) {
+        return segment.end;
+    }
+    if (time <= segment.startTime || segment.jump) {
+        return segment.start;
+    }
+    // same arithmetic as Interpolator: a per-step delta times the step count
+    glm::vec2 delta = (segment.end - segment.start) / float(segment.endTime - segment.startTime);
+    return segment.start + delta * float(time - segment.startTime);
+}
+
+void SegmentTracker::Apply(const update_t* updates, size_t numUpdates) {
+    uint32_t displayTime = m_Time - (m_Window - 1);
+
+    for (size_t i = 0; i < numUpdates; i++) {
+        uint32_t index = updates[i].index;
+        glm::vec2 end(updates[i].lon, updates[i].lat);
+
+        // the latest segment of the dot, queued or playing
+        Queue& queue = m_Queues[index];
+        Segment* last = queue.tail != NO_WAYPOINT ? &m_Waypoints[queue.tail].segment : &m_Segments[index];
+        if (end == last->end) {
+            // not a move, the dot keeps heading for its last position
+            continue;
+        }
+        if (m_ActivePosition[index] && last->endTime == m_Time) {
+            // moved again within the same frame, the last position wins
+            last->end = end;
+        } else {
+            // The new segment starts from the last known position when it
+            // was set, like Interpolator it cannot start before the display
+            // time because that is as far as the window looks back.
+            Segment segment;
+            segment.start = last->end;
+            segment.startTime = std::max(last->endTime, displayTime);
+            segment.end = end;
+            segment.endTime = m_Time;
+            if (m_ActivePosition[index]) {
+                Enqueue(index, segment);
+                last = &m_Waypoints[queue.tail].segment;
+            } else {
+                m_Segments[index] = segment;
+                last = &m_Segments[index];
+                m_Active.push_back(index);
+                m_ActivePosition[index] = m_Active.size();
+            }
+        }
+        glm::vec2 delta = last->end - last->start;
+        last->jump = (delta.x * delta.x + delta.y * delta.y) >
+                     MAX_DISTANCE_DEGREE * MAX_DISTANCE_DEGREE;
+    }
+}
+
+void SegmentTracker::Enqueue(uint32_t index, const Segment& segment) {
+    uint32_t waypoint = m_FreeWaypoint;
+    if (waypoint != NO_WAYPOINT) {
+        m_FreeWaypoint = m_Waypoints[waypoint].next;
+    } else {
+        waypoint = m_Waypoints.size();
+        m_Waypoints.push_back(Waypoint());
+    }
+    m_Waypoints[waypoint].segment = segment;
+    m_Waypoints[waypoint].next = NO_WAYPOINT;
+
+    Queue& queue = m_Queues[index];
+    if (queue.tail != NO_WAYPOINT) {
+        m_Waypoints[queue.tail].next = waypoint;
+    } else {
+        queue.head = waypoint;
+    }
+    queue.tail = waypoint;
+}
+
+bool SegmentTracker::Dequeue(uint32_t index) {
+    Queue& queue = m_Queues[index];
+    uint32_t waypoint = queue.head;
+    if (waypoint == NO_WAYPOINT) {
+        return false;
+    }
+    m_Segments[index] = m_Waypoints[waypoint].segment;
+    queue.head = m_Waypoints[waypoint].next;
+    if (queue.head == NO_WAYPOINT) {
+        queue.tail = NO_WAYPOINT;
+    }
+    m_Waypoints[waypoint].next = m_FreeWaypoint;
+    m_FreeWaypoint = waypoint;
+    return true;
+}
+
+void SegmentTracker::ClearQueue(uint32_t index) {
+    while (Dequeue(index)) {}
+}
+
+void SegmentTracker::Step() {
+    m_Time++;
+    uint32_t displayTime = m_Time - (m_Window - 1);
+
+    // only dots with an unfinished segment can change on display
+    for (size_t i = 0; i < m_Active.size();) {
+        uint32_t index = m_Active[i];
+        const Segment& segment = m_Segments[index];
+        // move on to the next reported position once this one is reached
+        while (displayTime >= segment.endTime && Dequeue(index)) {}
+        m_Display[index] = Evaluate(segment, displayTime);
+        m_Pending.Mark(index);
+        if (displayTime >= segment.endTime) {
+            Deactivate(index);
+        } else {
+            i++;
+        }
+    }
+}
+
+const glm::vec2* SegmentTracker::DisplayFrame() {
+    return m_Display.data();
+}
+
+void SegmentTracker::Deactivate(uint32_t index) {
+    uint32_t position = m_ActivePosition[index] - 1;
+    m_Active[position] = m_Active.back();
+    m_ActivePosition[m_Active[position]] = position + 1;
+    m_Active.pop_back();
+    m_ActivePosition[index] = 0;
+}
+
+void SegmentTracker::Pop(glm::vec2* frame, size_t numDots) {
+    memcpy(frame, m_Display.data(), std::min(numDots, m_FrameSize) * sizeof(glm::vec2));
+    m_Changed.Swap(m_Pending);
+    m_Pending.Clear();
+    Step();
+}
+
+DirtyRanges& SegmentTracker::GetChanged() {
+    return m_Changed;
+}
+
+void SegmentTracker::Activate(uint32_t instance, const glm::vec2& position) {
+    if (m_ActivePosition[instance]) {
+        Deactivate(instance);
+    }
+    ClearQueue(instance);
+    Segment& segment = m_Segments[instance];
+    segment.start = segment.end = position;
+    segment.startTime = segment.endTime = 0;
+    segment.jump = false;
+    m_Display[instance] = position;
+    m_Pending.Mark(instance);
+}
+
+void SegmentTracker::Move(uint32_t from, uint32_t to) {
+    if (m_ActivePosition[to]) {
+        Deactivate(to);
+    }
+    ClearQueue(to);
+    m_Segments[to] = m_Segments[from];
+    m_Queues[to] = m_Queues[from];
+    m_Queues[from].head = m_Queues[from].tail = NO_WAYPOINT;
+    m_Display[to] = m_Display[from];
+    m_Pending.Mark(to);
+    if (m_ActivePosition[from]) {
+        uint32_t position = m_ActivePosition[from];
+        m_Active[position - 1] = to;
+        m_ActivePosition[to] = position;
+        m_ActivePosition[from] = 0;
+    }
+}
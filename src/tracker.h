@@ -0,0 +1,89 @@
+
+#ifndef TIMELAPSEDOTMAP_TRACKER_H
+#define TIMELAPSEDOTMAP_TRACKER_H
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "dirty.h"
+#include "frame.h"
+#include "liveset.h"
+#include "update.h"
+
+// Interpolation engine keeping one segment per dot instead of a window of
+// frames. A dot moves linearly from one reported position to the next,
+// reaching each when the display gets to the time it was set; positions
+// reported while an earlier segment is still playing wait in a per-dot
+// queue. Time is counted in frames, and the display runs 'window' frames
+// behind decode just like with the FrameQueue/Interpolator pair, but only
+// dots that are currently moving are evaluated each frame.
+class SegmentTracker : public InstanceStore {
+
+public:
+    SegmentTracker(FrameProvider& frameProvider, size_t window);
+
+    size_t GetFrameSize();
+    size_t GetFrameSizeBytes();
+    size_t GetWindow();
+    size_t GetActiveDots();
+
+    // restart from a complete frame, nothing is moving afterwards
+    void Reset(const glm::vec2* frame);
+    // new positions decoded for the current frame
+    void Apply(const update_t* updates, size_t numUpdates);
+    // position of every dot at the display time
+    const glm::vec2* DisplayFrame();
+    // pass the display frame (or its first numDots entries) to the caller
+    // and step to the next frame
+    void Pop(glm::vec2* frame, size_t numDots = SIZE_MAX);
+    // dots of the last popped frame that may differ from the one before it
+    DirtyRanges& GetChanged();
+
+    // InstanceStore
+    void Activate(uint32_t instance, const glm::vec2& position);
+    void Move(uint32_t from, uint32_t to);
+
+private:
+    struct Segment {
+        glm::vec2 start;
+        glm::vec2 end;      // last known position
+        uint32_t startTime;
+        uint32_t endTime;   // frame the last known position was set
+        bool jump;          // too far to interpolate, stay at start until endTime
+    };
+
+    // segment waiting for the one before it to finish on display
+    struct Waypoint {
+        Segment segment;
+        uint32_t next;
+    };
+    struct Queue {
+        uint32_t head;
+        uint32_t tail;
+    };
+    static const uint32_t NO_WAYPOINT = UINT32_MAX;
+
+    glm::vec2 Evaluate(const Segment& segment, uint32_t time);
+    void Step();
+    void Deactivate(uint32_t index);
+    void Enqueue(uint32_t index, const Segment& segment);
+    bool Dequeue(uint32_t index);
+    void ClearQueue(uint32_t index);
+
+    size_t m_FrameSize;
+    size_t m_Window;
+    std::vector<Segment> m_Segments;   // segment playing on display
+    std::vector<Queue> m_Queues;       // segments waiting behind it
+    std::vector<Waypoint> m_Waypoints; // queued segments of all dots
+    uint32_t m_FreeWaypoint;           // free list through m_Waypoints
+    std::vector<glm::vec2> m_Display;
+    std::vector<uint32_t> m_Active;     // dots with a segment not yet finished on display
+    std::vector<uint32_t> m_ActivePosition; // position in m_Active + 1, 0 if not active
+    uint32_t m_Time;                    // decode time, display is m_Window - 1 frames behind
+    DirtyRanges m_Pending;              // display changes since the last Pop()
+    DirtyRanges m_Changed;
+};
+
+#endif //TIMELAPSEDOTMAP_TRACKER_H
@@ -0,0 +1,248 @@
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include <spdlog/spdlog.h>
+
+#include "interpolator.h"
+#include "profile.h"
+#include "trajectory.h"
+
+static bool EarlierKey(uint32_t time, const TrajectoryKey& key) {
+    return time < key.time;
+}
+
+TrajectoryWriter::TrajectoryWriter(const char* filename, uint32_t frameSize) :
+        m_Filename(filename),
+        m_File(fopen(filename, "wb")),
+        m_Keys(frameSize),
+        m_Jumps(0)
+{
+    if (m_File == NULL) {
+        throw std::runtime_error(std::string("cannot create ") + filename);
+    }
+}
+
+TrajectoryWriter::~TrajectoryWriter() {
+    if (m_File) {
+        fclose(m_File);
+    }
+}
+
+bool TrajectoryWriter::IsTrajectoryFile(const std::string& filename) {
+    static const std::string extension(".tldt");
+    return filename.size() >= extension.size() &&
+           filename.compare(filename.size() - extension.size(), extension.size(), extension) == 0;
+}
+
+void TrajectoryWriter::AddKey(uint32_t dot, uint32_t time, const glm::vec2& position) {
+    std::vector<TrajectoryKey>& keys = m_Keys[dot];
+    // the last update of a timestamp wins, including over a jump to an earlier one
+    while (!keys.empty() && keys.back().time == time) {
+        keys.pop_back();
+    }
+    if (!keys.empty()) {
+        glm::vec2 delta = position - glm::vec2(keys.back().lon, keys.back().lat);
+        if (delta.x * delta.x + delta.y * delta.y > MAX_DISTANCE_DEGREE * MAX_DISTANCE_DEGREE) {
+            // wait at the old position, then jump
+            TrajectoryKey wait = keys.back();
+            wait.time = time;
+            keys.push_back(wait);
+            m_Jumps++;
+        }
+    }
+    TrajectoryKey key = {time, position.x, position.y};
+    keys.push_back(key);
+}
+
+void TrajectoryWriter::AddSnapshot(uint32_t timestamp, const glm::vec2* frame, size_t numLocations) {
+    numLocations = std::min(numLocations, m_Keys.size());
+    for (size_t i = 0; i < numLocations; i++) {
+        if (m_Keys[i].empty() && (frame[i].x != 0.0f || frame[i].y != 0.0f)) {
+            AddKey(i, timestamp, frame[i]);
+        }
+    }
+}
+
+void TrajectoryWriter::AddDelta(uint32_t timestamp, const update_t* updates, size_t numUpdates) {
+    for (size_t i = 0; i < numUpdates; i++) {
+        if (updates[i].index < m_Keys.size()) {
+            AddKey(updates[i].index, timestamp, glm::vec2(updates[i].lon, updates[i].lat));
+        }
+    }
+}
+
+void TrajectoryWriter::Write(const void* data, size_t size) {
+    if (size && fwrite(data, 1, size, m_File) != size) {
+        throw std::runtime_error("cannot write " + m_Filename);
+    }
+}
+
+void TrajectoryWriter::Finish() {
+    std::vector<uint64_t> offsets(m_Keys.size() + 1, 0);
+    for (size_t i = 0; i < m_Keys.size(); i++) {
+        offsets[i + 1] = offsets[i] + m_Keys[i].size();
+    }
+    TrajectoryHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRAJECTORY_MAGIC, sizeof(TRAJECTORY_MAGIC));
+    header.version = TRAJECTORY_VERSION;
+    header.numDots = m_Keys.size();
+    header.numKeys = offsets.back();
+
+    Write(&header, sizeof(header));
+    Write(offsets.data(), offsets.size() * sizeof(uint64_t));
+    for (size_t i = 0; i < m_Keys.size(); i++) {
+        Write(m_Keys[i].data(), m_Keys[i].size() * sizeof(TrajectoryKey));
+    }
+    if (fclose(m_File) != 0) {
+        m_File = NULL;
+        throw std::runtime_error("cannot write " + m_Filename);
+    }
+    m_File = NULL;
+    spdlog::info("Wrote {}: {} keys for {} dots, {} jumps, {} bytes", m_Filename, header.numKeys,
+                 header.numDots, m_Jumps,
+                 sizeof(header) + offsets.size() * sizeof(uint64_t) + header.numKeys * sizeof(TrajectoryKey));
+}
+
+TrajectoryTracker::TrajectoryTracker(const std::string& filename, size_t frameSize, uint32_t idleSeconds) :
+        m_Visible(0),
+        m_Idle(idleSeconds),
+        m_Changed(frameSize)
+{
+    FILE* file = fopen(filename.c_str(), "rb");
+    if (file == NULL) {
+        throw std::runtime_error("cannot open " + filename);
+    }
+    TrajectoryHeader header;
+    bool ok = fread(&header, sizeof(header), 1, file) == 1 &&
+              memcmp(header.magic, TRAJECTORY_MAGIC, sizeof(TRAJECTORY_MAGIC)) == 0 &&
+              header.version == TRAJECTORY_VERSION;
+    if (!ok) {
+        fclose(file);
+        throw std::runtime_error(filename + " is not a version 1 .tldt trajectory file");
+    }
+    if (header.numDots != frameSize) {
+        fclose(file);
+        throw std::runtime_error(filename + " has " + std::to_string(header.numDots) +
+                                 " dots, the frames have " + std::to_string(frameSize));
+    }
+    m_Offsets.resize(header.numDots + 1);
+    m_Keys.resize(header.numKeys);
+    ok = fread(m_Offsets.data(), sizeof(uint64_t), m_Offsets.size(), file) == m_Offsets.size() &&
+         fread(m_Keys.data(), sizeof(TrajectoryKey), m_Keys.size(), file) == m_Keys.size() &&
+         m_Offsets.back() == header.numKeys;
+    fclose(file);
+    for (size_t i = 0; ok && i < header.numDots; i++) {
+        ok = m_Offsets[i] <= m_Offsets[i + 1];
+    }
+    if (!ok) {
+        throw std::runtime_error("truncated .tldt trajectory file " + filename);
+    }
+
+    m_Cursors.assign(m_Offsets.begin(), m_Offsets.end() - 1);
+    m_Segments.resize(frameSize);
+    for (size_t i = 0; i < frameSize; i++) {
+        Load(i, 0);
+    }
+    m_Shown.assign(frameSize, 0);
+    m_Display.resize(frameSize);
+    spdlog::info("Loaded {} trajectory keys for {} dots from {}", header.numKeys, header.numDots, filename);
+}
+
+size_t TrajectoryTracker::GetFrameSize() {
+    return m_Display.size();
+}
+
+size_t TrajectoryTracker::GetVisible() {
+    return m_Visible;
+}
+
+void TrajectoryTracker::Seek(uint32_t time) {
+    TLDM_PROFILE_SCOPE("trajectory seek");
+    const TrajectoryKey* keys = m_Keys.data();
+    for (size_t i = 0; i < m_Cursors.size(); i++) {
+        m_Cursors[i] = std::upper_bound(keys + m_Offsets[i], keys + m_Offsets[i + 1], time, EarlierKey) - keys;
+        Load(i, time);
+    }
+}
+
+void TrajectoryTracker::Load(size_t dot, uint32_t time) {
+    uint64_t begin = m_Offsets[dot], end = m_Offsets[dot + 1];
+    uint64_t& cursor = m_Cursors[dot];
+    // a frame or two of keys either way during playback
+    while (cursor < end && m_Keys[cursor].time <= time) {
+        cursor++;
+    }
+    while (cursor > begin && m_Keys[cursor - 1].time > time) {
+        cursor--;
+    }
+
+    Segment& segment = m_Segments[dot];
+    segment.end = cursor < end ? m_Keys[cursor].time : UINT32_MAX;
+    if (cursor == begin) {
+        // not located yet
+        segment.begin = 0;
+        segment.hidden = 0;
+        segment.rate = 0.0f;
+        segment.from = segment.to = glm::vec2(0.0f);
+        return;
+    }
+    const TrajectoryKey& from = m_Keys[cursor - 1];
+    segment.begin = from.time;
+    segment.from = segment.to = glm::vec2(from.lon, from.lat);
+    segment.rate = 0.0f;
+    if (cursor < end) {
+        const TrajectoryKey& to = m_Keys[cursor];
+        segment.to = glm::vec2(to.lon, to.lat);
+        segment.rate = 1.0f / float(to.time - from.time);
+    }
+    // like the LiveSet, idle for longer than m_Idle hides the dot until it
+    // reports again; a dot moving to its next key is not idle
+    if (m_Idle == 0 || (cursor < end && segment.end - segment.begin <= m_Idle)) {
+        segment.hidden = UINT32_MAX;
+    } else {
+        segment.hidden = uint32_t(std::min<uint64_t>(uint64_t(segment.begin) + m_Idle + 1, UINT32_MAX));
+    }
+}
+
+size_t TrajectoryTracker::Evaluate(uint32_t time) {
+    TLDM_PROFILE_SCOPE("evaluate trajectories");
+    m_Changed.Clear();
+    bool reordered = false;
+    size_t visible = 0;
+    for (size_t i = 0; i < m_Segments.size(); i++) {
+        const Segment& segment = m_Segments[i];
+        if (time < segment.begin || time >= segment.end) {
+            Load(i, time);
+        }
+        bool shown = time < segment.hidden;
+        if (shown != bool(m_Shown[i])) {
+            m_Shown[i] = shown;
+            reordered = true;
+        }
+        if (shown) {
+            glm::vec2 position = segment.from + (segment.to - segment.from) * (float(time - segment.begin) * segment.rate);
+            if (m_Display[visible] != position) {
+                m_Display[visible] = position;
+                m_Changed.Mark(visible);
+            }
+            visible++;
+        }
+    }
+    // dots appeared or disappeared, the ones after them moved to another instance
+    if (reordered) {
+        m_Changed.MarkAll();
+    }
+    m_Visible = visible;
+    return visible;
+}
+
+void TrajectoryTracker::Pop(glm::vec2* frame, size_t numDots) {
+    memcpy(frame, m_Display.data(), std::min(numDots, m_Visible) * sizeof(glm::vec2));
+}
+
+DirtyRanges& TrajectoryTracker::GetChanged() {
+    return m_Changed;
+}
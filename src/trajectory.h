@@ -0,0 +1,118 @@
+
+#ifndef TIMELAPSEDOTMAP_TRAJECTORY_H
+#define TIMELAPSEDOTMAP_TRAJECTORY_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "dirty.h"
+#include "writer.h"
+
+// .tldt trajectory file: every dot's reported positions as a piecewise
+// linear path over time, built offline from the deltas. A dot moves
+// linearly from one key to the next. A move longer than
+// MAX_DISTANCE_DEGREE is stored as two keys at the same time, the old
+// position and the new one, so the dot waits and then jumps; this is the
+// same rule the engines apply at runtime. Keys of a dot are sorted by time.
+//
+//   TrajectoryHeader
+//   uint64_t offsets[numDots + 1]   first key of each dot, then numKeys
+//   TrajectoryKey keys[numKeys]
+
+static const char TRAJECTORY_MAGIC[4] = {'T', 'L', 'D', 'T'};
+static const uint32_t TRAJECTORY_VERSION = 1;
+
+struct TrajectoryHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t numDots;
+    uint32_t reserved;
+    uint64_t numKeys;
+};
+
+struct TrajectoryKey {
+    uint32_t time;
+    float lon;
+    float lat;
+};
+
+// Collects the keys of every dot in memory and writes the file in
+// Finish(). Reverse deltas are not needed, any time can be evaluated.
+class TrajectoryWriter : public FrameWriter {
+
+public:
+    TrajectoryWriter(const char* filename, uint32_t frameSize);
+    ~TrajectoryWriter();
+
+    static bool IsTrajectoryFile(const std::string& filename);
+
+    // dots without a key yet start at their snapshot position
+    void AddSnapshot(uint32_t timestamp, const glm::vec2* frame, size_t numLocations);
+    void AddDelta(uint32_t timestamp, const update_t* updates, size_t numUpdates);
+    void Finish();
+
+private:
+    void AddKey(uint32_t dot, uint32_t time, const glm::vec2& position);
+    void Write(const void* data, size_t size);
+
+    std::string m_Filename;
+    FILE* m_File;
+    std::vector<std::vector<TrajectoryKey> > m_Keys;
+    uint64_t m_Jumps;
+};
+
+// Evaluates the trajectories at any time: each dot keeps a cursor on its
+// keys that steps forwards or backwards as playback moves, and Seek()
+// finds it by binary search. The segment between the keys either side of
+// the cursor is kept next to the other dots' ones, so most frames read no
+// keys at all. There is no window of frames and no decode ahead, the
+// display shows the current time. Like the LiveSet, a dot is
+// shown from its first key until idleSeconds after a key that is not
+// followed by another one within that time; visible dots are numbered
+// densely in dot order.
+class TrajectoryTracker {
+
+public:
+    TrajectoryTracker(const std::string& filename, size_t frameSize, uint32_t idleSeconds);
+
+    size_t GetFrameSize();
+    size_t GetVisible();
+
+    // move every cursor to time by binary search, e.g. after a jump
+    void Seek(uint32_t time);
+    // the visible dots at time, cursors step from where they are; returns
+    // their number
+    size_t Evaluate(uint32_t time);
+    // pass the visible dots (or the first numDots) to the caller
+    void Pop(glm::vec2* frame, size_t numDots = SIZE_MAX);
+    // dots of the last Evaluate() that may differ from the one before it
+    DirtyRanges& GetChanged();
+
+private:
+    // where a dot is during [begin, end), shown before hidden
+    struct Segment {
+        uint32_t begin;
+        uint32_t end;
+        uint32_t hidden;
+        float rate; // 1 / (end - begin), 0 after the last key
+        glm::vec2 from;
+        glm::vec2 to;
+    };
+
+    void Load(size_t dot, uint32_t time);
+
+    std::vector<uint64_t> m_Offsets;
+    std::vector<TrajectoryKey> m_Keys;
+    std::vector<uint64_t> m_Cursors; // by dot: first key after the current time
+    std::vector<Segment> m_Segments; // by dot, around the cursor
+    std::vector<uint8_t> m_Shown;    // by dot, at the last Evaluate()
+    std::vector<glm::vec2> m_Display;
+    size_t m_Visible;
+    uint32_t m_Idle;
+    DirtyRanges m_Changed;
+};
+
+#endif //TIMELAPSEDOTMAP_TRAJECTORY_H
@@ -2,6 +2,7 @@
 #ifndef TIMELAPSEDOTMAP_UPDATE_H
 #define TIMELAPSEDOTMAP_UPDATE_H
 
+#include <cstdint>
 #include <cstdlib>
 
 typedef struct {
@@ -10,4 +11,10 @@ typedef struct {
     float lon;
 } update_t;
 
+// new value of a per-dot attribute column, e.g. speed
+typedef struct {
+    uint32_t index;
+    float value;
+} attribute_t;
+
 #endif //TIMELAPSEDOTMAP_UPDATE_H
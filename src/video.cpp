@@ -0,0 +1,153 @@
+
+#include <cmath>
+#include <stdexcept>
+
+#include "video.h"
+
+VideoWriter::VideoWriter(const std::string& filename, const std::string& format, size_t width, size_t height,
+                         double fps, WorkerPool* pool) :
+        m_File(NULL),
+        m_Y4m(format == VIDEO_FORMAT_Y4M),
+        m_Width(width),
+        m_Height(height),
+        m_Pool(pool),
+        m_Frames(0),
+        m_Bytes(0),
+        m_HasPending(false),
+        m_Quit(false),
+        m_Failed(false)
+{
+    if (!m_Y4m && format != VIDEO_FORMAT_RGBA) {
+        throw std::runtime_error("Unknown video format " + format);
+    }
+    if (m_Y4m && (width % 2 || height % 2)) {
+        throw std::runtime_error("y4m needs an even width and height");
+    }
+    m_File = filename == "-" ? stdout : fopen(filename.c_str(), "wb");
+    if (m_File == NULL) {
+        throw std::runtime_error("Cannot create " + filename);
+    }
+    if (m_Y4m) {
+        // frame rate as a fraction, 29.97 becomes 29970:1000
+        unsigned long numerator = (unsigned long)std::lround(fps * 1000);
+        unsigned long denominator = 1000;
+        while (denominator > 1 && numerator % 10 == 0) {
+            numerator /= 10;
+            denominator /= 10;
+        }
+        int n = fprintf(m_File, "YUV4MPEG2 W%zu H%zu F%lu:%lu Ip A1:1 C420jpeg\n",
+                        width, height, numerator, denominator);
+        m_Bytes += n > 0 ? n : 0;
+    }
+    m_Thread = std::thread(&VideoWriter::Run, this);
+}
+
+VideoWriter::~VideoWriter() {
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Quit = true;
+    }
+    m_Ready.notify_one();
+    if (m_Thread.joinable()) {
+        m_Thread.join();
+    }
+    if (m_File != NULL && m_File != stdout) {
+        fclose(m_File);
+    }
+}
+
+void VideoWriter::Convert(const uint8_t* rgba, std::vector<uint8_t>& frame) {
+    if (!m_Y4m) {
+        frame.assign(rgba, rgba + m_Width * m_Height * 4);
+        return;
+    }
+    static const char FRAME[] = "FRAME\n";
+    size_t header = sizeof(FRAME) - 1;
+    size_t lumaSize = m_Width * m_Height;
+    size_t chromaSize = lumaSize / 4;
+    frame.resize(header + lumaSize + 2 * chromaSize);
+    std::copy(FRAME, FRAME + header, frame.begin());
+    uint8_t* luma = &frame[header];
+    uint8_t* cb = luma + lumaSize;
+    uint8_t* cr = cb + chromaSize;
+
+    // one chunk per pair of rows, chroma is averaged over 2x2 pixels
+    WorkerPool::Task task = [&](size_t pair, size_t) {
+        for (size_t y = 2 * pair; y < 2 * pair + 2; y++) {
+            const uint8_t* pixel = rgba + y * m_Width * 4;
+            for (size_t x = 0; x < m_Width; x++, pixel += 4) {
+                luma[y * m_Width + x] = (uint8_t)((66 * pixel[0] + 129 * pixel[1] + 25 * pixel[2] + 128 + 4096) >> 8);
+            }
+        }
+        const uint8_t* top = rgba + 2 * pair * m_Width * 4;
+        const uint8_t* bottom = top + m_Width * 4;
+        for (size_t x = 0; x < m_Width / 2; x++) {
+            int r = top[8 * x] + top[8 * x + 4] + bottom[8 * x] + bottom[8 * x + 4];
+            int g = top[8 * x + 1] + top[8 * x + 5] + bottom[8 * x + 1] + bottom[8 * x + 5];
+            int b = top[8 * x + 2] + top[8 * x + 6] + bottom[8 * x + 2] + bottom[8 * x + 6];
+            cb[pair * m_Width / 2 + x] = (uint8_t)((-38 * r - 74 * g + 112 * b + 512 + 4 * 32768) >> 10);
+            cr[pair * m_Width / 2 + x] = (uint8_t)((112 * r - 94 * g - 18 * b + 512 + 4 * 32768) >> 10);
+        }
+    };
+    if (m_Pool) {
+        m_Pool->Run(m_Height / 2, task);
+    } else {
+        for (size_t pair = 0; pair < m_Height / 2; pair++) {
+            task(pair, 0);
+        }
+    }
+}
+
+void VideoWriter::Write(const uint8_t* rgba) {
+    Convert(rgba, m_Converted);
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    m_Done.wait(lock, [this] { return !m_HasPending; });
+    Check();
+    m_Pending.swap(m_Converted);
+    m_HasPending = true;
+    m_Frames++;
+    lock.unlock();
+    m_Ready.notify_one();
+}
+
+void VideoWriter::Finish() {
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    m_Done.wait(lock, [this] { return !m_HasPending; });
+    if (fflush(m_File) != 0) {
+        m_Failed = true;
+    }
+    Check();
+}
+
+void VideoWriter::Check() {
+    if (m_Failed) {
+        throw std::runtime_error("Video write failed");
+    }
+}
+
+uint64_t VideoWriter::GetFrames() {
+    return m_Frames;
+}
+
+uint64_t VideoWriter::GetBytes() {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_Bytes;
+}
+
+void VideoWriter::Run() {
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    while (true) {
+        m_Ready.wait(lock, [this] { return m_HasPending || m_Quit; });
+        if (!m_HasPending) {
+            return;
+        }
+        // m_Pending is not touched by the caller until m_HasPending is cleared
+        lock.unlock();
+        bool ok = fwrite(m_Pending.data(), 1, m_Pending.size(), m_File) == m_Pending.size();
+        lock.lock();
+        m_Failed = m_Failed || !ok;
+        m_Bytes += m_Pending.size();
+        m_HasPending = false;
+        m_Done.notify_one();
+    }
+}
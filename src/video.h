@@ -0,0 +1,62 @@
+
+#ifndef TIMELAPSEDOTMAP_VIDEO_H
+#define TIMELAPSEDOTMAP_VIDEO_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "pool.h"
+
+#define VIDEO_FORMAT_Y4M "y4m"
+#define VIDEO_FORMAT_RGBA "rgba"
+
+// Writes rendered frames as a stream an encoder can read directly, e.g.
+// "ffmpeg -i export.y4m out.mp4". y4m is 4:2:0 with BT.601 limited range
+// and needs even dimensions; rgba is raw frames without a header. The
+// file is written on a background thread while the next frame renders.
+class VideoWriter {
+
+public:
+    // filename "-" writes to stdout
+    VideoWriter(const std::string& filename, const std::string& format, size_t width, size_t height, double fps,
+                WorkerPool* pool = NULL);
+    ~VideoWriter();
+
+    // rgba is width * height pixels, top row first
+    void Write(const uint8_t* rgba);
+    // waits for the last frame, throws if any write failed
+    void Finish();
+
+    uint64_t GetFrames();
+    uint64_t GetBytes();
+
+private:
+    void Convert(const uint8_t* rgba, std::vector<uint8_t>& frame);
+    void Run();
+    void Check();
+
+    FILE* m_File;
+    bool m_Y4m;
+    size_t m_Width;
+    size_t m_Height;
+    WorkerPool* m_Pool;
+    uint64_t m_Frames;
+    uint64_t m_Bytes;
+
+    std::vector<uint8_t> m_Converted; // filled by the caller
+    std::vector<uint8_t> m_Pending;   // written by the thread
+    std::thread m_Thread;
+    std::mutex m_Mutex;
+    std::condition_variable m_Ready;
+    std::condition_variable m_Done;
+    bool m_HasPending;
+    bool m_Quit;
+    bool m_Failed;
+};
+
+#endif //TIMELAPSEDOTMAP_VIDEO_H
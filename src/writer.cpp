@@ -0,0 +1,44 @@
+
+#include "container.h"
+#include "database.h"
+#include "source.h"
+#include "trajectory.h"
+#include "writer.h"
+
+FrameWriter* FrameWriter::Create(const char* filename, uint32_t frameSize, bool reversible) {
+    if (FrameSource::IsContainer(filename)) {
+        return new ContainerWriter(filename, frameSize, reversible);
+    }
+    if (TrajectoryWriter::IsTrajectoryFile(filename)) {
+        return new TrajectoryWriter(filename, frameSize);
+    }
+    return new DatabaseWriter(filename, false, reversible);
+}
+
+void ReverseDelta::Reset(const glm::vec2* frame, size_t numLocations) {
+    m_Frame.assign(frame, frame + numLocations);
+}
+
+const std::vector<update_t>& ReverseDelta::Build(const update_t* updates, size_t numUpdates) {
+    m_Reverse.clear();
+    // all from the frame before the delta, so a slot it moves twice gets
+    // back to where it was before both
+    for (size_t i = 0; i < numUpdates; i++) {
+        uint32_t slot = updates[i].index;
+        if (slot < m_Frame.size() && (m_Frame[slot].x != 0.0f || m_Frame[slot].y != 0.0f)) {
+            update_t previous;
+            previous.index = slot;
+            previous.lat = m_Frame[slot].y;
+            previous.lon = m_Frame[slot].x;
+            m_Reverse.push_back(previous);
+        }
+    }
+    for (size_t i = 0; i < numUpdates; i++) {
+        uint32_t slot = updates[i].index;
+        if (slot >= m_Frame.size()) {
+            m_Frame.resize(slot + 1, glm::vec2(0.0f));
+        }
+        m_Frame[slot] = glm::vec2(updates[i].lon, updates[i].lat);
+    }
+    return m_Reverse;
+}
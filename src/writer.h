@@ -0,0 +1,56 @@
+
+#ifndef TIMELAPSEDOTMAP_WRITER_H
+#define TIMELAPSEDOTMAP_WRITER_H
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "update.h"
+
+// Destination of tldm-convert and tldm-ingest: an SQLite database or a
+// .tldm container. Snapshots and deltas must be added in timestamp order,
+// a snapshot before the delta of the same timestamp.
+class FrameWriter {
+
+public:
+    // a ContainerWriter for .tldm files, a TrajectoryWriter for .tldt, a
+    // DatabaseWriter otherwise; reversible also stores the reverse of every
+    // delta, for rewinding
+    static FrameWriter* Create(const char* filename, uint32_t frameSize, bool reversible = false);
+
+    virtual ~FrameWriter() {}
+
+    virtual void AddSlot(const std::string& name, uint32_t slot) {}
+    virtual void AddSnapshot(uint32_t timestamp, const glm::vec2* frame, size_t numLocations) = 0;
+    virtual void AddDelta(uint32_t timestamp, const update_t* updates, size_t numUpdates) = 0;
+    // attribute columns, see FrameSource::GetAttributes(); a column's
+    // snapshot comes before its delta of the same timestamp. Only databases
+    // store them.
+    virtual bool HasAttributes() { return false; }
+    virtual void AddAttributeSnapshot(const std::string& name, uint32_t timestamp, const float* column,
+                                      size_t numValues) {}
+    virtual void AddAttributeDelta(const std::string& name, uint32_t timestamp, const attribute_t* updates,
+                                   size_t numUpdates) {}
+    virtual void Finish() = 0;
+};
+
+// Follows the frame through a writer's snapshots and deltas to build the
+// reverse of each delta: the previous positions of the slots it moves.
+// Slots without a location yet are left out, there is nothing to restore.
+class ReverseDelta {
+
+public:
+    // the frame before the next delta, e.g. a snapshot
+    void Reset(const glm::vec2* frame, size_t numLocations);
+    // reverse of updates, then moves the frame past them
+    const std::vector<update_t>& Build(const update_t* updates, size_t numUpdates);
+
+private:
+    std::vector<glm::vec2> m_Frame;
+    std::vector<update_t> m_Reverse;
+};
+
+#endif //TIMELAPSEDOTMAP_WRITER_H
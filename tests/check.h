@@ -0,0 +1,26 @@
+#ifndef TIMELAPSEDOTMAP_CHECK_H
+#define TIMELAPSEDOTMAP_CHECK_H
+
+#include <cstdio>
+
+// Just enough for the unit tests: CHECK reports a failed condition and
+// carries on, and main() returns CheckResult() so ctest sees the failure.
+static int g_CheckFailures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            g_CheckFailures++; \
+        } \
+    } while (0)
+
+static int CheckResult() {
+    if (g_CheckFailures) {
+        fprintf(stderr, "%d checks failed\n", g_CheckFailures);
+        return 1;
+    }
+    return 0;
+}
+
+#endif //TIMELAPSEDOTMAP_CHECK_H
@@ -0,0 +1,122 @@
+// FrameScheduler and PlaybackClock driven by a ManualClock: the frame
+// cadence, catching up after late frames, fractional speeds carrying
+// their phase across frames and the backlog limit.
+
+#include <cmath>
+
+#include "clock.h"
+#include "check.h"
+
+// periods and steps are powers of two, so the sums below are exact
+static const double FPS = 64.0;
+static const double PERIOD = 1.0 / FPS;
+
+static bool Near(double a, double b) {
+    return std::fabs(a - b) < 1e-9;
+}
+
+static void TestCadence() {
+    ManualClock clock(10.0);
+    FrameScheduler scheduler(clock, FPS);
+
+    // the first frame is due at once, the next ones a period apart
+    CHECK(Near(scheduler.Wait(), 0.0));
+    for (int i = 1; i <= 10; i++) {
+        CHECK(Near(scheduler.Wait(), PERIOD));
+        CHECK(Near(clock.Now(), 10.0 + i * PERIOD));
+    }
+
+    // a frame rendered half a period late does not shift the next deadline
+    clock.Advance(1.5 * PERIOD);
+    CHECK(Near(scheduler.Wait(), 1.5 * PERIOD));
+    CHECK(Near(scheduler.Wait(), 0.5 * PERIOD));
+    CHECK(Near(clock.Now(), 10.0 + 12 * PERIOD));
+    CHECK(scheduler.GetLateFrames() == 0);
+
+    // more than a frame behind: no burst, the cadence restarts from now
+    clock.Advance(3.25 * PERIOD);
+    double late = clock.Now();
+    CHECK(Near(scheduler.Wait(), 3.25 * PERIOD));
+    CHECK(scheduler.GetLateFrames() == 1);
+    CHECK(Near(scheduler.Wait(), PERIOD));
+    CHECK(Near(clock.Now(), late + PERIOD));
+
+    // a new rate applies from the next deadline on
+    scheduler.SetRate(FPS / 2);
+    CHECK(Near(scheduler.Wait(), PERIOD));
+    CHECK(Near(scheduler.Wait(), 2 * PERIOD));
+}
+
+static void TestUnlimited() {
+    ManualClock clock;
+    FrameScheduler scheduler(clock, 0.0);
+    // no waiting, just the time between frames
+    CHECK(Near(scheduler.Wait(), 0.0));
+    clock.Advance(0.125);
+    CHECK(Near(scheduler.Wait(), 0.125));
+    CHECK(Near(clock.Now(), 0.125));
+    CHECK(scheduler.GetLateFrames() == 0);
+}
+
+static void TestWholeSpeed() {
+    ManualClock clock;
+    PlaybackClock playback(clock, 1000);
+    // speed is deltas per frame at 60 Hz
+    clock.Advance(0.25);
+    CHECK(playback.Advance(1.0f) == 15);
+    clock.Advance(0.25);
+    CHECK(playback.Advance(2.0f) == 30);
+    CHECK(playback.Advance(1.0f) == 0);
+}
+
+static void TestFractionalSpeed() {
+    ManualClock clock;
+    PlaybackClock playback(clock, 1000);
+    // 0.25 deltas per 60 Hz frame at 64 Hz is 0.234375 deltas per frame;
+    // the fraction carries over, so every frame is due what it has owed
+    size_t total = 0;
+    for (int frame = 1; frame <= 64; frame++) {
+        clock.Advance(PERIOD);
+        size_t due = playback.Advance(0.25f);
+        CHECK(due <= 1);
+        total += due;
+        CHECK(total == size_t(std::floor(frame * 0.234375)));
+    }
+    CHECK(total == 15);
+    CHECK(playback.GetDropped() == 0);
+}
+
+static void TestBacklog() {
+    ManualClock clock;
+    PlaybackClock playback(clock, 10);
+
+    // a stalled window owes at most the backlog, the rest is dropped
+    clock.Advance(10.0);
+    CHECK(playback.Advance(1.0f) == 10);
+    CHECK(playback.GetDropped() == 590);
+
+    // deferred deltas are due again in the next frame, up to the limit
+    playback.Defer(4);
+    CHECK(playback.Advance(1.0f) == 4);
+    playback.Defer(8);
+    playback.Defer(8);
+    CHECK(playback.GetDropped() == 596);
+    CHECK(playback.Advance(1.0f) == 10);
+
+    // after a reset nothing is owed, however long ago the last frame was
+    playback.Defer(3);
+    clock.Advance(5.0);
+    playback.Reset();
+    CHECK(playback.Advance(1.0f) == 0);
+    clock.Advance(0.5);
+    CHECK(playback.Advance(1.0f) == 10);
+}
+
+int main() {
+    TestCadence();
+    TestUnlimited();
+    TestWholeSpeed();
+    TestFractionalSpeed();
+    TestBacklog();
+    return CheckResult();
+}
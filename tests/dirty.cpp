@@ -0,0 +1,146 @@
+// DirtyRanges: marking, counting, merging and coalescing, with indices on
+// and around the 64 bit word edges and limits that cut through a word.
+
+#include <vector>
+
+#include "dirty.h"
+#include "check.h"
+
+// expected holds begin, end pairs
+static bool HasRanges(DirtyRanges& dirty, size_t limit, size_t maxGap, const std::vector<size_t>& expected) {
+    const std::vector<DirtyRanges::Range>& ranges = dirty.Coalesce(limit, maxGap);
+    if (ranges.size() * 2 != expected.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < ranges.size(); i++) {
+        if (ranges[i].begin != expected[2 * i] || ranges[i].end != expected[2 * i + 1]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void TestMark() {
+    DirtyRanges dirty(200);
+    CHECK(dirty.GetSize() == 200);
+    CHECK(dirty.Count() == 0);
+    CHECK(dirty.Coalesce(200, 0).empty());
+
+    // the last bit of a word and the first of the next are one range
+    dirty.Mark(63);
+    dirty.Mark(64);
+    dirty.Mark(199);
+    CHECK(dirty.Count() == 3);
+    CHECK(HasRanges(dirty, 200, 0, {63, 65, 199, 200}));
+
+    // a range reaching into the next word, and ones filling whole words
+    dirty.Clear();
+    dirty.MarkRange(60, 130);
+    CHECK(dirty.Count() == 70);
+    CHECK(HasRanges(dirty, 200, 0, {60, 130}));
+    dirty.Clear();
+    dirty.MarkRange(0, 128);
+    CHECK(dirty.Count() == 128);
+    CHECK(HasRanges(dirty, 200, 0, {0, 128}));
+
+    // ranges are cut at the size
+    dirty.Clear();
+    dirty.MarkRange(190, 300);
+    CHECK(dirty.Count() == 10);
+    CHECK(HasRanges(dirty, 200, 0, {190, 200}));
+}
+
+static void TestCount() {
+    DirtyRanges dirty(130);
+    dirty.Mark(0);
+    dirty.Mark(63);
+    dirty.Mark(64);
+    dirty.Mark(129);
+    CHECK(dirty.Count() == 4);
+    CHECK(dirty.Count(0) == 0);
+    CHECK(dirty.Count(1) == 1);
+    CHECK(dirty.Count(63) == 1);
+    CHECK(dirty.Count(64) == 2);
+    CHECK(dirty.Count(65) == 3);
+    CHECK(dirty.Count(129) == 3);
+    CHECK(dirty.Count(130) == 4);
+    CHECK(dirty.Count(1000) == 4);
+}
+
+static void TestCoalesce() {
+    DirtyRanges dirty(256);
+    dirty.Mark(10);
+    dirty.Mark(14);
+    dirty.Mark(64);
+    dirty.MarkRange(120, 136);
+
+    // gaps of up to maxGap unmarked indices are bridged
+    CHECK(HasRanges(dirty, 256, 0, {10, 11, 14, 15, 64, 65, 120, 136}));
+    CHECK(HasRanges(dirty, 256, 3, {10, 15, 64, 65, 120, 136}));
+    CHECK(HasRanges(dirty, 256, 55, {10, 136}));
+
+    // the limit ends a range within a word and drops what is after it
+    CHECK(HasRanges(dirty, 128, 0, {10, 11, 14, 15, 64, 65, 120, 128}));
+    CHECK(HasRanges(dirty, 64, 100, {10, 15}));
+    CHECK(HasRanges(dirty, 65, 100, {10, 65}));
+    CHECK(dirty.Coalesce(10, 0).empty());
+    CHECK(dirty.Coalesce(0, 0).empty());
+
+    // a range open at the last word ends at the size
+    DirtyRanges full(100);
+    full.MarkRange(0, 100);
+    CHECK(HasRanges(full, 100, 0, {0, 100}));
+    CHECK(HasRanges(full, SIZE_MAX, 0, {0, 100}));
+}
+
+static void TestMarkAll() {
+    DirtyRanges dirty(70);
+    dirty.MarkAll();
+    CHECK(dirty.IsAll());
+    CHECK(dirty.Count() == 70);
+    CHECK(dirty.Count(65) == 65);
+    CHECK(HasRanges(dirty, 70, 0, {0, 70}));
+    CHECK(HasRanges(dirty, 65, 0, {0, 65}));
+    CHECK(dirty.Coalesce(0, 0).empty());
+
+    dirty.Clear();
+    CHECK(!dirty.IsAll());
+    CHECK(dirty.Count() == 0);
+}
+
+static void TestMerge() {
+    DirtyRanges a(130), b(130);
+    a.Mark(1);
+    a.Mark(64);
+    b.Mark(64);
+    b.Mark(129);
+    a.Merge(b);
+    CHECK(a.Count() == 3);
+    CHECK(HasRanges(a, 130, 0, {1, 2, 64, 65, 129, 130}));
+    CHECK(b.Count() == 2);
+
+    // merging a set marked whole marks everything, and marking whole
+    // is kept through later merges
+    DirtyRanges all(130);
+    all.MarkAll();
+    b.Merge(all);
+    CHECK(b.IsAll());
+    CHECK(b.Count() == 130);
+    all.Merge(a);
+    CHECK(all.IsAll());
+
+    // swapping keeps each set's marks
+    a.Swap(b);
+    CHECK(a.IsAll());
+    CHECK(!b.IsAll());
+    CHECK(b.Count() == 3);
+}
+
+int main() {
+    TestMark();
+    TestCount();
+    TestCoalesce();
+    TestMarkAll();
+    TestMerge();
+    return CheckResult();
+}
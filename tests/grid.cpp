@@ -0,0 +1,157 @@
+// SpatialGrid: Query() and QueryDensity() against a scan over every dot,
+// with dots inside and outside the grid extent, after the dots move and
+// after instances are dropped.
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "grid.h"
+#include "check.h"
+
+static const size_t CELLS_PER_SIDE = 16;
+static const glm::vec2 MINIMUM(100.0f, -40.0f);
+static const glm::vec2 MAXIMUM(110.0f, -30.0f);
+static const glm::vec2 BORDER(5.0f, 5.0f);
+
+// deterministic, so a failure repeats
+class Random {
+
+public:
+    explicit Random(uint64_t seed) : m_State(seed) {}
+
+    float Uniform(float low, float high) {
+        m_State = m_State * 6364136223846793005ULL + 1442695040888963407ULL;
+        return low + (high - low) * float(m_State >> 40) / float(1 << 24);
+    }
+
+private:
+    uint64_t m_State;
+};
+
+// the grid's cell of a position, border cells holding what is outside
+static size_t Cell(float value, float minimum, float cellSize) {
+    float cell = std::floor((value - minimum) / cellSize);
+    return (size_t)std::min(std::max(cell, 0.0f), float(CELLS_PER_SIDE - 1));
+}
+
+static void CheckQuery(SpatialGrid& grid, const std::vector<glm::vec2>& positions,
+                       const glm::vec2& minimum, const glm::vec2& maximum) {
+    std::vector<uint32_t> expected;
+    for (size_t i = 0; i < positions.size(); i++) {
+        const glm::vec2& p = positions[i];
+        if (p.x >= minimum.x && p.x <= maximum.x && p.y >= minimum.y && p.y <= maximum.y) {
+            expected.push_back(i);
+        }
+    }
+
+    std::vector<glm::vec2> out(positions.size());
+    std::vector<uint32_t> instances(positions.size());
+    size_t count = grid.Query(minimum, maximum, out.data(), instances.data());
+    CHECK(count == expected.size());
+    if (count != expected.size()) {
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        CHECK(out[i] == positions[instances[i]]);
+    }
+    instances.resize(count);
+    std::sort(instances.begin(), instances.end());
+    CHECK(instances == expected);
+}
+
+static void CheckDensity(SpatialGrid& grid, const std::vector<glm::vec2>& positions,
+                         const glm::vec2& minimum, const glm::vec2& maximum, int level) {
+    glm::vec2 cellSize = grid.GetCellSize();
+    size_t x0 = Cell(minimum.x, MINIMUM.x, cellSize.x) >> level, x1 = Cell(maximum.x, MINIMUM.x, cellSize.x) >> level;
+    size_t y0 = Cell(minimum.y, MINIMUM.y, cellSize.y) >> level, y1 = Cell(maximum.y, MINIMUM.y, cellSize.y) >> level;
+    size_t width = x1 - x0 + 1, height = y1 - y0 + 1;
+
+    // every dot counted in its block, if the block overlaps the query
+    std::vector<size_t> counts(width * height, 0);
+    std::vector<double> sumX(width * height, 0.0), sumY(width * height, 0.0);
+    for (size_t i = 0; i < positions.size(); i++) {
+        size_t bx = Cell(positions[i].x, MINIMUM.x, cellSize.x) >> level;
+        size_t by = Cell(positions[i].y, MINIMUM.y, cellSize.y) >> level;
+        if (bx < x0 || bx > x1 || by < y0 || by > y1) {
+            continue;
+        }
+        size_t block = (by - y0) * width + (bx - x0);
+        counts[block]++;
+        sumX[block] += positions[i].x;
+        sumY[block] += positions[i].y;
+    }
+
+    std::vector<glm::vec2> blockPositions(width * height);
+    std::vector<float> weights(width * height);
+    size_t count = grid.QueryDensity(minimum, maximum, level, blockPositions.data(), weights.data());
+    // blocks come row by row, empty ones left out
+    size_t found = 0;
+    for (size_t block = 0; block < counts.size(); block++) {
+        if (!counts[block]) {
+            continue;
+        }
+        CHECK(found < count);
+        if (found >= count) {
+            return;
+        }
+        CHECK(weights[found] == float(counts[block]));
+        CHECK(std::fabs(blockPositions[found].x - sumX[block] / counts[block]) < 1e-4);
+        CHECK(std::fabs(blockPositions[found].y - sumY[block] / counts[block]) < 1e-4);
+        found++;
+    }
+    CHECK(found == count);
+}
+
+static void CheckQueries(SpatialGrid& grid, const std::vector<glm::vec2>& positions, Random& random) {
+    CHECK(grid.GetSize() == positions.size());
+    // the whole extent, the border beyond it, and views inside it
+    CheckQuery(grid, positions, MINIMUM, MAXIMUM);
+    CheckQuery(grid, positions, MINIMUM - BORDER, MAXIMUM + BORDER);
+    CheckQuery(grid, positions, glm::vec2(90.0f, -50.0f), glm::vec2(101.0f, -39.0f));
+    for (size_t q = 0; q < 50; q++) {
+        glm::vec2 a(random.Uniform(95.0f, 115.0f), random.Uniform(-45.0f, -25.0f));
+        glm::vec2 b(random.Uniform(95.0f, 115.0f), random.Uniform(-45.0f, -25.0f));
+        CheckQuery(grid, positions, glm::min(a, b), glm::max(a, b));
+        for (int level = 0; level <= 4; level++) {
+            CheckDensity(grid, positions, glm::min(a, b), glm::max(a, b), level);
+        }
+    }
+    for (int level = 0; level <= 4; level++) {
+        CheckDensity(grid, positions, MINIMUM - BORDER, MAXIMUM + BORDER, level);
+    }
+}
+
+int main() {
+    Random random(7);
+    SpatialGrid grid(MINIMUM, MAXIMUM, CELLS_PER_SIDE);
+
+    // mostly inside the extent, some outside it in the border cells
+    std::vector<glm::vec2> positions(2000);
+    for (size_t i = 0; i < positions.size(); i++) {
+        positions[i] = glm::vec2(random.Uniform(98.0f, 112.0f), random.Uniform(-42.0f, -28.0f));
+    }
+    grid.Sync(positions.data(), positions.size());
+    CheckQueries(grid, positions, random);
+
+    // small moves stay in their cell, large ones change cell
+    for (size_t i = 0; i < positions.size(); i++) {
+        float radius = i % 3 == 0 ? 2.0f : 0.01f;
+        positions[i] += glm::vec2(random.Uniform(-radius, radius), random.Uniform(-radius, radius));
+    }
+    grid.Sync(positions.data(), positions.size());
+    CHECK(grid.GetMoves() > 0);
+    CheckQueries(grid, positions, random);
+
+    // instances dropped and added again
+    positions.resize(1500);
+    grid.Sync(positions.data(), positions.size());
+    CheckQueries(grid, positions, random);
+    positions.resize(1800, glm::vec2(105.0f, -35.0f));
+    grid.Sync(positions.data(), positions.size());
+    CheckQueries(grid, positions, random);
+
+    return CheckResult();
+}
@@ -0,0 +1,204 @@
+// InterpolationKernels: the vector variants must give bit-identical results
+// to the scalar one for changedDots, withinDistance and ramp, on odd
+// lengths, on ranges that start off the frame alignment like the
+// Interpolator's workers do, and at the MAX_DISTANCE_DEGREE boundary.
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "aligned.h"
+#include "interpolator.h"
+#include "kernels.h"
+#include "check.h"
+
+// odd lengths and lengths either side of the vector widths exercise the tails
+static const size_t LENGTHS[] = {0, 1, 2, 3, 5, 7, 8, 9, 15, 16, 17, 31, 33, 1037};
+static const size_t NUM_LENGTHS = sizeof(LENGTHS) / sizeof(LENGTHS[0]);
+// offset 0 is aligned and takes the vector loops, the others start mid-line
+static const size_t OFFSETS[] = {0, 1, 2, 3};
+static const size_t NUM_OFFSETS = sizeof(OFFSETS) / sizeof(OFFSETS[0]);
+static const size_t FRAME_SIZE = 1037 + 3;
+
+// deterministic, so a failure repeats
+class Random {
+
+public:
+    explicit Random(uint64_t seed) : m_State(seed) {}
+
+    uint32_t Next(uint32_t range) {
+        m_State = m_State * 6364136223846793005ULL + 1442695040888963407ULL;
+        return uint32_t(m_State >> 33) % range;
+    }
+
+    glm::vec2 Position() {
+        return glm::vec2(float(Next(36000)) / 100.0f - 180.0f, float(Next(18000)) / 100.0f - 90.0f);
+    }
+
+private:
+    uint64_t m_State;
+};
+
+// a frame aligned like the FrameRing's
+class AlignedFrame {
+
+public:
+    AlignedFrame() : m_Dots((glm::vec2*)AlignedAlloc(FRAME_SIZE * sizeof(glm::vec2))) {}
+    ~AlignedFrame() { AlignedFree(m_Dots); }
+
+    glm::vec2* Dots() { return m_Dots; }
+
+private:
+    AlignedFrame(const AlignedFrame&);
+    AlignedFrame& operator=(const AlignedFrame&);
+
+    glm::vec2* m_Dots;
+};
+
+// the vector variants this CPU has
+static std::vector<const InterpolationKernels*> GetVariants() {
+    std::vector<const InterpolationKernels*> variants;
+    const char* names[] = {"sse2", "avx2"};
+    for (size_t k = 0; k < sizeof(names) / sizeof(names[0]); k++) {
+        const InterpolationKernels& selected = SelectKernels(names[k]);
+        if (strcmp(selected.name, names[k]) == 0) {
+            variants.push_back(&selected);
+        }
+    }
+    return variants;
+}
+
+static void TestChangedDots(const InterpolationKernels& kernels, uint64_t seed) {
+    Random random(seed);
+    AlignedFrame last, previous;
+    float nan = std::numeric_limits<float>::quiet_NaN();
+    // none, a few, half and all of the dots change
+    const uint32_t densities[] = {0, 16, 2, 1};
+    for (size_t d = 0; d < sizeof(densities) / sizeof(densities[0]); d++) {
+        for (size_t i = 0; i < FRAME_SIZE; i++) {
+            previous.Dots()[i] = random.Position();
+            last.Dots()[i] = previous.Dots()[i];
+            if (densities[d] == 0 || random.Next(densities[d]) != 0) {
+                // -0 equals 0, so this is no change
+                if (random.Next(8) == 0) {
+                    previous.Dots()[i].x = 0.0f;
+                    last.Dots()[i].x = -0.0f;
+                }
+                continue;
+            }
+            switch (random.Next(4)) {
+                case 0: last.Dots()[i].x += 0.001f; break;
+                case 1: last.Dots()[i].y += 0.001f; break;
+                case 2: last.Dots()[i] += glm::vec2(0.001f, -0.001f); break;
+                // NaN never equals itself, it is always a change
+                default: last.Dots()[i].y = previous.Dots()[i].y = nan; break;
+            }
+        }
+        for (size_t l = 0; l < NUM_LENGTHS; l++) {
+            for (size_t o = 0; o < NUM_OFFSETS; o++) {
+                const glm::vec2* a = last.Dots() + OFFSETS[o];
+                const glm::vec2* b = previous.Dots() + OFFSETS[o];
+                std::vector<uint32_t> expected(LENGTHS[l] + 1), changed(LENGTHS[l] + 1);
+                size_t numExpected = ScalarKernels().changedDots(a, b, LENGTHS[l], expected.data());
+                size_t numChanged = kernels.changedDots(a, b, LENGTHS[l], changed.data());
+                CHECK(numChanged == numExpected);
+                CHECK(memcmp(changed.data(), expected.data(), numExpected * sizeof(uint32_t)) == 0);
+            }
+        }
+    }
+}
+
+static void TestWithinDistance(const InterpolationKernels& kernels, uint64_t seed) {
+    Random random(seed);
+    float nan = std::numeric_limits<float>::quiet_NaN();
+    float above = std::nextafter(MAX_DISTANCE_DEGREE, 1.0f);
+    float below = std::nextafter(MAX_DISTANCE_DEGREE, 0.0f);
+    // moves on both sides of the limit and exactly on it
+    const glm::vec2 moves[] = {
+            glm::vec2(0.0f, 0.0f),
+            glm::vec2(MAX_DISTANCE_DEGREE, 0.0f),
+            glm::vec2(0.0f, -MAX_DISTANCE_DEGREE),
+            glm::vec2(above, 0.0f),
+            glm::vec2(0.0f, -above),
+            glm::vec2(below, 0.0f),
+            glm::vec2(0.6f * MAX_DISTANCE_DEGREE, 0.8f * MAX_DISTANCE_DEGREE),
+            glm::vec2(1.0f, -1.0f),
+            glm::vec2(nan, 0.0f),
+    };
+    size_t numMoves = sizeof(moves) / sizeof(moves[0]);
+
+    // from the origin the move is the exact difference, so the limit itself is within
+    std::vector<glm::vec2> start(numMoves, glm::vec2(0.0f)), end(moves, moves + numMoves);
+    std::vector<uint8_t> within(numMoves);
+    const InterpolationKernels* both[] = {&ScalarKernels(), &kernels};
+    for (size_t k = 0; k < 2; k++) {
+        both[k]->withinDistance(start.data(), end.data(), numMoves, MAX_DISTANCE_DEGREE, within.data());
+        CHECK(within[0] == 1 && within[1] == 1 && within[2] == 1);
+        CHECK(within[3] == 0 && within[4] == 0);
+        CHECK(within[5] == 1);
+        CHECK(within[7] == 0);
+    }
+
+    start.resize(FRAME_SIZE);
+    end.resize(FRAME_SIZE);
+    for (size_t i = 0; i < FRAME_SIZE; i++) {
+        start[i] = random.Position();
+        end[i] = start[i] + moves[random.Next(numMoves)];
+    }
+    for (size_t l = 0; l < NUM_LENGTHS; l++) {
+        for (size_t o = 0; o < NUM_OFFSETS; o++) {
+            std::vector<uint8_t> expected(LENGTHS[l] + 1, 2), actual(LENGTHS[l] + 1, 2);
+            ScalarKernels().withinDistance(start.data() + OFFSETS[o], end.data() + OFFSETS[o], LENGTHS[l],
+                                           MAX_DISTANCE_DEGREE, expected.data());
+            kernels.withinDistance(start.data() + OFFSETS[o], end.data() + OFFSETS[o], LENGTHS[l],
+                                   MAX_DISTANCE_DEGREE, actual.data());
+            // including the byte past the end, which neither may write
+            CHECK(memcmp(actual.data(), expected.data(), actual.size()) == 0);
+        }
+    }
+}
+
+static void TestRamp(const InterpolationKernels& kernels, uint64_t seed) {
+    Random random(seed);
+    // up to the default window of 120 frames, and past the vector widths
+    const size_t numFrames[] = {0, 1, 2, 3, 4, 5, 7, 8, 9, 119, 120};
+    const size_t maxFrames = 120;
+    std::vector<glm::vec2> base(maxFrames * FRAME_SIZE);
+    for (size_t i = 0; i < base.size(); i++) {
+        base[i] = random.Position();
+    }
+    const uint32_t dots[] = {0, 1, 5, FRAME_SIZE - 1};
+    for (size_t n = 0; n < sizeof(numFrames) / sizeof(numFrames[0]); n++) {
+        for (size_t d = 0; d < sizeof(dots) / sizeof(dots[0]); d++) {
+            glm::vec2 delta = (random.Position() - random.Position()) / 1000.0f;
+            std::vector<glm::vec2> expected(base), actual(base);
+            std::vector<glm::vec2*> expectedFrames(maxFrames), actualFrames(maxFrames);
+            for (size_t k = 0; k < maxFrames; k++) {
+                expectedFrames[k] = &expected[k * FRAME_SIZE];
+                actualFrames[k] = &actual[k * FRAME_SIZE];
+            }
+            ScalarKernels().ramp(expectedFrames.data(), numFrames[n], dots[d], delta);
+            kernels.ramp(actualFrames.data(), numFrames[n], dots[d], delta);
+            // every frame and dot, so a stray write shows too
+            CHECK(memcmp(actual.data(), expected.data(), actual.size() * sizeof(glm::vec2)) == 0);
+        }
+    }
+}
+
+int main() {
+    std::vector<const InterpolationKernels*> variants = GetVariants();
+    if (variants.empty()) {
+        fprintf(stderr, "no vector kernels on this CPU, nothing to compare\n");
+    }
+    for (size_t v = 0; v < variants.size(); v++) {
+        for (uint64_t seed = 1; seed <= 3; seed++) {
+            TestChangedDots(*variants[v], seed);
+            TestWithinDistance(*variants[v], seed);
+            TestRamp(*variants[v], seed);
+        }
+    }
+    return CheckResult();
+}
@@ -0,0 +1,103 @@
+// PackKernels: packed positions unpacked the way dots.vs does it come back
+// within half a step, dots outside the region get PACKED_OUTSIDE, and the
+// vector variants match the scalar one.
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "kernels.h"
+#include "check.h"
+
+static const glm::vec2 MINIMUM(-10.0f, -5.0f);
+static const glm::vec2 MAXIMUM(20.0f, 40.0f);
+
+// dots.vs: degrees = packed_origin + aOffset * packed_step
+static glm::vec2 Unpack(const PackedPosition& packed, glm::vec2 step) {
+    return MINIMUM + glm::vec2(packed.x, packed.y) * step;
+}
+
+static void TestRoundTrip(glm::vec2 scale) {
+    glm::vec2 step = 1.0f / scale;
+    std::vector<glm::vec2> positions;
+    for (size_t i = 0; i <= 1000; i++) {
+        // walk the region diagonally, off the step grid
+        float t = float(i) / 1000.0f;
+        positions.push_back(MINIMUM + (MAXIMUM - MINIMUM) * glm::vec2(t, 1.0f - t * t));
+    }
+    // -1 was the sentinel of the unpacked path, it is an ordinary position here
+    positions.push_back(glm::vec2(-1.0f, -1.0f));
+
+    std::vector<PackedPosition> packed(positions.size());
+    ScalarPackKernels().pack(positions.data(), positions.size(), MINIMUM, scale, packed.data());
+    for (size_t i = 0; i < positions.size(); i++) {
+        CHECK(packed[i].x != PACKED_OUTSIDE && packed[i].y != PACKED_OUTSIDE);
+        // half a step, plus float rounding of the degrees either side
+        glm::vec2 error = glm::abs(Unpack(packed[i], step) - positions[i]) / step;
+        CHECK(error.x <= 0.51f && error.y <= 0.51f);
+    }
+
+    // the corners of the region are the first and last step
+    glm::vec2 corners[] = {MINIMUM, MAXIMUM};
+    PackedPosition cornersPacked[2];
+    ScalarPackKernels().pack(corners, 2, MINIMUM, scale, cornersPacked);
+    CHECK(cornersPacked[0].x == 0 && cornersPacked[0].y == 0);
+    CHECK(cornersPacked[1].x == uint16_t(PACKED_STEPS) && cornersPacked[1].y == uint16_t(PACKED_STEPS));
+}
+
+static void TestOutside(glm::vec2 scale) {
+    glm::vec2 step = 1.0f / scale;
+    float nan = std::numeric_limits<float>::quiet_NaN();
+    // less than half a step outside rounds onto the edge, more is outside
+    glm::vec2 positions[] = {
+            MINIMUM - 0.4f * step,
+            MAXIMUM + 0.4f * step,
+            glm::vec2(MINIMUM.x - 0.6f * step.x, 0.0f),
+            glm::vec2(0.0f, MAXIMUM.y + 0.6f * step.y),
+            glm::vec2(-100.0f, 0.0f),
+            glm::vec2(nan, 0.0f),
+            glm::vec2(0.0f, nan),
+    };
+    size_t count = sizeof(positions) / sizeof(positions[0]);
+    std::vector<PackedPosition> packed(count);
+    ScalarPackKernels().pack(positions, count, MINIMUM, scale, packed.data());
+    CHECK(packed[0].x == 0 && packed[0].y == 0);
+    CHECK(packed[1].x == uint16_t(PACKED_STEPS) && packed[1].y == uint16_t(PACKED_STEPS));
+    for (size_t i = 2; i < count; i++) {
+        CHECK(packed[i].x == PACKED_OUTSIDE && packed[i].y == PACKED_OUTSIDE);
+    }
+}
+
+static void TestVariants(glm::vec2 scale) {
+    // odd counts and an unaligned start exercise the vector tails
+    std::vector<glm::vec2> positions;
+    for (size_t i = 0; i < 1037; i++) {
+        float t = float(i) / 1000.0f;
+        positions.push_back(MINIMUM + (MAXIMUM - MINIMUM) * glm::vec2(std::sin(t * 7.0f), std::cos(t * 3.0f)));
+    }
+    std::vector<PackedPosition> expected(positions.size());
+    ScalarPackKernels().pack(positions.data() + 1, positions.size() - 1, MINIMUM, scale, expected.data());
+
+    const char* kernels[] = {"sse2", "avx2"};
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+        const PackKernels& selected = SelectPackKernels(kernels[k]);
+        if (strcmp(selected.name, kernels[k]) != 0) {
+            continue;
+        }
+        std::vector<PackedPosition> packed(positions.size());
+        selected.pack(positions.data() + 1, positions.size() - 1, MINIMUM, scale, packed.data());
+        CHECK(memcmp(packed.data(), expected.data(), (positions.size() - 1) * sizeof(PackedPosition)) == 0);
+    }
+}
+
+int main() {
+    // GlSink's scale for the region
+    glm::vec2 scale = PACKED_STEPS / (MAXIMUM - MINIMUM);
+    TestRoundTrip(scale);
+    TestOutside(scale);
+    TestVariants(scale);
+    return CheckResult();
+}
@@ -0,0 +1,162 @@
+// FrameRing: the copy-on-write frames must always equal a window of full
+// frame copies, through updates, interpolation writes to older frames,
+// LiveSet moves and untracked writes, and GetOldestChanges() must list
+// every dot where the oldest frame changed.
+
+#include <cstring>
+#include <deque>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "ring.h"
+#include "check.h"
+
+static const size_t NUM_FRAMES = 8;
+static const size_t FRAME_SIZE = 1000;
+
+// deterministic, so a failure repeats
+class Random {
+
+public:
+    explicit Random(uint64_t seed) : m_State(seed) {}
+
+    uint32_t Next(uint32_t range) {
+        m_State = m_State * 6364136223846793005ULL + 1442695040888963407ULL;
+        return uint32_t(m_State >> 33) % range;
+    }
+
+    glm::vec2 Position() {
+        return glm::vec2(float(Next(36000)) / 100.0f - 180.0f, float(Next(18000)) / 100.0f - 90.0f);
+    }
+
+private:
+    uint64_t m_State;
+};
+
+typedef std::deque<std::vector<glm::vec2> > Window;
+
+static bool SameFrames(FrameRing& ring, const Window& window) {
+    for (size_t i = 0; i < NUM_FRAMES; i++) {
+        if (memcmp(ring.Frame(i), window[i].data(), FRAME_SIZE * sizeof(glm::vec2)) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void TestAgainstFullCopies(uint64_t seed) {
+    Random random(seed);
+    FrameRing ring(NUM_FRAMES, FRAME_SIZE);
+    std::vector<glm::vec2> frame(FRAME_SIZE);
+    for (size_t i = 0; i < FRAME_SIZE; i++) {
+        frame[i] = random.Position();
+    }
+    ring.Fill(frame.data());
+    Window window(NUM_FRAMES, frame);
+    CHECK(SameFrames(ring, window));
+
+    DirtyRanges changed(FRAME_SIZE);
+    std::vector<glm::vec2> oldest = window.front();
+    size_t partialCopies = 0;
+    for (size_t step = 0; step < 400; step++) {
+        // a few updates most frames, now and then more than a quarter of
+        // the frame so Advance() copies it whole
+        size_t numUpdates = random.Next(10) == 0 ? FRAME_SIZE / 3 : random.Next(20);
+        std::vector<update_t> updates(numUpdates);
+        for (size_t i = 0; i < numUpdates; i++) {
+            glm::vec2 position = random.Position();
+            updates[i].index = random.Next(FRAME_SIZE);
+            updates[i].lon = position.x;
+            updates[i].lat = position.y;
+            window.back()[updates[i].index] = position;
+        }
+        ring.Apply(updates.data(), updates.size());
+
+        // the Interpolator ramps updated dots through the older frames
+        for (size_t i = 0; i < numUpdates && random.Next(2); i++) {
+            uint32_t index = updates[i].index;
+            for (size_t k = 1; k + 1 < NUM_FRAMES; k++) {
+                glm::vec2 position = random.Position();
+                ring.Frame(k)[index] = position;
+                window[k][index] = position;
+            }
+        }
+
+        // LiveSet expiring and reporting dots
+        if (random.Next(4) == 0) {
+            uint32_t from = random.Next(FRAME_SIZE), to = random.Next(FRAME_SIZE);
+            ring.Move(from, to);
+            for (size_t k = 0; k < NUM_FRAMES; k++) {
+                window[k][to] = window[k][from];
+            }
+        }
+        if (random.Next(4) == 0) {
+            uint32_t instance = random.Next(FRAME_SIZE);
+            glm::vec2 position = random.Position();
+            ring.Activate(instance, position);
+            for (size_t k = 0; k < NUM_FRAMES; k++) {
+                window[k][instance] = position;
+            }
+        }
+
+        // now and then the newest frame is written directly
+        if (random.Next(20) == 0) {
+            uint32_t index = random.Next(FRAME_SIZE);
+            glm::vec2 position = random.Position();
+            ring.LastFrame()[index] = position;
+            window.back()[index] = position;
+            ring.Invalidate();
+        }
+        CHECK(SameFrames(ring, window));
+
+        // what FrameQueue::Pop() does with the oldest frame
+        ring.GetOldestChanges(changed);
+        for (size_t i = 0; i < FRAME_SIZE; i++) {
+            if (window.front()[i] != oldest[i]) {
+                CHECK(changed.Count(i + 1) - changed.Count(i) == 1);
+            }
+        }
+        oldest = window.front();
+
+        ring.Advance();
+        window.pop_front();
+        window.push_back(window.back());
+        CHECK(SameFrames(ring, window));
+        if (ring.GetCopiedDots() < FRAME_SIZE) {
+            partialCopies++;
+        }
+    }
+    // the copy-on-write path was taken, not just whole frame copies
+    CHECK(partialCopies > 0);
+}
+
+static void TestCopiedDots() {
+    FrameRing ring(NUM_FRAMES, FRAME_SIZE);
+    std::vector<glm::vec2> frame(FRAME_SIZE, glm::vec2(1.0f, 2.0f));
+    ring.Fill(frame.data());
+    ring.Advance();
+    CHECK(ring.GetCopiedDots() == 0);
+
+    // the touches stay listed until their frame leaves the window
+    update_t updates[] = {{3, 10.0f, 20.0f}, {5, 30.0f, 40.0f}};
+    ring.Apply(updates, 2);
+    for (size_t i = 0; i < NUM_FRAMES; i++) {
+        ring.Advance();
+        CHECK(ring.GetCopiedDots() == (i + 1 < NUM_FRAMES ? 2 : 0));
+    }
+    CHECK(ring.LastFrame()[3] == glm::vec2(20.0f, 10.0f));
+    CHECK(ring.LastFrame()[4] == glm::vec2(1.0f, 2.0f));
+
+    // an untracked write makes the next frames whole copies
+    ring.Invalidate();
+    ring.Advance();
+    CHECK(ring.GetCopiedDots() == FRAME_SIZE);
+}
+
+int main() {
+    TestAgainstFullCopies(1);
+    TestAgainstFullCopies(2);
+    TestCopiedDots();
+    return CheckResult();
+}
@@ -0,0 +1,1074 @@
+// Benchmarks the replay hot paths on a synthetic dataset
+//
+//   tldm-bench [--dots N] [--timestamps N] [--rate R] [--radius DEG]
+//              [--active F] [--snapshot SECONDS] [--idle SECONDS] [--seed N]
+//              [--threads N] [--time SECONDS] [--filter NAME]
+//              [--format json|csv] [--dir DIR] [--keep]
+//   tldm-bench --generate output.{db,tldm} [params]
+//
+// The generator is deterministic: the same parameters and seed give the
+// same dataset on every platform. Each timestamp a dot reports with
+// probability 'rate' and moves up to 'radius' degrees in lat and lon.
+// Only a fraction 'active' of the dots keeps reporting to the end, the
+// others stop for good at a random timestamp, so there are dots for the
+// LiveSet to expire; end_to_end runs with and without expiry show what
+// compacting them saves.
+// Datasets are written in all three storage formats and every benchmark
+// reads the same frames, so results can be compared across formats,
+// dataset sizes and versions. Results go to stdout, the log to stderr.
+// Kernel variants and other paths that must agree are checked against
+// each other first; any difference makes the exit status 1.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <spdlog/spdlog.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+
+#include "camera.h"
+#include "database.h"
+#include "dirty.h"
+#include "frame.h"
+#include "grid.h"
+#include "interpolator.h"
+#include "kernels.h"
+#include "liveset.h"
+#include "order.h"
+#include "pool.h"
+#include "queue.h"
+#include "raster.h"
+#include "render.h"
+#include "tracker.h"
+#include "trajectory.h"
+#include "video.h"
+#include "writer.h"
+
+struct SyntheticParams {
+    uint32_t dots;
+    uint32_t timestamps;
+    double rate;               // chance of a dot reporting at a timestamp
+    double radius;             // largest move per report, degrees
+    double active;             // fraction of dots reporting until the last timestamp
+    uint32_t snapshotSeconds;
+    uint64_t seed;
+    glm::vec2 centre;          // lon, lat
+    float spread;              // dots start within +-spread degrees of the centre
+    uint32_t start;            // first timestamp
+};
+
+// splitmix64, unlike the std distributions it gives the same numbers everywhere
+class Random {
+
+public:
+    explicit Random(uint64_t seed) : m_State(seed) {}
+
+    uint64_t Next() {
+        uint64_t z = (m_State += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+    // [0, 1)
+    double Uniform() {
+        return (Next() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    // [-1, 1)
+    double Signed() {
+        return Uniform() * 2.0 - 1.0;
+    }
+
+private:
+    uint64_t m_State;
+};
+
+static uint64_t Generate(const SyntheticParams& params, FrameWriter& writer) {
+    Random random(params.seed);
+    std::vector<glm::vec2> frame(params.dots);
+    for (uint32_t slot = 0; slot < params.dots; slot++) {
+        frame[slot] = params.centre + glm::vec2(float(random.Signed() * params.spread),
+                                                float(random.Signed() * params.spread));
+        writer.AddSlot("dot" + std::to_string(slot), slot);
+    }
+    // its own generator, so with every dot active the dataset is as before
+    Random lifetimes(~params.seed);
+    std::vector<uint32_t> stops(params.dots, params.timestamps);
+    for (uint32_t slot = 0; slot < params.dots; slot++) {
+        if (lifetimes.Uniform() >= params.active) {
+            stops[slot] = uint32_t(lifetimes.Uniform() * params.timestamps);
+        }
+    }
+
+    // gaps between reporting dots are geometric, so only reporting dots cost time
+    double logMiss = params.rate < 1.0 ? std::log(1.0 - params.rate) : 0.0;
+    std::vector<update_t> delta;
+    uint64_t numUpdates = 0;
+    for (uint32_t i = 0; i < params.timestamps; i++) {
+        uint32_t timestamp = params.start + i;
+        if (i == 0 || timestamp % params.snapshotSeconds == 0) {
+            writer.AddSnapshot(timestamp, frame.data(), frame.size());
+        }
+        delta.clear();
+        for (double slot = -1.0;;) {
+            slot += params.rate < 1.0 ? 1.0 + std::floor(std::log(1.0 - random.Uniform()) / logMiss) : 1.0;
+            if (slot >= params.dots) {
+                break;
+            }
+            if (i >= stops[(uint32_t)slot]) {
+                continue;
+            }
+            glm::vec2& position = frame[(uint32_t)slot];
+            position += glm::vec2(float(random.Signed() * params.radius), float(random.Signed() * params.radius));
+            update_t update;
+            update.index = (uint32_t)slot;
+            update.lat = position.y;
+            update.lon = position.x;
+            delta.push_back(update);
+        }
+        writer.AddDelta(timestamp, delta.data(), delta.size());
+        numUpdates += delta.size();
+    }
+    writer.Finish();
+    return numUpdates;
+}
+
+struct Result {
+    std::string name;
+    std::string variant;
+    uint64_t iterations;
+    double seconds;
+    uint64_t items;
+    uint64_t bytes;
+};
+
+// time spent in the measured part of an iteration
+class Stopwatch {
+
+public:
+    Stopwatch() : m_Seconds(0.0) {}
+
+    void Start() {
+        m_Start = std::chrono::steady_clock::now();
+    }
+
+    void Stop() {
+        m_Seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - m_Start).count();
+    }
+
+    double GetSeconds() {
+        return m_Seconds;
+    }
+
+private:
+    std::chrono::steady_clock::time_point m_Start;
+    double m_Seconds;
+};
+
+class Bench {
+
+public:
+    Bench(double minSeconds, const std::string& filter) : m_MinSeconds(minSeconds), m_Filter(filter), m_Failures(0) {}
+
+    bool Enabled(const std::string& name) {
+        return m_Filter.empty() || name.find(m_Filter) != std::string::npos;
+    }
+
+    // Calls body(watch, items, bytes) until the watch has run for the
+    // minimum time. The body starts and stops the watch around the part
+    // to measure and adds the items and bytes it processed.
+    template<typename Body>
+    void Run(const std::string& name, const std::string& variant, Body body) {
+        if (!Enabled(name)) {
+            return;
+        }
+        Result result;
+        result.name = name;
+        result.variant = variant;
+        result.iterations = 0;
+        result.items = 0;
+        result.bytes = 0;
+        Stopwatch watch;
+        while (watch.GetSeconds() < m_MinSeconds) {
+            body(watch, result.items, result.bytes);
+            result.iterations++;
+        }
+        result.seconds = watch.GetSeconds();
+        spdlog::info("{:<16} {:<14} {:>10.2f} us/iteration {:>10.2f} ns/item", name, variant,
+                     result.seconds / result.iterations * 1e6,
+                     result.items ? result.seconds / result.items * 1e9 : 0.0);
+        m_Results.push_back(result);
+    }
+
+    // a variant gave different results, logged by the caller; the results
+    // are still written but the exit status is 1
+    void Fail() {
+        m_Failures++;
+    }
+
+    size_t GetFailures() {
+        return m_Failures;
+    }
+
+    // a measurement without timing, e.g. a file size
+    void Add(const std::string& name, const std::string& variant, uint64_t items, uint64_t bytes,
+             double seconds = 0.0) {
+        if (!Enabled(name)) {
+            return;
+        }
+        Result result = {name, variant, 1, seconds, items, bytes};
+        m_Results.push_back(result);
+    }
+
+    void WriteCsv(FILE* file) {
+        fprintf(file, "name,variant,iterations,seconds,us_per_iteration,items,ns_per_item,items_per_second,"
+                      "bytes,bytes_per_item,mb_per_second\n");
+        for (size_t i = 0; i < m_Results.size(); i++) {
+            const Result& r = m_Results[i];
+            fprintf(file, "%s,%s,%llu,%.6f,%.3f,%llu,%.3f,%.1f,%llu,%.3f,%.3f\n", r.name.c_str(), r.variant.c_str(),
+                    (unsigned long long)r.iterations, r.seconds, PerIteration(r), (unsigned long long)r.items,
+                    PerItem(r), ItemsPerSecond(r), (unsigned long long)r.bytes, BytesPerItem(r), MegabytesPerSecond(r));
+        }
+    }
+
+    void WriteJson(FILE* file, const SyntheticParams& params, size_t threads) {
+        fprintf(file, "{\n  \"params\": {\"dots\": %u, \"timestamps\": %u, \"rate\": %g, \"radius\": %g, "
+                      "\"active\": %g, \"snapshot\": %u, \"seed\": %llu, \"threads\": %zu},\n  \"results\": [\n",
+                params.dots, params.timestamps, params.rate, params.radius, params.active,
+                params.snapshotSeconds, (unsigned long long)params.seed, threads);
+        for (size_t i = 0; i < m_Results.size(); i++) {
+            const Result& r = m_Results[i];
+            fprintf(file, "    {\"name\": \"%s\", \"variant\": \"%s\", \"iterations\": %llu, \"seconds\": %.6f, "
+                          "\"us_per_iteration\": %.3f, \"items\": %llu, \"ns_per_item\": %.3f, "
+                          "\"items_per_second\": %.1f, \"bytes\": %llu, \"bytes_per_item\": %.3f, "
+                          "\"mb_per_second\": %.3f}%s\n",
+                    r.name.c_str(), r.variant.c_str(), (unsigned long long)r.iterations, r.seconds, PerIteration(r),
+                    (unsigned long long)r.items, PerItem(r), ItemsPerSecond(r), (unsigned long long)r.bytes,
+                    BytesPerItem(r), MegabytesPerSecond(r), i + 1 < m_Results.size() ? "," : "");
+        }
+        fprintf(file, "  ]\n}\n");
+    }
+
+private:
+    static double PerIteration(const Result& r) {
+        return r.iterations ? r.seconds / r.iterations * 1e6 : 0.0;
+    }
+
+    static double PerItem(const Result& r) {
+        return r.items ? r.seconds / r.items * 1e9 : 0.0;
+    }
+
+    static double ItemsPerSecond(const Result& r) {
+        return r.seconds > 0.0 ? r.items / r.seconds : 0.0;
+    }
+
+    static double BytesPerItem(const Result& r) {
+        return r.items ? double(r.bytes) / r.items : 0.0;
+    }
+
+    static double MegabytesPerSecond(const Result& r) {
+        return r.seconds > 0.0 ? r.bytes / r.seconds / 1e6 : 0.0;
+    }
+
+    double m_MinSeconds;
+    std::string m_Filter;
+    std::vector<Result> m_Results;
+    size_t m_Failures;
+};
+
+static uint64_t FileSize(const std::string& filename) {
+    FILE* file = fopen(filename.c_str(), "rb");
+    if (file == NULL) {
+        return 0;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fclose(file);
+    return size > 0 ? size : 0;
+}
+
+// reading frames through FrameProvider, per storage format
+static void BenchSource(Bench& bench, const std::string& filename, const std::string& variant, uint64_t seed) {
+    FrameProvider frameProvider(filename.c_str());
+    std::vector<uint32_t> timestamps = frameProvider.GetTimestamps();
+    std::vector<uint32_t> snapshots = frameProvider.GetSnapshotTimestamps();
+    size_t frameSize = frameProvider.GetFrameSize();
+    std::vector<glm::vec2> frame(frameSize);
+
+    bench.Run("snapshot", variant, [&](Stopwatch& watch, uint64_t& items, uint64_t& bytes) {
+        watch.Start();
+        size_t numLocations = frameProvider.GetSnapshot(snapshots[0], frame.data(), frame.size());
+        watch.Stop();
+        items += numLocations;
+        bytes += numLocations * sizeof(glm::vec2);
+    });
+
+    size_t index = 0;
+    bench.Run("fill_delta", variant, [&](Stopwatch& watch, uint64_t& items, uint64_t& bytes) {
+        watch.Start();
+        size_t numUpdates = frameProvider.FillDelta(timestamps[index], frame.data(), frameSize);
+        watch.Stop();
+        index = (index + 1) % timestamps.size();
+        items += numUpdates;
+        bytes += numUpdates * sizeof(update_t);
+    });
+
+    bench.Run("next", variant, [&](Stopwatch& watch, uint64_t& items, uint64_t& bytes) {
+        watch.Start();
+        frameProvider.Next(frame.data());
+        watch.Stop();
+        items++;
+    });
+
+    Random random(seed);
+    bench.Run("seek", variant, [&](Stopwatch& watch, uint64_t& items, uint64_t& bytes) {
+        uint32_t target = timestamps[random.Next() % timestamps.size()];
+        watch.Start();
+        frameProvider.Seek(target, frame.data());
+        watch.Stop();
+        items++;
+    });
+}
+
+// DatabaseSource reading rows with statements and with incremental blob
+// reads into its own buffers, which must give the same frames
+static void BenchBlobReads(Bench& bench, const std::string& filename) {
+    if (!bench.Enabled("blob_snapshot") && !bench.Enabled("blob_delta")) {
+        return;
+    }
+    DatabaseSource query(filename.c_str(), false);
+    DatabaseSource incremental(filename.c_str(), true);
+    std::vector<uint32_t> timestamps = query.GetTimestamps();
+    std::vector<uint32_t> snapshots = query.GetSnapshotTimestamps();
+    size_t frameSize = query.GetFrameSize();
+    std::vector<glm::vec2> expected(frameSize), frame(frameSize);
+    size_t numLocations = query.GetSnapshot(snapshots[0], expected.data(), frameSize);
+    if (incremental.GetSnapshot(snapshots[0], frame.data(), frameSize) != numLocations ||
+        memcmp(frame.data(), expected.data(), numLocations * sizeof(glm::vec2)) != 0) {
+        spdlog::error("incremental snapshot differs from the query's");
+        bench.Fail();
+    }
+    for (size_t i = 0; i < timestamps.size(); i++) {
+        size_t numExpected, numUpdates;
+        std::vector<update_t> updates;
+        const update_t* data = query.GetDelta(timestamps[i], numExpected);
+        updates.assign(data, data + numExpected);
+        data = incremental.GetDelta(timestamps[i], numUpdates);
+        if (numUpdates != numExpected || memcmp(data, updates.data(), numUpdates * sizeof(update_t)) != 0) {
+            spdlog::error("incremental delta at {} differs from the query's", timestamps[i]);
+            bench.Fail();
+            break;
+        }
+    }
+
+    DatabaseSource* sources[] = {&query, &incremental};
+    const char* paths[] = {"query", "incremental"};
+    for (size_t s = 0; s < 2; s++) {
+        DatabaseSource& source = *sources[s];
+        std::string variant = paths[s];
+        bench.Run("blob_snapshot", variant, [&](Stopwatch& watch, uint64_t& items, uint64_t& bytes) {
+            watch.Start();
+            size_t numRead = source.GetSnapshot(snapshots[0], frame.data(), frameSize);
+            watch.Stop();
+            items += numRead;
+            bytes += numRead * sizeof(glm::vec2);
+        });
+        size_t index = 0;
+        bench.Run("blob_delta", variant, [&](Stopwatch& watch, uint64_t& items, uint64_t& bytes) {
+            size_t numUpdates;
+            watch.Start();
+            source.GetDelta(timestamps[index], numUpdates);
+            watch.Stop();
+            index = (index + 1) % timestamps.size();
+            items += numUpdates;
+            bytes += numUpdates * sizeof(update_t);
+        });
+    }
+}
+
+// Everything after decoding, with the deltas already in memory. Frames are
+// replayed in a loop; a wrap to the first delta is just a big jump.
+class EngineBench {
+
+public:
+    EngineBench(Bench& bench, FrameProvider& frameProvider, uint32_t idleSeconds, size_t threads) :
+            m_Bench(bench),
+            m_FrameProvider(frameProvider),
+            m_FrameSize(frameProvider.GetFrameSize()),
+            m_Idle(idleSeconds),
+            m_Threads(threads),
+            m_Snapshot(m_FrameSize),
+            m_Output(m_FrameSize)
+    {
+        std::vector<uint32_t> timestamps = frameProvider.GetTimestamps();
+        m_Timestamps = timestamps;
+        m_Deltas.resize(timestamps.size());
+        for (size_t i = 0; i < timestamps.size(); i++) {
+            frameProvider.ReadDelta(timestamps[i], m_Deltas[i]);
+        }
+        frameProvider.GetSnapshot(timestamps[0], m_Snapshot.data(), m_FrameSize);
+    }
+
+    // trajectories: where the .tldt made from the deltas goes
+    void Run(const std::string& trajectories) {
+        BenchWindow();
+        BenchTracker();
+        BenchTrajectory(trajectories);
+        BenchLiveSet();
+        BenchGrid();
+        BenchPack();
+        BenchSwizzle();
+        BenchDirty();
+        BenchOrder();
+        BenchRaster();
+    }
+
+private:
+    void BenchWindow() {
+        {
+            FrameQueue frameQueue(m_FrameProvider, 120);
+            size_t index = 0;
+            m_Bench.Run("queue_pop", "window", [&](Stopwatch& watch, uint64_t& items, uint64_t& bytes) {
+                const std::vector<update_t>& delta = NextDelta(index);
+                frameQueue.Apply(delta.data(), delta.size());
+                watch.Start();
+                frameQueue.Pop(m_Output.data());
+                watch.Stop();
+                items += m_FrameSize;
+                bytes += m_FrameSize * sizeof(glm::vec2);
+            });
+        }
+
+        // every kernel the CPU has on one thread, then the best one on more threads
+        const char* kernels[] = {"scalar", "sse2", "avx2"};
+        for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+            const InterpolationKernels& selected = SelectKernels(kernels[k]);
+            if (strcmp(selected.name, kernels[k]) == 0) {
+                BenchInterpolate(selected, 1);
+            }
+        }
+        for (size_t threads = 2; threads < 2 * m_Threads; threads *= 2) {
+            BenchInterpolate(DetectKernels(), std::min(threads, m_Threads));
+        }
+
+        WorkerPool pool(m_Threads);
+        std::vector<uint32_t> idles = GetIdles();
+        for (size_t i = 0; i < idles.size(); i++) {
+            FrameQueue frameQueue(m_FrameProvider, 120);
+            Interpolator interpolator(frameQueue, DetectKernels(), &pool);
+            LiveSet liveSet(m_FrameSize, idles[i]);
+            Reset(liveSet, frameQueue);
+            size_t index = 0;
+            RunFromMiddle("end_to_end", "window/idle " + std::to_string(idles[i]),
+                          [&](Stopwatch& watch, uint64_t& items, uint64_t& bytes) {
+                const std::vector<update_t>& delta = NextDelta(index);
+                watch.Start();
+                const update_t* updates = liveSet.Remap(m_Timestamps[index], delta.data(), delta.size(),
+                                                        frameQueue);
+                frameQueue.Apply(updates, delta.size());
+                liveSet.Expire(m_Timestamps[index], frameQueue);
+                interpolator.Interpolate(liveSet.GetActive());
+                frameQueue.Pop(m_Output.data(), liveSet.GetActive());
+                watch.Stop();
+                items += liveSet.GetActive();
+            });
+        }
+    }
+
+    // Every frame popped with the given kernels and threads must be the same
+    // as with the scalar kernels on one thread, over a few windows of deltas.
+    void CheckInterpolate(const InterpolationKernels& kernels, size_t threads) {
+        WorkerPool pool(threads);
+        FrameQueue expectedQueue(m_FrameProvider, 120);
+        FrameQueue frameQueue(m_FrameProvider, 120);
+        Interpolator expectedInterpolator(expectedQueue, ScalarKernels(), NULL);
+        Interpolator interpolator(frameQueue, kernels, &pool);
+        std::vector<glm::vec2> expected(m_FrameSize);
+        size_t numFrames = std::min<size_t>(m_Deltas.size(), 4 * 120);
+        for (size_t i = 0; i < numFrames; i++) {
+            expectedQueue.Apply(m_Deltas[i].data(), m_Deltas[i].size());
+            expectedInterpolator.Interpolate();
+            expectedQueue.Pop(expected.data());
+            frameQueue.Apply(m_Deltas[i].data(), m_Deltas[i].size());
+            interpolator.Interpolate();
+            frameQueue.Pop(m_Output.data());
+            if (memcmp(m_Output.data(), expected.data(), m_FrameSize * sizeof(glm::vec2)) != 0) {
+                spdlog::error("{} interpolation on {} threads differs from scalar at frame {}", kernels.name,
+                              threads, i);
+                m_Bench.Fail();
+                return;
+            }
+        }
+    }
+
+    void BenchInterpolate(const InterpolationKernels& kernels, size_t threads) {
+        if (!m_Bench.Enabled("interpolate")) {
+            return;
+        }
+        if (strcmp(kernels.name, ScalarKernels().name) != 0 || threads > 1) {
+            CheckInterpolate(kernels, threads);
+        }
+        WorkerPool pool(threads);
+        FrameQueue frameQueue(m_FrameProvider, 120);
+        Interpolator interpolator(frameQueue, kernels, &pool);
+        size_t index = 0;
+        m_Bench.Run("interpolate", std::string(kernels.name) + "/" + std::to_string(threads) + "t",
+                    [&](Stopwatch& watch, uint64_t& items, uint64_t& bytes) {
+            const std::vector<update_t>& delta = NextDelta(index);
+            frameQueue.Apply(delta.data(), delta.size());
+            watch.Start();
+            interpolator.Interpolate();
+            watch.Stop();
+            frameQueue.Pop(m_Output.data());
+            items += m_FrameSize;
+        });
+    }
+
+    void BenchTracker() {
+        SegmentTracker tracker(m_FrameProvider, 120);
+        size_t index = 0;
+        m_Bench.Run("tracker", "segment", [&](Stopwatch& watch, uint64_t& items, uint64_t& bytes) {
+            const std::vector<update_t>& delta = NextDelta(index);
+            watch.Start();
+            tracker.Apply(delta.data(), delta.size());
+            tracker.Pop(m_Output.data());
+            watch.Stop();
+            items += delta.size();
+        });
+
+        std::vector<uint32_t> idles = GetIdles();
+        for (size_t i = 0; i < idles.size(); i++) {
+            LiveSet liveSet(m_FrameSize, idles[i]);
+            Reset(liveSet, tracker);
+            index = 0;
+            RunFromMiddle("end_to_end", "segment/idle " + std::to_string(idles[i]),
+                          [&](Stopwatch& watch, uint64_t& items, uint64_t& bytes) {
+                const std::vector<update_t>& delta = NextDelta(index);
+                watch.Start();
+                const update_t* updates = liveSet.Remap(m_Timestamps[index], delta.data(), delta.size(), tracker);
+                tracker.Apply(updates, delta.size());
+                liveSet.Expire(m_Timestamps[index], tracker);
+                tracker.Pop(m_Output.data(), liveSet.GetActive());
+                watch.Stop();
+                items += liveSet.GetActive();
+            });
+        }
+    }
+
+    // the trajectory engine, items are visible dots; nothing is decoded or
+    // applied, so this compares with end_to_end of the other engines
+    void BenchTrajectory(const std::string& filename) {
+        if (!m_Bench.Enabled("trajectory")) {
+            return;
+        }
+        {
+            TrajectoryWriter writer(filename.c_str(), m_FrameSize);
+            writer.AddSnapshot(m_Timestamps[0], m_Snapshot.data(), m_FrameSize);
+            for (size_t i = 0; i < m_Deltas.size(); i++) {
+                writer.AddDelta(m_Timestamps[i], m_Deltas[i].data(), m_Deltas[i].size());
+            }
+            writer.Finish();
+        }
+        TrajectoryTracker tracker(filename, m_FrameSize, m_Idle);
+        tracker.Seek(m_Timestamps[0]);
+        size_t index = 0;
+        m_Bench.Run("trajectory", "evaluate", [&](Stopwatch& watch, uint64_t& items, uint64_t& bytes) {
+            index = (index + 1) % m_Timestamps.size();
+            watch.Start();
+            size_t numDots = tracker.Evaluate(m_Timestamps[index]);
+            tracker.Pop(m_Output.data(), numDots);
+            watch.Stop();
+            items += numDots;
+        });
+        m_Bench.Run("trajectory", "seek", [&](Stopwatch& watch, uint64_t& items, uint64_t& bytes) {
+            index = (index + m_Timestamps.size() / 3) % m_Timestamps.size();
+            watch.Start();
+            tracker.Seek(m_Timestamps[index]);
+            watch.Stop();
+            items += m_FrameSize;
+        });
+    }
+
+    // the bookkeeping for sparse data on its own, items are live dots
+    void BenchLiveSet() {
+        SegmentTracker tracker(m_FrameProvider, 120);
+        LiveSet liveSet(m_FrameSize, m_Idle);
+        Reset(liveSet, tracker);
+        size_t index = 0;
+        RunFromMiddle("liveset", "idle " + std::to_string(m_Idle), [&](Stopwatch& watch, uint64_t& items,
+                                                                        uint64_t& bytes) {
+            const std::vector<update_t>& delta = NextDelta(index);
+            watch.Start();
+            const update_t* updates = liveSet.Remap(m_Timestamps[index], delta.data(), delta.size(), tracker);
+            watch.Stop();
+            tracker.Apply(updates, delta.size());
+            watch.Start();
+            liveSet.Expire(m_Timestamps[index], tracker);
+            watch.Stop();
+            tracker.Pop(m_Output.data(), liveSet.GetActive());
+            items += liveSet.GetActive();
+        });
+    }
+
+    // culling and density cells on the tracker output
+    void BenchGrid() {
+        SegmentTracker tracker(m_FrameProvider, 120);
+        glm::vec2 minimum, maximum;
+        Bounds(minimum, maximum);
+        SpatialGrid grid(minimum, maximum);
+        grid.Sync(m_Snapshot.data(), m_FrameSize);
+        glm::vec2 quarter = (maximum - minimum) * 0.25f;
+        size_t index = 0;
+        // items are dots that changed cell, the rest only costs a compare
+        m_Bench.Run("grid_sync", "256", [&](Stopwatch& watch, uint64_t& items, uint64_t& bytes) {
+            const std::vector<update_t>& delta = NextDelta(index);
+            tracker.Apply(delta.data(), delta.size());
+            tracker.Pop(m_Output.data());
+            size_t moves = grid.GetMoves();
+            watch.Start();
+            grid.Sync(m_Output.data(), m_FrameSize);
+            watch.Stop();
+            items += grid.GetMoves() - moves;
+        });
+        std::vector<glm::vec2> visible(m_FrameSize);
+        std::vector<float> weights(m_FrameSize);
+        m_Bench.Run("grid_query", "half view", [&](Stopwatch& watch, uint64_t& items, uint64_t& bytes) {
+            watch.Start();
+            items += grid.Query(minimum + quarter, maximum - quarter, visible.data());
+            watch.Stop();
+        });
+        for (int level = 0; level <= 4; level += 2) {
+            m_Bench.Run("grid_density", "level " + std::to_string(level),
+                        [&](Stopwatch& watch, uint64_t& items, uint64_t& bytes) {
+                watch.Start();
+                items += grid.QueryDensity(minimum, maximum, level, visible.data(), weights.data());
+                watch.Stop();
+            });
+        }
+    }
+
+    // GlSink's packed upload over the area of the data, items are dots and
+    // bytes the packed size. Every variant is checked against the scalar
+    // one, and the round trip against half a step.
+    void BenchPack() {
+        if (!m_Bench.Enabled("pack")) {
+            return;
+        }
+        glm::vec2 minimum, maximum;
+        Bounds(minimum, maximum);
+        glm::vec2 scale = PACKED_STEPS / (maximum - minimum);
+        std::vector<PackedPosition> expected(m_FrameSize), packed(m_FrameSize);
+        ScalarPackKernels().pack(m_Snapshot.data(), m_FrameSize, minimum, scale, expected.data());
+
+        glm::vec2 step = 1.0f / scale;
+        float maxError = 0.0f;
+        for (size_t i = 0; i < m_FrameSize; i++) {
+            if (expected[i].x == PACKED_OUTSIDE) {
+                continue;
+            }
+            glm::vec2 position = minimum + glm::vec2(expected[i].x, expected[i].y) * step;
+            glm::vec2 error = glm::abs(position - m_Snapshot[i]) / step;
+            maxError = std::max(maxError, std::max(error.x, error.y));
+        }
+        spdlog::info("Packed round trip error up to {:.3f} steps of {:.6f} x {:.6f} degrees{}", maxError,
+                     step.x, step.y, maxError > 0.501f ? ", more than half a step" : "");
+
+        const char* kernels[] = {"scalar", "sse2", "avx2"};
+        for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+            const PackKernels& selected = SelectPackKernels(kernels[k]);
+            if (strcmp(selected.name, kernels[k]) != 0) {
+                continue;
+            }
+            selected.pack(m_Snapshot.data(), m_FrameSize, minimum, scale, packed.data());
+            if (memcmp(packed.data(), expected.data(), m_FrameSize * sizeof(PackedPosition)) != 0) {
+                spdlog::error("{} pack differs from scalar", selected.name);
+                m_Bench.Fail();
+            }
+            m_Bench.Run("pack", selected.name, [&](Stopwatch& watch, uint64_t& items, uint64_t& bytes) {
+                watch.Start();
+                selected.pack(m_Snapshot.data(), m_FrameSize, minimum, scale, packed.data());
+                watch.Stop();
+                items += m_FrameSize;
+                bytes += m_FrameSize * sizeof(PackedPosition);
+            });
+        }
+    }
+
+    // snapshot rows to frames, in place like DatabaseSource does
+    void BenchSwizzle() {
+        if (!m_Bench.Enabled("swizzle")) {
+            return;
+        }
+        // the snapshot as stored: lat, lon pairs
+        std::vector<glm::vec2> stored(m_FrameSize), expected(m_FrameSize);
+        for (size_t i = 0; i < m_FrameSize; i++) {
+            stored[i] = glm::vec2(m_Snapshot[i].y, m_Snapshot[i].x);
+        }
+        ScalarSwizzleKernels().swizzle((const float*)stored.data(), m_FrameSize, expected.data());
+
+        const char* kernels[] = {"scalar", "sse2", "avx2"};
+        for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+            const SwizzleKernels& selected = SelectSwizzleKernels(kernels[k]);
+            if (strcmp(selected.name, kernels[k]) != 0) {
+                continue;
+            }
+            m_Output = stored;
+            selected.swizzle((const float*)m_Output.data(), m_FrameSize, m_Output.data());
+            if (memcmp(m_Output.data(), expected.data(), m_FrameSize * sizeof(glm::vec2)) != 0) {
+                spdlog::error("{} swizzle differs from scalar", selected.name);
+                m_Bench.Fail();
+            }
+            m_Bench.Run("swizzle", selected.name, [&](Stopwatch& watch, uint64_t& items, uint64_t& bytes) {
+                // swapping twice restores the frame, so every run starts alike
+                watch.Start();
+                selected.swizzle((const float*)m_Output.data(), m_FrameSize, m_Output.data());
+                watch.Stop();
+                items += m_FrameSize;
+                bytes += m_FrameSize * sizeof(glm::vec2);
+            });
+        }
+    }
+
+    // GlSink's partial uploads: the tracker's changed dots merged into the
+    // three regions and coalesced, items are dots per frame and bytes those
+    // in the ranges. The ranges are copied into a region outside the timing
+    // and checked against the whole frame.
+    void BenchDirty() {
+        if (!m_Bench.Enabled("dirty")) {
+            return;
+        }
+        SegmentTracker tracker(m_FrameProvider, 120);
+        std::vector<DirtyRanges> regionChanges(3, DirtyRanges(m_FrameSize));
+        std::vector<std::vector<glm::vec2> > regions(3, std::vector<glm::vec2>(m_FrameSize));
+        for (size_t i = 0; i < regionChanges.size(); i++) {
+            regionChanges[i].MarkAll();
+        }
+        size_t index = 0, frames = 0, mismatches = 0;
+        uint64_t uploaded = 0, full = 0;
+        m_Bench.Run("dirty", "gap 4", [&](Stopwatch& watch, uint64_t& items, uint64_t& bytes) {
+            const std::vector<update_t>& delta = NextDelta(index);
+            tracker.Apply(delta.data(), delta.size());
+            tracker.Pop(m_Output.data());
+            size_t region = frames++ % regions.size();
+            watch.Start();
+            for (size_t i = 0; i < regionChanges.size(); i++) {
+                regionChanges[i].Merge(tracker.GetChanged());
+            }
+            const std::vector<DirtyRanges::Range>& ranges = regionChanges[region].Coalesce(m_FrameSize, 4);
+            watch.Stop();
+            for (size_t i = 0; i < ranges.size(); i++) {
+                std::copy(m_Output.begin() + ranges[i].begin, m_Output.begin() + ranges[i].end,
+                          regions[region].begin() + ranges[i].begin);
+                bytes += (ranges[i].end - ranges[i].begin) * sizeof(glm::vec2);
+                uploaded += (ranges[i].end - ranges[i].begin) * sizeof(glm::vec2);
+            }
+            regionChanges[region].Clear();
+            if (regions[region] != m_Output) {
+                mismatches++;
+            }
+            full += m_FrameSize * sizeof(glm::vec2);
+            items += m_FrameSize;
+        });
+        if (mismatches) {
+            spdlog::error("{} of {} frames differ after uploading the changed ranges", mismatches, frames);
+            m_Bench.Fail();
+        }
+        spdlog::info("Changed ranges took {:.1f}% of the full uploads, {:.1f} KB saved per frame",
+                     100.0 * uploaded / std::max<uint64_t>(full, 1), (full - uploaded) / 1e3 / std::max<size_t>(frames, 1));
+    }
+
+    // tldm-convert --hilbert: the same deltas and culling by slot and by
+    // slots along the curve. Scatter items are updates, query items dots in
+    // view. The dots in view are also counted as ranges, what a partial
+    // upload or a contiguous cull would deal with.
+    void BenchOrder() {
+        if (!m_Bench.Enabled("order_scatter") && !m_Bench.Enabled("order_query")) {
+            return;
+        }
+        SlotOrder order(m_FrameSize);
+        order.AddFrame(m_Snapshot.data(), m_FrameSize);
+        for (size_t i = 0; i < m_Deltas.size(); i++) {
+            order.AddDelta(m_Deltas[i].data(), m_Deltas[i].size());
+        }
+        order.Build();
+        std::vector<std::vector<update_t> > deltas(m_Deltas.size());
+        for (size_t i = 0; i < m_Deltas.size(); i++) {
+            order.ReorderDelta(m_Deltas[i].data(), m_Deltas[i].size(), deltas[i]);
+        }
+        std::vector<glm::vec2> snapshot(m_FrameSize);
+        order.ReorderFrame(m_Snapshot.data(), m_FrameSize, snapshot.data());
+
+        glm::vec2 minimum, maximum;
+        Bounds(minimum, maximum);
+        glm::vec2 quarter = (maximum - minimum) * 0.25f;
+        const char* variants[] = {"slot", "hilbert"};
+        for (size_t v = 0; v < 2; v++) {
+            const std::vector<std::vector<update_t> >& variantDeltas = v ? deltas : m_Deltas;
+            const std::vector<glm::vec2>& frame = v ? snapshot : m_Snapshot;
+            m_Output = frame;
+            size_t index = 0;
+            m_Bench.Run("order_scatter", variants[v], [&](Stopwatch& watch, uint64_t& items, uint64_t& bytes) {
+                const std::vector<update_t>& delta = variantDeltas[index];
+                index = (index + 1) % variantDeltas.size();
+                watch.Start();
+                FrameProvider::ApplyDelta(delta.data(), delta.size(), m_Output.data());
+                watch.Stop();
+                items += delta.size();
+            });
+
+            SpatialGrid grid(minimum, maximum);
+            grid.Sync(frame.data(), m_FrameSize);
+            std::vector<glm::vec2> visible(m_FrameSize);
+            m_Bench.Run("order_query", variants[v], [&](Stopwatch& watch, uint64_t& items, uint64_t& bytes) {
+                watch.Start();
+                items += grid.Query(minimum + quarter, maximum - quarter, visible.data());
+                watch.Stop();
+            });
+
+            DirtyRanges inView(m_FrameSize);
+            glm::vec2 viewMinimum = minimum + quarter, viewMaximum = maximum - quarter;
+            for (size_t i = 0; i < m_FrameSize; i++) {
+                if (frame[i].x >= viewMinimum.x && frame[i].y >= viewMinimum.y &&
+                    frame[i].x <= viewMaximum.x && frame[i].y <= viewMaximum.y) {
+                    inView.Mark(i);
+                }
+            }
+            size_t numRanges = inView.Coalesce(m_FrameSize, 4).size();
+            spdlog::info("Ordered by {}, the {} dots in half the view form {} ranges", variants[v],
+                         inView.Count(), numRanges);
+        }
+    }
+
+    // tldm-export: the CPU rasterizer and the y4m stream, items are dots
+    void BenchRaster() {
+        if (!m_Bench.Enabled("raster") && !m_Bench.Enabled("video")) {
+            return;
+        }
+        size_t width = 1920, height = 1080;
+        WorkerPool pool(m_Threads);
+        Rasterizer rasterizer(width, height, &pool);
+        glm::vec2 minimum, maximum;
+        Bounds(minimum, maximum);
+        RenderParam render;
+        // camera over the middle of the data, high enough to see all of it
+        glm::vec2 centre = (minimum + maximum) * 0.5f;
+        float z = (maximum.y - minimum.y) * 0.5f / std::tan(glm::radians(22.5f));
+        Camera camera(glm::vec3(centre.x * render.GetXScale(), centre.y, z));
+        render.UpdateDotScale(z);
+        glm::mat4 projection = glm::perspective(glm::radians(45.0f), float(width) / float(height), 0.0001f, 1000.0f);
+        glm::mat4 view = camera.GetViewMatrix();
+        m_Bench.Run("raster", std::to_string(width) + "x" + std::to_string(height),
+                    [&](Stopwatch& watch, uint64_t& items, uint64_t& bytes) {
+            watch.Start();
+            rasterizer.Render(m_Snapshot.data(), m_FrameSize, projection, view, render.GetDotScale(),
+                              render.GetXScale());
+            watch.Stop();
+            items += m_FrameSize;
+        });
+
+        VideoWriter video("/dev/null", VIDEO_FORMAT_Y4M, width, height, 60, &pool);
+        m_Bench.Run("video", VIDEO_FORMAT_Y4M, [&](Stopwatch& watch, uint64_t& items, uint64_t& bytes) {
+            watch.Start();
+            video.Write(rasterizer.GetPixels());
+            watch.Stop();
+            items++;
+            bytes += width * height * 3 / 2;
+        });
+        video.Finish();
+    }
+
+    // Replays the first half of the run untimed before m_Bench.Run, so the
+    // dots that stopped reporting early have expired where it measures.
+    template<typename Body>
+    void RunFromMiddle(const std::string& name, const std::string& variant, Body body) {
+        if (!m_Bench.Enabled(name)) {
+            return;
+        }
+        Stopwatch watch;
+        uint64_t items = 0, bytes = 0;
+        for (size_t i = 0; i < m_Deltas.size() / 2; i++) {
+            body(watch, items, bytes);
+        }
+        m_Bench.Run(name, variant, body);
+    }
+
+    // never expiring and the configured idle time, the difference is what compaction saves
+    std::vector<uint32_t> GetIdles() {
+        std::vector<uint32_t> idles(1, 0);
+        if (m_Idle != 0) {
+            idles.push_back(m_Idle);
+        }
+        return idles;
+    }
+
+    const std::vector<update_t>& NextDelta(size_t& index) {
+        index = (index + 1) % m_Deltas.size();
+        return m_Deltas[index];
+    }
+
+    void Reset(LiveSet& liveSet, FrameQueue& frameQueue) {
+        std::vector<glm::vec2> instances(m_FrameSize);
+        liveSet.Reset(m_Timestamps[0], m_Snapshot.data(), instances.data());
+        frameQueue.Fill(instances.data());
+    }
+
+    void Reset(LiveSet& liveSet, SegmentTracker& tracker) {
+        std::vector<glm::vec2> instances(m_FrameSize);
+        liveSet.Reset(m_Timestamps[0], m_Snapshot.data(), instances.data());
+        tracker.Reset(instances.data());
+    }
+
+    void Bounds(glm::vec2& minimum, glm::vec2& maximum) {
+        minimum = maximum = m_Snapshot[0];
+        for (size_t i = 1; i < m_FrameSize; i++) {
+            minimum = glm::min(minimum, m_Snapshot[i]);
+            maximum = glm::max(maximum, m_Snapshot[i]);
+        }
+    }
+
+    Bench& m_Bench;
+    FrameProvider& m_FrameProvider;
+    size_t m_FrameSize;
+    uint32_t m_Idle;
+    size_t m_Threads;
+    std::vector<uint32_t> m_Timestamps;
+    std::vector<std::vector<update_t> > m_Deltas;
+    std::vector<glm::vec2> m_Snapshot;
+    std::vector<glm::vec2> m_Output;
+};
+
+int main(int argc, char* argv[]) {
+    SyntheticParams params;
+    params.dots = 70000;
+    params.timestamps = 3600;
+    params.rate = 0.05;
+    params.radius = 0.001;
+    params.active = 0.5;
+    params.snapshotSeconds = 600;
+    params.seed = 1;
+    params.centre = glm::vec2(174.0f, -41.0f);
+    params.spread = 6.0f;
+    params.start = 1560038400; // a multiple of 600, the first timestamp is a regular snapshot too
+    // shorter than the run, so dots that stopped early expire before the end
+    uint32_t idleSeconds = 600;
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    double minSeconds = 0.5;
+    std::string filter;
+    std::string format = "json";
+    std::string directory = ".";
+    std::string generate;
+    bool keep = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--dots" && hasValue) {
+            params.dots = strtoul(argv[++i], NULL, 10);
+        } else if (arg == "--timestamps" && hasValue) {
+            params.timestamps = strtoul(argv[++i], NULL, 10);
+        } else if (arg == "--rate" && hasValue) {
+            params.rate = atof(argv[++i]);
+        } else if (arg == "--radius" && hasValue) {
+            params.radius = atof(argv[++i]);
+        } else if (arg == "--active" && hasValue) {
+            params.active = atof(argv[++i]);
+        } else if (arg == "--snapshot" && hasValue) {
+            params.snapshotSeconds = strtoul(argv[++i], NULL, 10);
+        } else if (arg == "--seed" && hasValue) {
+            params.seed = strtoull(argv[++i], NULL, 10);
+        } else if (arg == "--idle" && hasValue) {
+            idleSeconds = strtoul(argv[++i], NULL, 10);
+        } else if (arg == "--threads" && hasValue) {
+            threads = std::max(1, atoi(argv[++i]));
+        } else if (arg == "--time" && hasValue) {
+            minSeconds = atof(argv[++i]);
+        } else if (arg == "--filter" && hasValue) {
+            filter = argv[++i];
+        } else if (arg == "--format" && hasValue) {
+            format = argv[++i];
+        } else if (arg == "--dir" && hasValue) {
+            directory = argv[++i];
+        } else if (arg == "--generate" && hasValue) {
+            generate = argv[++i];
+        } else if (arg == "--keep") {
+            keep = true;
+        } else {
+            spdlog::error("usage: {} [--dots N] [--timestamps N] [--rate R] [--radius DEG] [--active F] "
+                          "[--snapshot SECONDS] [--idle SECONDS] [--seed N] [--threads N] [--time SECONDS] "
+                          "[--filter NAME] [--format json|csv] [--dir DIR] [--keep] [--generate output]", argv[0]);
+            return 1;
+        }
+    }
+    if (params.dots == 0 || params.timestamps == 0 || params.rate <= 0.0 || params.rate > 1.0 ||
+        params.active < 0.0 || params.active > 1.0 || params.snapshotSeconds == 0) {
+        spdlog::error("need dots > 0, timestamps > 0, 0 < rate <= 1, 0 <= active <= 1 and snapshot > 0");
+        return 1;
+    }
+    // keep the log out of the results
+    spdlog::set_default_logger(spdlog::stderr_color_mt("stderr"));
+
+    if (!generate.empty()) {
+        std::unique_ptr<FrameWriter> writer(FrameWriter::Create(generate.c_str(), params.dots));
+        uint64_t numUpdates = Generate(params, *writer);
+        spdlog::info("Generated {}: {} dots, {} timestamps, {} updates", generate, params.dots, params.timestamps,
+                     numUpdates);
+        return 0;
+    }
+
+    Bench bench(minSeconds, filter);
+    std::vector<std::string> files;
+    std::vector<std::string> variants;
+    files.push_back(directory + "/tldm-bench.db");
+    variants.push_back("db");
+    files.push_back(directory + "/tldm-bench.tldm");
+    variants.push_back("tldm");
+    for (size_t i = 0; i < files.size(); i++) {
+        remove(files[i].c_str());
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::unique_ptr<FrameWriter> writer(FrameWriter::Create(files[i].c_str(), params.dots));
+        uint64_t numUpdates = Generate(params, *writer);
+        writer.reset();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        uint64_t size = FileSize(files[i]);
+        bench.Add("generate", variants[i], numUpdates, size, seconds);
+        // file size per update, for comparing the formats
+        bench.Add("size", variants[i], numUpdates, size);
+    }
+
+    for (size_t i = 0; i < files.size(); i++) {
+        BenchSource(bench, files[i], variants[i], params.seed);
+    }
+    BenchBlobReads(bench, files[0]);
+    {
+        // engines read from memory, the format does not matter
+        FrameProvider frameProvider(files.back().c_str());
+        EngineBench engines(bench, frameProvider, idleSeconds, threads);
+        engines.Run(directory + "/tldm-bench.tldt");
+    }
+
+    if (!keep) {
+        for (size_t i = 0; i < files.size(); i++) {
+            remove(files[i].c_str());
+        }
+        remove((directory + "/tldm-bench.tldt").c_str());
+    }
+    if (format == "csv") {
+        bench.WriteCsv(stdout);
+    } else {
+        bench.WriteJson(stdout, params, threads);
+    }
+    if (bench.GetFailures()) {
+        spdlog::error("{} checks failed", bench.GetFailures());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,367 @@
+// Converts between frame storage formats
+//
+//   tldm-convert [--reversible] [--hilbert] [--shard SECONDS] [--attributes speed,heading]
+//                input.{db,tldm} output.{db,tldm,tldt}
+//
+// A .tldm output is a memory-mappable container, a .tldt output holds the
+// trajectory of every dot for the trajectory engine, replayed next to the
+// input it was made from. Anything else is written as an SQLite database.
+// --reversible adds the reverse of every delta, for rewinding the replay.
+// --hilbert renumbers the slots so that dots close on the map get close
+// slots (see SlotOrder); the slots table, snapshots and deltas all follow.
+// --shard splits the output by time, e.g. 86400 for one file per UTC day,
+// for replaying with a pattern like output-*.db (see ShardedSource).
+// The input may be such a pattern too.
+// --attributes stores columns derived from the reports next to the deltas
+// of a database output, for colouring and filtering the dots (see
+// AttributeWriter and the [attributes] section of config.ini).
+
+#include <algorithm>
+#include <cmath>
+#include <ctime>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include "container.h"
+#include "database.h"
+#include "order.h"
+#include "shards.h"
+#include "trajectory.h"
+
+// Starts another output every 'seconds', named after the start of its
+// period: out.db becomes out-20190501-000000.db and so on. Each shard
+// begins with a snapshot of the whole frame, so that it can be read on its
+// own and dots that do not report in it keep their place.
+class ShardWriter : public FrameWriter {
+
+public:
+    ShardWriter(const std::string& output, uint32_t frameSize, bool reversible, uint32_t seconds,
+                const std::string& slots, const std::vector<uint32_t>* newSlots) :
+            m_Output(output),
+            m_Reversible(reversible),
+            m_Seconds(seconds),
+            m_Slots(slots),
+            m_NewSlots(newSlots),
+            m_Frame(frameSize),
+            m_End(0)
+    {}
+
+    void AddSnapshot(uint32_t timestamp, const glm::vec2* frame, size_t numLocations) {
+        numLocations = std::min(numLocations, m_Frame.size());
+        std::copy(frame, frame + numLocations, m_Frame.begin());
+        std::fill(m_Frame.begin() + numLocations, m_Frame.end(), glm::vec2(0.0f));
+        if (timestamp >= m_End) {
+            Next(timestamp);
+        } else {
+            m_Writer->AddSnapshot(timestamp, frame, numLocations);
+        }
+    }
+
+    void AddDelta(uint32_t timestamp, const update_t* updates, size_t numUpdates) {
+        if (timestamp >= m_End) {
+            Next(timestamp);
+        }
+        m_Writer->AddDelta(timestamp, updates, numUpdates);
+        for (size_t i = 0; i < numUpdates; i++) {
+            if (updates[i].index < m_Frame.size()) {
+                m_Frame[updates[i].index] = glm::vec2(updates[i].lon, updates[i].lat);
+            }
+        }
+    }
+
+    bool HasAttributes() {
+        return !FrameSource::IsContainer(m_Output);
+    }
+
+    void AddAttributeSnapshot(const std::string& name, uint32_t timestamp, const float* column, size_t numValues) {
+        m_Columns[name].assign(column, column + numValues);
+        m_Writer->AddAttributeSnapshot(name, timestamp, column, numValues);
+    }
+
+    void AddAttributeDelta(const std::string& name, uint32_t timestamp, const attribute_t* updates,
+                           size_t numUpdates) {
+        if (timestamp >= m_End) {
+            Next(timestamp);
+        }
+        m_Writer->AddAttributeDelta(name, timestamp, updates, numUpdates);
+        std::vector<float>& column = m_Columns[name];
+        for (size_t i = 0; i < numUpdates; i++) {
+            if (updates[i].index < column.size()) {
+                column[updates[i].index] = updates[i].value;
+            }
+        }
+    }
+
+    void Finish() {
+        if (m_Writer) {
+            m_Writer->Finish();
+        }
+    }
+
+private:
+    // the state before timestamp is the new shard's first snapshot
+    void Next(uint32_t timestamp) {
+        Finish();
+        m_Writer.reset();
+        time_t start = timestamp - timestamp % m_Seconds;
+        m_End = uint64_t(start) + m_Seconds;
+        char suffix[32];
+        strftime(suffix, sizeof(suffix), "-%Y%m%d-%H%M%S", std::gmtime(&start));
+        size_t slash = m_Output.find_last_of("/\\");
+        size_t dot = m_Output.find_last_of('.');
+        if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+            dot = m_Output.size();
+        }
+        std::string filename = m_Output.substr(0, dot) + suffix + m_Output.substr(dot);
+        spdlog::info("Writing shard {}", filename);
+
+        m_Writer.reset(FrameWriter::Create(filename.c_str(), m_Frame.size(), m_Reversible));
+        DatabaseWriter* database = dynamic_cast<DatabaseWriter*>(m_Writer.get());
+        if (database && !m_Slots.empty()) {
+            database->CopySlots(m_Slots.c_str(), m_NewSlots);
+        }
+        m_Writer->AddSnapshot(timestamp, m_Frame.data(), m_Frame.size());
+        for (std::map<std::string, std::vector<float> >::iterator column = m_Columns.begin();
+             column != m_Columns.end(); ++column) {
+            m_Writer->AddAttributeSnapshot(column->first, timestamp, column->second.data(), column->second.size());
+        }
+    }
+
+    std::string m_Output;
+    bool m_Reversible;
+    uint32_t m_Seconds;
+    std::string m_Slots; // database to copy the slots table from, if any
+    const std::vector<uint32_t>* m_NewSlots;
+    std::unique_ptr<FrameWriter> m_Writer;
+    std::vector<glm::vec2> m_Frame;
+    std::map<std::string, std::vector<float> > m_Columns; // attribute state, for the next shard's snapshots
+    uint64_t m_End; // of the current shard
+};
+
+static const float KM_PER_DEGREE = 111.2f;
+
+// Derives attribute columns from the reports on their way to writer:
+// "speed" in km/h and "heading" in degrees clockwise from north, both from
+// a dot's previous report to its latest one. Values hold until the dot
+// reports again, and are 0 before its second report. Every snapshot gets
+// the columns as they are, every delta the values that changed.
+class AttributeWriter : public FrameWriter {
+
+public:
+    AttributeWriter(FrameWriter& writer, const std::vector<std::string>& names, uint32_t frameSize) :
+            m_Writer(writer),
+            m_Names(names),
+            m_Positions(frameSize),
+            m_Reported(frameSize, 0),
+            m_Columns(names.size(), std::vector<float>(frameSize, 0.0f)),
+            m_Changes(names.size())
+    {
+        for (size_t i = 0; i < names.size(); i++) {
+            if (names[i] != "speed" && names[i] != "heading") {
+                throw std::runtime_error("unknown attribute " + names[i] + ", expected speed or heading");
+            }
+        }
+    }
+
+    void AddSnapshot(uint32_t timestamp, const glm::vec2* frame, size_t numLocations) {
+        m_Writer.AddSnapshot(timestamp, frame, numLocations);
+        for (size_t c = 0; c < m_Names.size(); c++) {
+            m_Writer.AddAttributeSnapshot(m_Names[c], timestamp, m_Columns[c].data(), m_Columns[c].size());
+        }
+        // where the dots were, but not when they reported it
+        numLocations = std::min(numLocations, m_Positions.size());
+        for (size_t i = 0; i < numLocations; i++) {
+            if (m_Reported[i] == 0) {
+                m_Positions[i] = frame[i];
+            }
+        }
+    }
+
+    void AddDelta(uint32_t timestamp, const update_t* updates, size_t numUpdates) {
+        m_Writer.AddDelta(timestamp, updates, numUpdates);
+        for (size_t c = 0; c < m_Changes.size(); c++) {
+            m_Changes[c].clear();
+        }
+        for (size_t i = 0; i < numUpdates; i++) {
+            uint32_t slot = updates[i].index;
+            if (slot >= m_Positions.size()) {
+                continue;
+            }
+            glm::vec2 position(updates[i].lon, updates[i].lat);
+            if (m_Reported[slot] != 0 && timestamp > m_Reported[slot]) {
+                // flat earth over the distance of one report
+                float latitude = glm::radians(0.5f * (position.y + m_Positions[slot].y));
+                float east = (position.x - m_Positions[slot].x) * KM_PER_DEGREE * std::cos(latitude);
+                float north = (position.y - m_Positions[slot].y) * KM_PER_DEGREE;
+                for (size_t c = 0; c < m_Names.size(); c++) {
+                    float value;
+                    if (m_Names[c] == "speed") {
+                        value = std::sqrt(east * east + north * north) * 3600.0f / (timestamp - m_Reported[slot]);
+                    } else if (east == 0.0f && north == 0.0f) {
+                        value = m_Columns[c][slot]; // standing still, keep facing the same way
+                    } else {
+                        value = std::fmod(glm::degrees(std::atan2(east, north)) + 360.0f, 360.0f);
+                    }
+                    if (value != m_Columns[c][slot]) {
+                        m_Columns[c][slot] = value;
+                        attribute_t change = {slot, value};
+                        m_Changes[c].push_back(change);
+                    }
+                }
+            }
+            m_Positions[slot] = position;
+            m_Reported[slot] = timestamp;
+        }
+        for (size_t c = 0; c < m_Names.size(); c++) {
+            m_Writer.AddAttributeDelta(m_Names[c], timestamp, m_Changes[c].data(), m_Changes[c].size());
+        }
+    }
+
+    void Finish() {
+        m_Writer.Finish();
+    }
+
+private:
+    FrameWriter& m_Writer;
+    std::vector<std::string> m_Names;
+    std::vector<glm::vec2> m_Positions; // latest report by slot
+    std::vector<uint32_t> m_Reported;   // its timestamp, 0: none yet
+    std::vector<std::vector<float> > m_Columns;
+    std::vector<std::vector<attribute_t> > m_Changes; // of the current delta
+};
+
+// the typical location of every dot needs a pass over all deltas first
+static void Locate(FrameSource& source, SlotOrder& order, std::vector<glm::vec2>& frame) {
+    std::vector<uint32_t> timestamps = source.GetTimestamps();
+    std::vector<uint32_t> snapshots = source.GetSnapshotTimestamps();
+    if (!snapshots.empty()) {
+        size_t numLocations = source.GetSnapshot(snapshots[0], frame.data(), frame.size());
+        order.AddFrame(frame.data(), numLocations);
+    }
+    for (size_t i = 0; i < timestamps.size(); i++) {
+        size_t numUpdates;
+        const update_t* updates = source.GetDelta(timestamps[i], numUpdates);
+        order.AddDelta(updates, numUpdates);
+    }
+    order.Build();
+}
+
+static void AddSnapshot(FrameSource& source, FrameWriter& writer, SlotOrder* order, uint32_t timestamp,
+                        std::vector<glm::vec2>& frame, std::vector<glm::vec2>& reordered) {
+    size_t numLocations = source.GetSnapshot(timestamp, frame.data(), frame.size());
+    if (order) {
+        order->ReorderFrame(frame.data(), numLocations, reordered.data());
+        writer.AddSnapshot(timestamp, reordered.data(), reordered.size());
+    } else {
+        writer.AddSnapshot(timestamp, frame.data(), numLocations);
+    }
+}
+
+static void Convert(FrameSource& source, FrameWriter& writer, SlotOrder* order, std::vector<glm::vec2>& frame) {
+    std::vector<uint32_t> timestamps = source.GetTimestamps();
+    std::vector<uint32_t> snapshots = source.GetSnapshotTimestamps();
+    std::vector<uint32_t>::iterator snapshot = snapshots.begin();
+    std::vector<glm::vec2> reordered(order ? frame.size() : 0);
+    std::vector<update_t> delta;
+    for (size_t i = 0; i < timestamps.size(); i++) {
+        // a snapshot is the state before the delta of the same timestamp
+        for (; snapshot != snapshots.end() && *snapshot <= timestamps[i]; ++snapshot) {
+            AddSnapshot(source, writer, order, *snapshot, frame, reordered);
+        }
+        size_t numUpdates;
+        const update_t* updates = source.GetDelta(timestamps[i], numUpdates);
+        if (order) {
+            order->ReorderDelta(updates, numUpdates, delta);
+            updates = delta.data();
+        }
+        writer.AddDelta(timestamps[i], updates, numUpdates);
+    }
+    for (; snapshot != snapshots.end(); ++snapshot) {
+        AddSnapshot(source, writer, order, *snapshot, frame, reordered);
+    }
+    writer.Finish();
+}
+
+int main(int argc, char* argv[]) {
+    bool reversible = false;
+    bool hilbert = false;
+    uint32_t shardSeconds = 0;
+    std::vector<std::string> attributes;
+    std::vector<const char*> files;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--reversible") {
+            reversible = true;
+        } else if (arg == "--hilbert") {
+            hilbert = true;
+        } else if (arg == "--shard" && i + 1 < argc) {
+            shardSeconds = strtoul(argv[++i], NULL, 10);
+        } else if (arg == "--attributes" && i + 1 < argc) {
+            std::string names = argv[++i];
+            for (size_t begin = 0; begin <= names.size();) {
+                size_t end = std::min(names.find(',', begin), names.size());
+                if (end > begin) {
+                    attributes.push_back(names.substr(begin, end - begin));
+                }
+                begin = end + 1;
+            }
+        } else {
+            files.push_back(argv[i]);
+        }
+    }
+    if (files.size() != 2) {
+        spdlog::error("usage: {} [--reversible] [--hilbert] [--shard SECONDS] "
+                      "[--attributes speed,heading] input output", argv[0]);
+        return 1;
+    }
+    const char* input = files[0];
+    const char* output = files[1];
+    if (shardSeconds && TrajectoryWriter::IsTrajectoryFile(output)) {
+        spdlog::error("trajectories cannot be sharded, convert to .db or .tldm");
+        return 1;
+    }
+
+    std::unique_ptr<FrameSource> source(FrameSource::Open(input));
+    spdlog::info("Converting {}: {} frames, {} snapshots", input,
+                 (uint32_t)source->GetTimestamps().size(), (uint32_t)source->GetSnapshotTimestamps().size());
+
+    size_t frameSize = source->GetFrameSize();
+    std::vector<glm::vec2> frame(frameSize);
+    std::unique_ptr<SlotOrder> order;
+    if (hilbert) {
+        order.reset(new SlotOrder(frameSize));
+        Locate(*source, *order, frame);
+    }
+
+    // the slots table of sharded databases is the same in every shard
+    std::string slots;
+    if (!FrameSource::IsContainer(input)) {
+        slots = ShardedSource::IsSharded(input) ? ShardedSource::Expand(input)[0] : input;
+    }
+    const std::vector<uint32_t>* newSlots = order ? &order->GetNewSlots() : NULL;
+    std::unique_ptr<FrameWriter> writer;
+    if (shardSeconds) {
+        writer.reset(new ShardWriter(output, frameSize, reversible, shardSeconds, slots, newSlots));
+    } else {
+        writer.reset(FrameWriter::Create(output, frameSize, reversible));
+        DatabaseWriter* database = dynamic_cast<DatabaseWriter*>(writer.get());
+        if (database && !slots.empty()) {
+            database->CopySlots(slots.c_str(), newSlots);
+        }
+    }
+    std::unique_ptr<FrameWriter> derived;
+    if (!attributes.empty()) {
+        if (writer->HasAttributes()) {
+            derived.reset(new AttributeWriter(*writer, attributes, frameSize));
+        } else {
+            spdlog::warn("{} cannot hold attribute columns, convert to .db for them", output);
+        }
+    }
+    Convert(*source, derived ? *derived : *writer, order.get(), frame);
+    return 0;
+}
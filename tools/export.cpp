@@ -0,0 +1,169 @@
+// Renders the replay to a video stream without a window or GL context
+//
+//   tldm-export [--width W] [--height H] [--fps F] [--frames N]
+//               [--format y4m|rgba] [-o output|-] config.ini
+//
+// Reads the same config.ini as tldm and plays the database from the first
+// frame to the last with the configured camera, dot size, replay speed and
+// interpolation; a negative speed plays from the last frame back to the
+// first. Output frames are 1/fps apart on the same playback clock
+// as the interactive view, so e.g.
+// "tldm-export -o - config.ini | ffmpeg -i - daily.mp4" gives the same
+// time-lapse as watching it, only rendered faster.
+
+#include <chrono>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <spdlog/spdlog.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <stb_image.h>
+#include <learnopengl/filesystem.h>
+#include <INIReader.h>
+
+#include "camera.h"
+#include "clock.h"
+#include "replay.h"
+#include "render.h"
+#include "engine.h"
+#include "pool.h"
+#include "raster.h"
+#include "video.h"
+
+// rasterizes every frame with a fixed camera and appends it to the video
+class VideoSink : public FrameSink {
+
+public:
+    VideoSink(Rasterizer& rasterizer, VideoWriter& video, size_t frameSize,
+              const glm::mat4& projection, const glm::mat4& view, RenderParam& render) :
+            m_Rasterizer(rasterizer),
+            m_Video(video),
+            m_Frame(frameSize),
+            m_Projection(projection),
+            m_View(view),
+            m_Render(render)
+    {
+    }
+
+    glm::vec2* Acquire(size_t numDots) {
+        return m_Frame.data();
+    }
+
+    void Submit(uint32_t timestamp, size_t numDots) {
+        m_Rasterizer.Render(m_Frame.data(), numDots, m_Projection, m_View, m_Render.GetDotScale(),
+                            m_Render.GetXScale());
+        m_Video.Write(m_Rasterizer.GetPixels());
+    }
+
+private:
+    Rasterizer& m_Rasterizer;
+    VideoWriter& m_Video;
+    std::vector<glm::vec2> m_Frame;
+    glm::mat4 m_Projection;
+    glm::mat4 m_View;
+    RenderParam& m_Render;
+};
+
+int main(int argc, char* argv[]) {
+    std::string output = "export.y4m";
+    std::string format = VIDEO_FORMAT_Y4M;
+    const char* iniFilename = NULL;
+    size_t width = 0;
+    size_t height = 0;
+    double fps = 60;
+    uint64_t maxFrames = 0;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--width" && i + 1 < argc) {
+            width = atoi(argv[++i]);
+        } else if (arg == "--height" && i + 1 < argc) {
+            height = atoi(argv[++i]);
+        } else if (arg == "--fps" && i + 1 < argc) {
+            fps = atof(argv[++i]);
+        } else if (arg == "--frames" && i + 1 < argc) {
+            maxFrames = strtoull(argv[++i], NULL, 10);
+        } else if (arg == "--format" && i + 1 < argc) {
+            format = argv[++i];
+        } else if (arg == "-o" && i + 1 < argc) {
+            output = argv[++i];
+        } else {
+            iniFilename = argv[i];
+        }
+    }
+    if (iniFilename == NULL) {
+        spdlog::error("usage: {} [--width W] [--height H] [--fps F] [--frames N] [--format {}|{}] [-o output|-] "
+                      "config.ini", argv[0], VIDEO_FORMAT_Y4M, VIDEO_FORMAT_RGBA);
+        return 1;
+    }
+    if (output == "-") {
+        // keep the log out of the video stream
+        spdlog::set_default_logger(spdlog::stderr_color_mt("stderr"));
+    }
+
+    // same settings as the interactive view
+    INIReader config(iniFilename);
+    RenderParam render(config.GetReal("render", "dotsize", 0.005f),
+                       config.GetReal("render", "dotsize_min", 0.001f),
+                       config.GetReal("render", "dotsize_max", 0.025f));
+    ReplayParam replay(config.GetReal("replay", "speed", 1.0f),
+                       config.GetReal("replay", "speed_min", 0.1f),
+                       config.GetReal("replay", "speed_max", 120.0f));
+    Camera camera(glm::vec3(config.GetReal("camera", "x", 174.0f) * render.GetXScale(),
+                            config.GetReal("camera", "y", -40.0f),
+                            config.GetReal("camera", "z", 10.0f)));
+    if (width == 0) {
+        width = config.GetInteger("window", "width", 960);
+    }
+    if (height == 0) {
+        height = config.GetInteger("window", "height", 540);
+    }
+    WorkerPool workers(config.GetInteger("threads", "workers", 0));
+    ReplayEngine engine(ReplaySettings(config), workers);
+
+    Rasterizer rasterizer(width, height, &workers);
+    int spriteWidth, spriteHeight, spriteChannels;
+    unsigned char* sprite = stbi_load(FileSystem::getPath("resources/dot/dot.png").c_str(),
+                                      &spriteWidth, &spriteHeight, &spriteChannels, 4);
+    if (sprite) {
+        rasterizer.SetSprite(sprite, spriteWidth, spriteHeight);
+        stbi_image_free(sprite);
+    } else {
+        spdlog::warn("Cannot load dot.png, drawing round dots");
+    }
+    VideoWriter video(output, format, width, height, fps, &workers);
+
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), float(width) / float(height), 0.0001f, 1000.0f);
+    glm::mat4 view = camera.GetViewMatrix();
+    render.UpdateDotScale(camera.Position.z);
+    spdlog::info("Exporting {} x {} at {} fps to {}", width, height, fps, output);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    // video time, not wall time: every frame is exactly 1/fps later
+    ManualClock clock;
+    PlaybackClock playback(clock, SIZE_MAX);
+    VideoSink sink(rasterizer, video, engine.GetFrameSize(), projection, view, render);
+    if (replay.GetSpeed() < 0.0f) {
+        // a negative speed rewinds from the end, like the headless replay
+        engine.Seek(engine.LastTimestamp());
+        if (!engine.SetReverse(true)) {
+            return 1;
+        }
+    }
+    while (!engine.AtEnd() && (maxFrames == 0 || video.GetFrames() < maxFrames)) {
+        clock.Advance(1.0 / fps);
+        // unlike the window, wait for decode instead of dropping behind
+        engine.Advance(playback.Advance(std::fabs(replay.GetSpeed())), true);
+        engine.Render(sink);
+    }
+    video.Finish();
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    spdlog::info("Exported {} frames ({:.1f} MB) in {:.1f} s: {:.1f} fps, {:.1f}x real time",
+                 video.GetFrames(), video.GetBytes() / 1e6, seconds, video.GetFrames() / seconds,
+                 video.GetFrames() / seconds / fps);
+    return 0;
+}
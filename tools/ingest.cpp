@@ -0,0 +1,664 @@
+// Builds a frame database from CSV location events
+//
+//   tldm-ingest [--append] [--reversible] [--memory MB] [--threads N]
+//               -o output.{db,tldm} input.csv...
+//
+// Input lines are "YYYY-MM-DD HH:MM:SS.mmm,name,lat,lon" in any order, '-'
+// reads stdin. It replaces the split/sort/create-db.py steps of
+// prepare-data.sh and writes the same tables as create-db.py.
+//
+// Input is read in chunks of a third of the memory budget. Each chunk is
+// parsed and sorted on all cores and spilled to a run file; the runs are
+// merged by timestamp while the frames are written. Events of the same
+// second keep their input order.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+#include <SQLiteCpp/SQLiteCpp.h>
+
+#include "database.h"
+#include "pool.h"
+#include "writer.h"
+
+static const uint32_t SNAPSHOT_SECONDS = 600; // create snapshot every 10 minutes
+
+struct Record {
+    uint32_t timestamp;
+    uint32_t name;
+    float lat;
+    float lon;
+};
+
+static bool EarlierRecord(const Record& a, const Record& b) {
+    return a.timestamp < b.timestamp;
+}
+
+// Dot names to dense ids, safe to call from all parser threads
+class NameTable {
+
+public:
+    NameTable() : m_Next(0) {}
+
+    uint32_t Intern(const char* name, size_t length) {
+        std::string key(name, length);
+        Shard& shard = m_Shards[std::hash<std::string>()(key) % NUM_SHARDS];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        std::unordered_map<std::string, uint32_t>::iterator it = shard.ids.find(key);
+        if (it != shard.ids.end()) {
+            return it->second;
+        }
+        uint32_t id = m_Next++;
+        shard.ids.insert(std::make_pair(key, id));
+        return id;
+    }
+
+    size_t Size() {
+        return m_Next;
+    }
+
+    std::vector<std::string> Names() {
+        std::vector<std::string> names(m_Next);
+        for (size_t i = 0; i < NUM_SHARDS; i++) {
+            for (const auto& entry : m_Shards[i].ids) {
+                names[entry.second] = entry.first;
+            }
+        }
+        return names;
+    }
+
+private:
+    static const size_t NUM_SHARDS = 64;
+
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<std::string, uint32_t> ids;
+    };
+
+    Shard m_Shards[NUM_SHARDS];
+    std::atomic<uint32_t> m_Next;
+};
+
+// Local time like create-db.py, mktime() only runs once per hour of input
+class TimeParser {
+
+public:
+    TimeParser() : m_HourStart(0) {
+        memset(m_Hour, 0, sizeof(m_Hour));
+    }
+
+    // "YYYY-MM-DD HH:MM:SS", returns false if malformed
+    bool Parse(const char* text, size_t length, uint32_t& seconds) {
+        static const char pattern[] = "dddd-dd-dd dd:dd:dd";
+        if (length < sizeof(pattern) - 1) {
+            return false;
+        }
+        for (size_t i = 0; i < sizeof(pattern) - 1; i++) {
+            if (pattern[i] == 'd' ? (text[i] < '0' || text[i] > '9') : text[i] != pattern[i]) {
+                return false;
+            }
+        }
+        if (memcmp(text, m_Hour, HOUR_LENGTH) != 0) {
+            struct tm t;
+            memset(&t, 0, sizeof(t));
+            t.tm_year = Digits(text, 4) - 1900;
+            t.tm_mon = Digits(text + 5, 2) - 1;
+            t.tm_mday = Digits(text + 8, 2);
+            t.tm_hour = Digits(text + 11, 2);
+            t.tm_isdst = -1;
+            m_HourStart = mktime(&t);
+            memcpy(m_Hour, text, HOUR_LENGTH);
+        }
+        seconds = m_HourStart + 60 * Digits(text + 14, 2) + Digits(text + 17, 2);
+        return true;
+    }
+
+private:
+    static const size_t HOUR_LENGTH = 13; // "YYYY-MM-DD HH"
+
+    static int Digits(const char* text, int count) {
+        int value = 0;
+        for (int i = 0; i < count; i++) {
+            value = 10 * value + (text[i] - '0');
+        }
+        return value;
+    }
+
+    char m_Hour[HOUR_LENGTH];
+    time_t m_HourStart;
+};
+
+class Ingest {
+
+public:
+    Ingest(size_t memoryBytes, size_t numThreads, uint32_t after, const std::string& runPrefix) :
+            m_MemoryBytes(memoryBytes),
+            m_Workers(numThreads),
+            m_Parsers(m_Workers.Size()),
+            m_After(after),
+            m_RunPrefix(runPrefix),
+            m_NumLines(0),
+            m_NumRecords(0),
+            m_Invalid(0)
+    {
+    }
+
+    ~Ingest() {
+        for (size_t i = 0; i < m_Runs.size(); i++) {
+            remove(m_Runs[i].c_str());
+        }
+    }
+
+    // first pass: parse, sort and spill the input
+    void Read(const std::vector<const char*>& inputs) {
+        size_t chunkBytes = std::max<size_t>(m_MemoryBytes / 3, 1 << 20);
+        std::vector<char> chunk;
+        for (size_t i = 0; i < inputs.size(); i++) {
+            FILE* file = strcmp(inputs[i], "-") == 0 ? stdin : fopen(inputs[i], "rb");
+            if (file == NULL) {
+                throw std::runtime_error(std::string("cannot open ") + inputs[i]);
+            }
+            spdlog::info("Reading {}...", inputs[i]);
+            size_t used = chunk.size();
+            chunk.resize(chunkBytes + 1);
+            size_t read;
+            while ((read = fread(chunk.data() + used, 1, chunkBytes - used, file)) > 0) {
+                used += read;
+                // keep the partial last line for the next chunk
+                size_t end = used;
+                while (end > 0 && chunk[end - 1] != '\n') {
+                    end--;
+                }
+                if (end == 0 && used == chunkBytes) {
+                    throw std::runtime_error("line longer than the memory budget");
+                }
+                Parse(chunk.data(), end);
+                memmove(chunk.data(), chunk.data() + end, used - end);
+                used -= end;
+            }
+            if (file != stdin) {
+                fclose(file);
+            }
+            // terminate a last line without a newline
+            chunk.resize(used);
+            if (!chunk.empty()) {
+                chunk.push_back('\n');
+            }
+        }
+        if (!chunk.empty()) {
+            Parse(chunk.data(), chunk.size());
+        }
+        if (!m_Runs.empty() && !m_Sorted.empty()) {
+            Spill();
+        }
+        spdlog::info("Parsed {} lines: {} events of {} dots, {} skipped, {} runs",
+                     m_NumLines, m_NumRecords, m_Names.Size(), m_Invalid.load(), m_Runs.size());
+    }
+
+    NameTable& GetNames() {
+        return m_Names;
+    }
+
+    // first location of every dot, in order of first appearance
+    void GetFirstLocations(std::vector<uint32_t>& order, std::vector<glm::vec2>& locations) {
+        order.resize(m_First.size());
+        for (size_t i = 0; i < order.size(); i++) {
+            order[i] = i;
+        }
+        std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+            return m_First[a].timestamp < m_First[b].timestamp ||
+                   (m_First[a].timestamp == m_First[b].timestamp && m_First[a].sequence < m_First[b].sequence);
+        });
+        locations.resize(m_First.size());
+        for (size_t i = 0; i < m_First.size(); i++) {
+            locations[i] = glm::vec2(m_First[i].lon, m_First[i].lat);
+        }
+    }
+
+    // second pass: all events in timestamp order
+    void Merge(const std::function<void(const Record&)>& emit) {
+        if (m_Runs.empty()) {
+            for (size_t i = 0; i < m_Sorted.size(); i++) {
+                emit(m_Sorted[i]);
+            }
+            return;
+        }
+        std::vector<std::unique_ptr<RunReader> > readers;
+        size_t bufferSize = std::max<size_t>(m_MemoryBytes / m_Runs.size() / sizeof(Record), 4096);
+        typedef std::pair<uint32_t, size_t> Head; // timestamp, run
+        std::priority_queue<Head, std::vector<Head>, std::greater<Head> > heads;
+        for (size_t i = 0; i < m_Runs.size(); i++) {
+            readers.push_back(std::unique_ptr<RunReader>(new RunReader(m_Runs[i], bufferSize)));
+            if (readers[i]->Valid()) {
+                heads.push(Head(readers[i]->Current().timestamp, i));
+            }
+        }
+        while (!heads.empty()) {
+            size_t run = heads.top().second;
+            heads.pop();
+            // ties go to the earlier run, which keeps the input order
+            RunReader& reader = *readers[run];
+            do {
+                emit(reader.Current());
+                reader.Next();
+            } while (reader.Valid() && (heads.empty() || Head(reader.Current().timestamp, run) < heads.top()));
+            if (reader.Valid()) {
+                heads.push(Head(reader.Current().timestamp, run));
+            }
+        }
+    }
+
+private:
+    struct First {
+        uint32_t timestamp;
+        uint64_t sequence;
+        float lat;
+        float lon;
+    };
+
+    class RunReader {
+
+    public:
+        RunReader(const std::string& filename, size_t bufferSize) :
+                m_File(fopen(filename.c_str(), "rb")),
+                m_Buffer(bufferSize),
+                m_Position(0),
+                m_Count(0)
+        {
+            if (m_File == NULL) {
+                throw std::runtime_error("cannot open " + filename);
+            }
+            Next();
+            m_Position = 0;
+        }
+
+        ~RunReader() {
+            fclose(m_File);
+        }
+
+        bool Valid() {
+            return m_Position < m_Count;
+        }
+
+        const Record& Current() {
+            return m_Buffer[m_Position];
+        }
+
+        void Next() {
+            if (++m_Position >= m_Count) {
+                m_Count = fread(m_Buffer.data(), sizeof(Record), m_Buffer.size(), m_File);
+                m_Position = 0;
+            }
+        }
+
+    private:
+        FILE* m_File;
+        std::vector<Record> m_Buffer;
+        size_t m_Position;
+        size_t m_Count;
+    };
+
+    // "YYYY-MM-DD HH:MM:SS.mmm,name,lat,lon"
+    bool ParseLine(const char* line, const char* end, TimeParser& time, Record& record) {
+        const char* fields[4];
+        const char* fieldEnds[4];
+        size_t numFields = 0;
+        const char* field = line;
+        for (const char* p = line; p <= end; p++) {
+            if (p == end || *p == ',') {
+                if (numFields == 4) {
+                    return false;
+                }
+                fields[numFields] = field;
+                fieldEnds[numFields++] = p;
+                field = p + 1;
+            }
+        }
+        if (numFields != 4 || !time.Parse(fields[0], fieldEnds[0] - fields[0], record.timestamp)) {
+            return false;
+        }
+        char* parsed;
+        double lat = strtod(fields[2], &parsed);
+        if (parsed == fields[2]) {
+            return false;
+        }
+        double lon = strtod(fields[3], &parsed);
+        if (parsed == fields[3]) {
+            return false;
+        }
+        if (lat == 0.0 || lon == 0.0 || record.timestamp <= m_After) {
+            // not a valid location, or already in the appended database
+            return false;
+        }
+        record.lat = (float)lat;
+        record.lon = (float)lon;
+        record.name = m_Names.Intern(fields[1], fieldEnds[1] - fields[1]);
+        return true;
+    }
+
+    void Parse(char* text, size_t size) {
+        // pieces end at line boundaries
+        size_t numPieces = 4 * m_Workers.Size();
+        std::vector<size_t> bounds(numPieces + 1, size);
+        bounds[0] = 0;
+        for (size_t i = 1; i < numPieces; i++) {
+            size_t bound = std::max(bounds[i - 1], i * size / numPieces);
+            while (bound < size && bound > 0 && text[bound - 1] != '\n') {
+                bound++;
+            }
+            bounds[i] = bound;
+        }
+
+        std::vector<std::vector<Record> > pieces(numPieces);
+        std::vector<size_t> lines(numPieces, 0);
+        m_Workers.Run(numPieces, [&](size_t piece, size_t worker) {
+            std::vector<Record>& records = pieces[piece];
+            const char* p = text + bounds[piece];
+            const char* end = text + bounds[piece + 1];
+            Record record;
+            size_t invalid = 0;
+            while (p < end) {
+                const char* newline = (const char*)memchr(p, '\n', end - p);
+                const char* lineEnd = newline ? newline : end;
+                if (lineEnd > p && lineEnd[-1] == '\r') {
+                    lineEnd--;
+                }
+                if (lineEnd > p) {
+                    lines[piece]++;
+                    if (ParseLine(p, lineEnd, m_Parsers[worker], record)) {
+                        records.push_back(record);
+                    } else {
+                        invalid++;
+                    }
+                }
+                p = newline ? newline + 1 : end;
+            }
+            m_Invalid += invalid;
+        });
+
+        // first appearance, in input order
+        m_First.resize(m_Names.Size(), First{UINT32_MAX, 0, 0.0f, 0.0f});
+        for (size_t i = 0; i < numPieces; i++) {
+            m_NumLines += lines[i];
+            for (size_t j = 0; j < pieces[i].size(); j++) {
+                const Record& record = pieces[i][j];
+                First& first = m_First[record.name];
+                if (record.timestamp < first.timestamp) {
+                    first = First{record.timestamp, m_NumRecords, record.lat, record.lon};
+                }
+                m_NumRecords++;
+            }
+        }
+
+        // stable sorts and merges keep the input order within a second
+        m_Workers.Run(numPieces, [&](size_t piece, size_t) {
+            std::stable_sort(pieces[piece].begin(), pieces[piece].end(), EarlierRecord);
+        });
+        while (pieces.size() > 1) {
+            std::vector<std::vector<Record> > merged((pieces.size() + 1) / 2);
+            m_Workers.Run(merged.size(), [&](size_t pair, size_t) {
+                if (2 * pair + 1 == pieces.size()) {
+                    merged[pair].swap(pieces[2 * pair]);
+                    return;
+                }
+                std::vector<Record>& a = pieces[2 * pair];
+                std::vector<Record>& b = pieces[2 * pair + 1];
+                merged[pair].resize(a.size() + b.size());
+                std::merge(a.begin(), a.end(), b.begin(), b.end(), merged[pair].begin(), EarlierRecord);
+                std::vector<Record>().swap(a);
+                std::vector<Record>().swap(b);
+            });
+            pieces.swap(merged);
+        }
+
+        // a single chunk stays in memory
+        if (!m_Sorted.empty()) {
+            Spill();
+        }
+        m_Sorted.swap(pieces[0]);
+    }
+
+    void Spill() {
+        std::string filename = m_RunPrefix + std::to_string(m_Runs.size());
+        FILE* file = fopen(filename.c_str(), "wb");
+        if (file == NULL) {
+            throw std::runtime_error("cannot create " + filename);
+        }
+        m_Runs.push_back(filename);
+        size_t written = fwrite(m_Sorted.data(), sizeof(Record), m_Sorted.size(), file);
+        fclose(file);
+        if (written != m_Sorted.size()) {
+            throw std::runtime_error("cannot write " + filename);
+        }
+        spdlog::debug("Spilled {} events to {}", m_Sorted.size(), filename);
+        std::vector<Record>().swap(m_Sorted);
+    }
+
+    size_t m_MemoryBytes;
+    WorkerPool m_Workers;
+    std::vector<TimeParser> m_Parsers;
+    uint32_t m_After;
+    std::string m_RunPrefix;
+    NameTable m_Names;
+    std::vector<First> m_First;
+    std::vector<Record> m_Sorted;
+    std::vector<std::string> m_Runs;
+    size_t m_NumLines;
+    uint64_t m_NumRecords;
+    std::atomic<size_t> m_Invalid;
+};
+
+// Turns time ordered events into snapshots and per-second deltas
+class FrameBuilder {
+
+public:
+    FrameBuilder(FrameWriter& writer, std::vector<glm::vec2>& frame, const std::vector<uint32_t>& slots,
+                 uint32_t timestamp) :
+            m_Writer(writer),
+            m_Frame(frame),
+            m_Slots(slots),
+            m_DeltaIndex(frame.size(), -1),
+            m_Timestamp(timestamp),
+            m_NumDeltas(0)
+    {
+    }
+
+    void Add(const Record& record) {
+        if (m_Timestamp && record.timestamp != m_Timestamp) {
+            // new second, dump delta
+            Flush();
+            if (record.timestamp % SNAPSHOT_SECONDS == 0) {
+                m_Writer.AddSnapshot(record.timestamp, m_Frame.data(), m_Frame.size());
+            }
+        }
+        m_Timestamp = record.timestamp;
+
+        // the last location of a second wins, in the place of its first one
+        uint32_t slot = m_Slots[record.name];
+        if (m_DeltaIndex[slot] < 0) {
+            m_DeltaIndex[slot] = m_Delta.size();
+            m_Delta.push_back(update_t());
+        }
+        update_t& update = m_Delta[m_DeltaIndex[slot]];
+        update.index = slot;
+        update.lat = record.lat;
+        update.lon = record.lon;
+        m_Frame[slot] = glm::vec2(record.lon, record.lat);
+    }
+
+    void Flush() {
+        if (m_Delta.empty()) {
+            return;
+        }
+        m_Writer.AddDelta(m_Timestamp, m_Delta.data(), m_Delta.size());
+        for (size_t i = 0; i < m_Delta.size(); i++) {
+            m_DeltaIndex[m_Delta[i].index] = -1;
+        }
+        m_Delta.clear();
+        m_NumDeltas++;
+    }
+
+    size_t GetNumDeltas() {
+        return m_NumDeltas;
+    }
+
+private:
+    FrameWriter& m_Writer;
+    std::vector<glm::vec2>& m_Frame;
+    const std::vector<uint32_t>& m_Slots;
+    std::vector<update_t> m_Delta;
+    std::vector<int32_t> m_DeltaIndex;
+    uint32_t m_Timestamp;
+    size_t m_NumDeltas;
+};
+
+// slots and the last frame of a database that is going to be appended
+static uint32_t ReadExisting(const char* filename, std::unordered_map<std::string, uint32_t>& slots,
+                             std::vector<glm::vec2>& frame) {
+    {
+        SQLite::Database db(filename);
+        SQLite::Statement slotsQuery(db, "SELECT name, slot FROM slots");
+        while (slotsQuery.executeStep()) {
+            slots[slotsQuery.getColumn(0).getText()] = slotsQuery.getColumn(1).getInt();
+        }
+    }
+    uint32_t numSlots = 0;
+    for (const auto& slot : slots) {
+        numSlots = std::max(numSlots, slot.second + 1);
+    }
+
+    DatabaseSource source(filename);
+    std::vector<uint32_t> timestamps = source.GetTimestamps();
+    std::vector<uint32_t> snapshots = source.GetSnapshotTimestamps();
+    frame.assign(numSlots, glm::vec2(0.0f));
+    if (timestamps.empty()) {
+        return 0;
+    }
+    uint32_t last = timestamps.back();
+    size_t first = 0;
+    std::vector<uint32_t>::iterator snapshot = std::upper_bound(snapshots.begin(), snapshots.end(), last);
+    if (snapshot != snapshots.begin()) {
+        source.GetSnapshot(*(snapshot - 1), frame.data(), frame.size());
+        first = std::lower_bound(timestamps.begin(), timestamps.end(), *(snapshot - 1)) - timestamps.begin();
+    }
+    for (size_t i = first; i < timestamps.size(); i++) {
+        size_t numUpdates;
+        const update_t* updates = source.GetDelta(timestamps[i], numUpdates);
+        for (size_t j = 0; j < numUpdates; j++) {
+            if (updates[j].index < frame.size()) {
+                frame[updates[j].index] = glm::vec2(updates[j].lon, updates[j].lat);
+            }
+        }
+    }
+    return last;
+}
+
+int main(int argc, char* argv[]) {
+    const char* output = NULL;
+    bool append = false;
+    bool reversible = false;
+    size_t memoryMB = 1024;
+    size_t numThreads = 0;
+    std::vector<const char*> inputs;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--append") {
+            append = true;
+        } else if (arg == "--reversible") {
+            reversible = true;
+        } else if (arg == "--memory" && i + 1 < argc) {
+            memoryMB = atoi(argv[++i]);
+        } else if (arg == "--threads" && i + 1 < argc) {
+            numThreads = atoi(argv[++i]);
+        } else if (arg == "-o" && i + 1 < argc) {
+            output = argv[++i];
+        } else {
+            inputs.push_back(argv[i]);
+        }
+    }
+    if (output == NULL || inputs.empty()) {
+        spdlog::error("usage: {} [--append] [--reversible] [--memory MB] [--threads N] -o output input...",
+                      argv[0]);
+        return 1;
+    }
+    if (append && FrameSource::IsContainer(output)) {
+        spdlog::error("--append needs a database, .tldm containers are written once");
+        return 1;
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::unordered_map<std::string, uint32_t> existing;
+    std::vector<glm::vec2> frame;
+    uint32_t lastTimestamp = 0;
+    if (append) {
+        lastTimestamp = ReadExisting(output, existing, frame);
+        spdlog::info("Appending to {}: {} slots, last frame at {}", output, existing.size(), lastTimestamp);
+    }
+
+    Ingest ingest(memoryMB << 20, numThreads, lastTimestamp, std::string(output) + ".run");
+    ingest.Read(inputs);
+
+    // slots in order of first appearance, after the existing ones
+    std::vector<std::string> names = ingest.GetNames().Names();
+    std::vector<uint32_t> order;
+    std::vector<glm::vec2> firstLocations;
+    ingest.GetFirstLocations(order, firstLocations);
+    std::vector<uint32_t> slots(names.size());
+    std::vector<std::pair<std::string, uint32_t> > newSlots;
+    size_t numExisting = frame.size();
+    for (size_t i = 0; i < order.size(); i++) {
+        uint32_t name = order[i];
+        std::unordered_map<std::string, uint32_t>::iterator it = existing.find(names[name]);
+        if (it != existing.end()) {
+            slots[name] = it->second;
+        } else {
+            slots[name] = frame.size();
+            frame.push_back(firstLocations[name]);
+            newSlots.push_back(std::make_pair(names[name], slots[name]));
+        }
+    }
+
+    std::unique_ptr<FrameWriter> writer;
+    if (append) {
+        DatabaseWriter* database = new DatabaseWriter(output, true, reversible);
+        writer.reset(database);
+        // new slots are not in the last snapshot, readers start them at 0
+        // and so must the reverse deltas
+        database->Resume(frame.data(), numExisting);
+    } else {
+        writer.reset(FrameWriter::Create(output, frame.size(), reversible));
+    }
+    for (size_t i = 0; i < newSlots.size(); i++) {
+        writer->AddSlot(newSlots[i].first, newSlots[i].second);
+    }
+
+    FrameBuilder builder(*writer, frame, slots, lastTimestamp);
+    bool first = !append;
+    ingest.Merge([&](const Record& record) {
+        if (first) {
+            // the first snapshot holds the first location of every dot
+            writer->AddSnapshot(record.timestamp, frame.data(), frame.size());
+            first = false;
+        }
+        builder.Add(record);
+    });
+    builder.Flush();
+    writer->Finish();
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    spdlog::info("Ingested {} frames and {} new dots in {:.1f} s", builder.GetNumDeltas(), newSlots.size(), seconds);
+    return 0;
+}
@@ -5,6 +5,14 @@
 # Convert compressed event dump to frame database
 #
 # Usage: cd data; ../tools/prepare_data events_201905.csv.gz
+#
+# The native tool does all steps in one go, using every core:
+#   cat events_201905.csv.bz2 | bunzip2 | tldm-ingest -o tldm.db -
+# and adds further days to an existing database with --append.
+#
+# Slots are numbered in order of first appearance; renumbering them along
+# a Hilbert curve keeps nearby dots together in every frame:
+#   tldm-convert --hilbert tldm.db tldm-hilbert.db
 
 echo "Uncompressing event dumps and splitting to per-day files..."
 # unzip and split original event dump to per-day files to help sorting